@@ -0,0 +1,79 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_ANNOTATIONS_H_
+#define BBQUE_OPENCV_DEMO_ANNOTATIONS_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * @brief The (compact) output of an effect, beside its gray-level image
+ *
+ * Effects produce a single channel image and a list of annotations, which
+ * are rendered on top of the composited image only by the sinks which
+ * actually need them. Vectors are cleared but never shrunk, thus after the
+ * first few frames no further allocation is required.
+ */
+struct Annotations {
+
+	/** The keypoints detected by the effect (if any) */
+	std::vector<cv::KeyPoint> keypoints;
+
+	/** The bounding boxes of the detected objects (if any) */
+	std::vector<cv::Rect> boxes;
+
+	/** The (optional) label of each box, which must outlive the frame */
+	std::vector<const char *> labels;
+
+	/** The (previous, current) positions of tracked keypoints (if any) */
+	std::vector<std::pair<cv::Point2f, cv::Point2f> > tracks;
+
+	void clear() {
+		keypoints.clear();
+		boxes.clear();
+		labels.clear();
+		tracks.clear();
+	}
+
+	bool empty() const {
+		return keypoints.empty() && boxes.empty() && tracks.empty();
+	}
+
+	/**
+	 * @brief Render the annotations on the specified (3 channels) image
+	 */
+	void draw(cv::Mat &img) const {
+		std::vector<cv::KeyPoint>::const_iterator kp = keypoints.begin();
+		for ( ; kp != keypoints.end(); ++kp)
+			cv::circle(img, kp->pt, 4, cv::Scalar(0,0,255,0));
+		for (size_t i = 0; i < tracks.size(); ++i)
+			cv::line(img, tracks[i].first, tracks[i].second,
+					cv::Scalar(0,255,0,0));
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			cv::rectangle(img, boxes[i], cv::Scalar(0,255,0,0));
+			if (i >= labels.size())
+				continue;
+			cv::putText(img, labels[i],
+					cv::Point(boxes[i].x + 2, boxes[i].y + 12),
+					cv::FONT_HERSHEY_COMPLEX_SMALL, 0.5,
+					cv::Scalar(0,255,0), 1, CV_AA);
+		}
+	}
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_ANNOTATIONS_H_
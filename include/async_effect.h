@@ -0,0 +1,151 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_ASYNC_EFFECT_H_
+#define BBQUE_OPENCV_DEMO_ASYNC_EFFECT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "annotations.h"
+#include "memory_budget.h"
+
+/**
+ * @brief An effect running in background, on the latest submitted frame
+ *
+ * Frames are posted into a single slot mailbox: a frame submitted while
+ * the effect is still busy on a previous one replaces the frame pending
+ * (if any), which is dropped. Thus the effect always runs on the most
+ * recent frame, and the submitting thread never waits for it.
+ *
+ * The most recent completed result is kept, tagged with its source frame,
+ * until it is fetched or replaced by a newer one.
+ */
+class AsyncEffect {
+
+public:
+
+	/**
+	 * @brief The effect, producing annotations from a gray-level frame
+	 */
+	typedef std::function<void(uint8_t effect, cv::Mat const &gray,
+			Annotations &result)> Effect;
+
+	struct Result {
+		Annotations annotations;
+		/** The effect which produced the result */
+		uint8_t effect;
+		/** The number of the source frame */
+		uint32_t frame;
+		/** The size of the source frame, i.e. of the annotations space */
+		cv::Size size;
+		/** When the source frame has been grabbed [ms] */
+		double grab_ms;
+		/** When the source frame has been submitted [ms] */
+		double submit_ms;
+		/** When the result has been completed [ms] */
+		double done_ms;
+	};
+
+	AsyncEffect();
+
+	~AsyncEffect();
+
+	/**
+	 * @brief Account the mailbox buffers to a subsystem
+	 */
+	void Attach(MemoryBudget &memory, uint8_t subsys);
+
+	void Start(Effect const &effect);
+
+	void Stop();
+
+	bool Running() const {
+		return worker.joinable();
+	}
+
+	/**
+	 * @brief Post a (copy of the) frame to be processed by an effect
+	 *
+	 * @param grab_ms when the frame has been grabbed, on the NowMs()
+	 * timeline
+	 */
+	void Submit(uint8_t effect, cv::Mat const &gray, uint32_t frame,
+			double grab_ms);
+
+	/**
+	 * @brief Get the latest result, if not already fetched
+	 *
+	 * @return false if no new result has been completed since the last
+	 * fetch
+	 */
+	bool Fetch(Result &result);
+
+	/**
+	 * @brief Wait for the effect to complete all the submitted frames
+	 */
+	void Wait();
+
+	uint32_t Completed() const {
+		return completed;
+	}
+
+	uint32_t Dropped() const {
+		return dropped;
+	}
+
+	/**
+	 * @brief The current time [ms], on the timeline of the results
+	 */
+	static double NowMs();
+
+private:
+
+	std::thread worker;
+
+	std::mutex mtx;
+	std::condition_variable submit_cv;
+	std::condition_variable idle_cv;
+
+	Effect effect;
+
+	/** The frame pending, and the one being processed */
+	cv::Mat pending;
+	cv::Mat working;
+	Result pending_tag;
+	bool has_pending;
+	bool busy;
+	bool stopping;
+
+	/** The result being produced, and the latest completed one */
+	Result work;
+	Result done;
+	bool has_done;
+
+	uint32_t completed;
+	uint32_t dropped;
+
+	void Worker();
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_ASYNC_EFFECT_H_
@@ -0,0 +1,130 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_CALIBRATION_H_
+#define BBQUE_OPENCV_DEMO_CALIBRATION_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <bbque/utils/timer.h>
+
+/**
+ * @brief Measure the cost of each configuration and derive a recipe
+ *
+ * The calibration plan sweeps all the combinations of effects, resolutions
+ * and thread counts (powers of two, up-to the maximum). For each one, after
+ * some warm-up frames, the achieved framerate, the CPU usage and the peak
+ * resident memory are measured.
+ *
+ * The generated recipe has an AWM for each thread count, whose:
+ * - PE quantity is the highest CPU usage measured with that thread count
+ * - memory quantity is the highest peak memory measured, plus a margin
+ * - value is the average, over effects, of the best quality achievable,
+ *   where quality is the fraction of the maximum resolution processed at
+ *   the target framerate
+ * AWMs which cost more but do not provide more value are dropped.
+ */
+class Calibration {
+
+public:
+
+	struct Config {
+		uint8_t effect;
+		uint8_t res;
+		uint32_t threads;
+	};
+
+	struct Measure {
+		Config cfg;
+		uint32_t pixels;
+		double fps;
+		double cpu_pct;
+		uint64_t mem_peak;
+	};
+
+	/**
+	 * @param recipe the path of the recipe to generate
+	 * @param effects the effects to calibrate
+	 * @param resolutions the number of resolution presets
+	 * @param threads_max the maximum number of threads
+	 * @param fps_max the target framerate
+	 * @param frames the frames measured for each configuration
+	 */
+	Calibration(std::string const &recipe,
+			std::vector<uint8_t> const &effects,
+			uint8_t resolutions, uint32_t threads_max,
+			uint8_t fps_max, uint32_t frames);
+
+	bool Done() const {
+		return (cur >= plan.size());
+	}
+
+	Config const & Current() const {
+		return plan[cur];
+	}
+
+	/**
+	 * @brief Account for a frame processed with the current configuration
+	 *
+	 * @param pixels the size of the processed frame
+	 * @return true when the current configuration has been measured, and
+	 * thus the next one should be applied
+	 */
+	bool Frame(uint32_t pixels);
+
+	/**
+	 * @brief Write the recipe derived from all the measurements
+	 *
+	 * @param effect_names the names of effects, as reported by comments
+	 */
+	bool WriteRecipe(char const * const *effect_names) const;
+
+	/**
+	 * @brief Read the (sorted) AWM ids of a recipe
+	 *
+	 * Either a generated recipe, or any other, is accepted: just the
+	 * "<awm id=...>" elements are looked for.
+	 *
+	 * @return false if the recipe could not be read, or has no AWMs
+	 */
+	static bool ReadRecipeAWMs(std::string const &path,
+			std::vector<uint8_t> &awms);
+
+private:
+
+	std::string recipe;
+
+	uint8_t fps_max;
+
+	std::vector<Config> plan;
+	size_t cur;
+
+	std::vector<Measure> measures;
+
+	/** Frames not measured at the beginning of each configuration */
+	uint32_t warmup;
+	uint32_t frames;
+	uint32_t count;
+
+	bbque::utils::Timer tmr;
+	double tstart;
+	double tcpu;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_CALIBRATION_H_
@@ -0,0 +1,113 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_CONTROL_CHANNEL_H_
+#define BBQUE_OPENCV_DEMO_CONTROL_CHANNEL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "spsc_queue.h"
+
+/**
+ * @brief The maximum number of commands pending
+ */
+#define CONTROL_QUEUE_SIZE 64
+
+/**
+ * @brief A command, as received on the control channel
+ *
+ * Commands are text lines, with an optional argument:
+ * - "effect <none|canny|fast|surf|objrec|orb>"
+ * - "resolution <low|mid|hig|up|down>"
+ * - "fps <max fps>"
+ * - "snapshot"
+ * - "exit"
+ */
+struct ControlCommand {
+
+	enum Type {
+		CMD_EFFECT = 0,
+		CMD_RESOLUTION,
+		CMD_FPS,
+		CMD_SNAPSHOT,
+		CMD_EXIT,
+		CMD_COUNT // This must be the last element
+	};
+
+	static const char *typeStr[CMD_COUNT];
+
+	uint8_t type;
+	/** The argument, still to be validated by who applies the command */
+	char arg[16];
+
+	/**
+	 * @brief Parse a command line
+	 */
+	static bool Parse(char const *line, ControlCommand &cmd);
+
+};
+
+/**
+ * @brief A channel to control an instance at run-time
+ *
+ * Commands are written, by any client, into a named pipe. A listener
+ * thread parses them and queues them to the EXC, which applies them
+ * (between two frames) with no locking at all.
+ */
+class ControlChannel {
+
+public:
+
+	ControlChannel();
+
+	~ControlChannel();
+
+	/**
+	 * @brief Create the named pipe, and start listening for commands
+	 */
+	bool Open(std::string const &path);
+
+	/**
+	 * @brief Stop listening, and remove the named pipe
+	 */
+	void Close();
+
+	/**
+	 * @brief Get the next pending command (EXC side)
+	 */
+	bool Pop(ControlCommand &cmd) {
+		return queue.Pop(cmd);
+	}
+
+private:
+
+	std::string path;
+	int fd;
+
+	std::thread listener;
+	std::atomic<bool> running;
+
+	SpscQueue<ControlCommand, CONTROL_QUEUE_SIZE> queue;
+
+	void Listen();
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_CONTROL_CHANNEL_H_
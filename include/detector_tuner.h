@@ -0,0 +1,132 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_DETECTOR_TUNER_H_
+#define BBQUE_OPENCV_DEMO_DETECTOR_TUNER_H_
+
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief The over-budget factor tolerated before raising the parameter
+ */
+#define DETECTOR_TUNER_HIGH_WATER 1.0
+
+/**
+ * @brief The under-budget factor required before lowering the parameter
+ *
+ * The band in between avoids oscillations around the budget.
+ */
+#define DETECTOR_TUNER_LOW_WATER 0.7
+
+/**
+ * @brief The load aimed at by raising the parameter, within the band
+ */
+#define DETECTOR_TUNER_TARGET 0.85
+
+/**
+ * @brief The maximum (multiplicative) change of a single adjustment
+ */
+#define DETECTOR_TUNER_STEP_MAX 2.0
+
+/**
+ * @brief The (multiplicative) change lowering the parameter
+ */
+#define DETECTOR_TUNER_STEP_DOWN 1.1
+
+/**
+ * @brief A frame-to-frame controller of a detector sensitivity
+ *
+ * The tuned parameter is a detection threshold, i.e. the higher its value
+ * the less the keypoints detected, and the less the time spent to detect
+ * and render them. After each frame the parameter is raised in proportion
+ * to how much the keypoints, or the effect time, exceeded their budget
+ * (aiming at a load a bit lower than the budget), while it is lowered
+ * (slowly) only once both are well within it.
+ */
+class DetectorTuner {
+
+public:
+
+	/**
+	 * @brief The per-frame budgets, a 0 value meaning no limit
+	 */
+	struct Budget {
+		uint32_t keypoints;
+		double effect_ms;
+
+		bool Enabled() const {
+			return keypoints || effect_ms;
+		}
+	};
+
+	/**
+	 * @param integral the parameter has just integer values
+	 */
+	DetectorTuner(char const *name, double value, double min, double max,
+			bool integral);
+
+	void SetBudget(Budget const &budget);
+
+	bool Enabled() const {
+		return budget.Enabled();
+	}
+
+	/**
+	 * @brief Account a processed frame and adjust the parameter
+	 *
+	 * @return true if the parameter value has been changed
+	 */
+	bool Update(uint32_t keypoints, double effect_ms);
+
+	double Value() const {
+		return value;
+	}
+
+	/**
+	 * @brief The fraction of the processed frames within the budget
+	 */
+	double Compliance() const {
+		return frames ? static_cast<double>(compliant) / frames : 1;
+	}
+
+	/**
+	 * @brief Dump the tuning metrics
+	 */
+	void Print(FILE *out) const;
+
+private:
+
+	char const *name;
+
+	Budget budget;
+
+	double value;
+	double min;
+	double max;
+	bool integral;
+
+	/** The range of values actually used */
+	double used_min;
+	double used_max;
+
+	uint32_t frames;
+	uint32_t compliant;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_DETECTOR_TUNER_H_
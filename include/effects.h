@@ -0,0 +1,91 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_EFFECTS_H_
+#define BBQUE_OPENCV_DEMO_EFFECTS_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * Rows to read beyond a strip to compute Canny edges within the strip:
+ * 3 for the 7x7 Gaussian, 1 for the 3x3 Sobel and 1 for the non-maxima
+ * suppression, plus some margin for the hysteresis. Gradients are thus
+ * exact, but edges are an approximation: the hysteresis (with a null low
+ * threshold) follows weak edges beyond any halo, thus an edge can be lost,
+ * or kept, depending on pixels out of the strip and its halo.
+ */
+#define EFFECT_CANNY_HALO 8
+
+/**
+ * Rows to read beyond a strip to detect FAST keypoints within the strip:
+ * 3 for the Bresenham circle and 1 for the non-maxima suppression.
+ */
+#define EFFECT_FAST_HALO 4
+
+/**
+ * @brief An horizontal strip of a region of a frame
+ *
+ * Effects working on local neighborhoods can process a frame, or just some
+ * regions of it, by strips, each one reading also the halo around it.
+ */
+struct Strip {
+	/** The rows produced by processing this strip */
+	cv::Range rows;
+	/** The rows read to process this strip, i.e. including the halos */
+	cv::Range halo;
+	/** The columns produced by processing this strip */
+	cv::Range cols;
+	/** The columns read to process this strip, i.e. including the halos */
+	cv::Range halo_cols;
+};
+
+/**
+ * @brief A region grown by the specified halo, clipped to the frame
+ */
+cv::Rect HaloRegion(cv::Rect const &region, cv::Size const &frame, int halo);
+
+/**
+ * @brief Split a region of a frame into (up-to) count strips
+ *
+ * Strips are appended, thus multiple regions can be processed by a
+ * single batch of strips.
+ */
+void SplitStrips(cv::Rect const &region, cv::Size const &frame,
+		uint32_t count, int halo, std::vector<Strip> &strips);
+
+/**
+ * @brief Canny edges of a strip
+ *
+ * These functions are reentrant: different strips can be processed
+ * concurrently, provided that each one uses its own scratch buffer. Unless
+ * the strip spans the whole image, edges approximate the ones of the whole
+ * image (see EFFECT_CANNY_HALO).
+ *
+ * @param gray the whole input (gray-level) image
+ * @param edges the whole output image, of the same size of gray
+ * @param scratch a scratch buffer, used to process the strip halo
+ */
+void CannyStrip(cv::Mat const &gray, cv::Mat &edges,
+		Strip const &strip, cv::Mat &scratch);
+
+/**
+ * @brief Keypoints of a strip, in image coordinates
+ */
+void DetectStrip(cv::Mat const &gray, cv::FeatureDetector const &fd,
+		Strip const &strip, std::vector<cv::KeyPoint> &kps);
+
+#endif // BBQUE_OPENCV_DEMO_EFFECTS_H_
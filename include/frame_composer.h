@@ -0,0 +1,116 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_FRAME_COMPOSER_H_
+#define BBQUE_OPENCV_DEMO_FRAME_COMPOSER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "annotations.h"
+#include "kernels.h"
+#include "memory_budget.h"
+
+// The opacity of the information box, in [0, 256]
+#define INFO_BOX_ALPHA 160
+
+// The width of the information box, and the height of each of its lines
+#define INFO_BOX_WIDTH 240
+#define INFO_LINE_YSPACE 11
+
+// The maximum number of lines, and their length, in the information box
+#define INFO_LINES_MAX 8
+#define INFO_LINE_LEN 64
+
+/**
+ * @brief The composition of the frames to display
+ *
+ * The (single channel) output of the effects is rendered in colors, with
+ * the annotations on top and a thumbnail of the source frame, the regions
+ * of interest are outlined and an information box, with some text lines,
+ * is blended at the bottom right corner. The composition is the same for
+ * a window, or for out-of-process viewers (e.g. by PreviewSink).
+ *
+ * Text lines are formatted into fixed buffers, and the box background is
+ * allocated once per size, thus composing a frame never allocates.
+ */
+class FrameComposer {
+
+public:
+
+	FrameComposer(Kernels const &kernels);
+
+	/**
+	 * @brief Account the information box background
+	 */
+	void Attach(MemoryBudget &memory, uint8_t subsys);
+
+	/**
+	 * @brief Drop the text lines of the previous composition
+	 */
+	void ClearInfo() {
+		info_lines = 0;
+	}
+
+	/**
+	 * @brief Add a (printf-like formatted) line to the information box
+	 *
+	 * Lines exceeding INFO_LINES_MAX are dropped.
+	 */
+	void Info(char const *fmt, ...)
+		__attribute__((format(printf, 2, 3)));
+
+	/**
+	 * @brief Compose a frame with the output of an effect (if any)
+	 *
+	 * @param frame the source frame, composed in place without effects
+	 * @param effects the effect output, empty if no effect is applied
+	 * @param regions the regions to outline, but one covering the frame
+	 * @param composition the 3 channels buffer, of the frame size, for
+	 * the effect output
+	 *
+	 * @return the image to display, either the frame or the composition
+	 */
+	cv::Mat & Compose(cv::Mat &frame, cv::Mat const &effects,
+			Annotations const &annotations,
+			std::vector<cv::Rect> const &regions,
+			cv::Mat &composition);
+
+	/**
+	 * @brief The last image composed
+	 */
+	cv::Mat const & Display() const {
+		return display;
+	}
+
+private:
+
+	Kernels const &kernels;
+
+	// The image to be displayed
+	cv::Mat display;
+
+	// The background of the information box
+	cv::Mat info_box;
+
+	char info[INFO_LINES_MAX][INFO_LINE_LEN];
+	uint8_t info_lines;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_FRAME_COMPOSER_H_
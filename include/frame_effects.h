@@ -0,0 +1,224 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_FRAME_EFFECTS_H_
+#define BBQUE_OPENCV_DEMO_FRAME_EFFECTS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "annotations.h"
+#include "detector_tuner.h"
+#include "effects.h"
+#include "hamming.h"
+#include "kernels.h"
+#include "memory_budget.h"
+#include "refdb.h"
+#include "stats.h"
+#include "worker_pool.h"
+
+// The detectors sensitivity: the initial value and the range where it is
+// tuned, to fit the keypoints and effect time budgets
+#define FAST_THRESHOLD 10
+#define FAST_THRESHOLD_MIN 5
+#define FAST_THRESHOLD_MAX 200
+#define SURF_HESSIAN 400.0
+#define SURF_HESSIAN_MIN 100.0
+#define SURF_HESSIAN_MAX 20000.0
+
+enum EffectType {
+	EFF_NONE = 0,
+	EFF_CANNY,
+	EFF_FAST,
+	EFF_SURF,
+	EFF_OREC,
+	EFF_ORB,
+	EFF_COUNT // This must be the last element
+};
+
+extern const char *effectStr[EFF_COUNT];
+
+/**
+ * @brief The effects applied to frames, independently of any RTRM
+ *
+ * This is the core of the frame pipeline: Canny edges, and the keypoints
+ * analytics (FAST, SURF, object recognition and ORB tracking), restricted
+ * to some regions of the frame and run by a pool of workers. Frames are
+ * sourced (e.g. by FrameSource) and the results sunk (e.g. by ResultsSink,
+ * or by FrameComposer and PreviewSink) by the caller, thus the pipeline
+ * can be embedded in any service, as well as profiled in isolation.
+ *
+ * The workers, and the pixel kernels, are provided by the caller, which
+ * sizes and pins them. Effects can be applied by a thread other than the
+ * caller one, but just one effect at a time.
+ */
+class FrameEffects {
+
+public:
+
+	FrameEffects(WorkerPool &pool, Kernels const &kernels);
+
+	/**
+	 * @brief Account the descriptors and scratch buffers
+	 */
+	void Attach(MemoryBudget &memory);
+
+	/**
+	 * @brief Load the reference objects database, for EFF_OREC
+	 */
+	bool LoadRefDB(std::string const &path);
+
+	RefDB const & References() const {
+		return refdb;
+	}
+
+	/**
+	 * @brief Check whether an effect can be applied
+	 */
+	bool Available(uint8_t effect) const {
+		return effect < EFF_COUNT && (effect != EFF_OREC || refdb.Loaded());
+	}
+
+	/**
+	 * @brief Adapt the detectors sensitivity to the budgets (if any)
+	 */
+	void SetBudget(DetectorTuner::Budget const &budget);
+
+	/**
+	 * @brief Get rid of the first call costs, at the size of this image
+	 *
+	 * The image is overwritten by a flat scene, but a box: just a few
+	 * keypoints, to run all the code paths at a negligible cost.
+	 */
+	void Prewarm(cv::Mat &gray);
+
+	/**
+	 * @brief Forget the keypoints tracked, e.g. on a resolution switch
+	 */
+	void Reset();
+
+	/**
+	 * @brief Canny edges of the regions of a (BGR) frame
+	 *
+	 * Overlapping regions are merged, thus strips never share edges.
+	 *
+	 * @param gray the gray-level frame, just the regions are converted
+	 * @param edges the output, out of the regions is left untouched
+	 */
+	void Canny(cv::Mat const &frame, std::vector<cv::Rect> const &regions,
+			cv::Mat &gray, cv::Mat &edges);
+
+	/**
+	 * @brief Keypoints analytics on the regions of a gray-level frame
+	 *
+	 * The detectors are tuned on the time spent and the keypoints found.
+	 * Overlapping regions are merged, thus keypoints are never repeated.
+	 *
+	 * @return false if the effect is not available
+	 */
+	bool Detect(uint8_t effect, cv::Mat const &gray,
+			std::vector<cv::Rect> const &regions, Annotations &result);
+
+	/**
+	 * @brief Tune a detector on its last detection
+	 */
+	void Tune(uint8_t effect, uint32_t kps, double teffect);
+
+	cv::FeatureDetector const & FastDetector() const {
+		return *fast_detector;
+	}
+
+	DetectorTuner const & Tuner(uint8_t effect) const {
+		return (effect == EFF_SURF) ? surf_tuner : fast_tuner;
+	}
+
+	/**
+	 * @brief The bytes of the keypoints buffers (by their capacity)
+	 */
+	size_t KeypointsBytes() const;
+
+	uint32_t ObjectsFound() const {
+		return orec_found;
+	}
+
+	size_t Matches() const {
+		return orb_matches.size();
+	}
+
+	char const * MatcherImpl() const {
+		return hamming.Impl();
+	}
+
+	Stats const & QueryMs() const {
+		return orec_query_ms;
+	}
+
+	Stats const & MatchMs() const {
+		return orb_match_ms;
+	}
+
+	void Print(FILE *out) const;
+
+private:
+
+	WorkerPool &pool;
+	Kernels const &kernels;
+	MemoryBudget *memory;
+
+	// The (disjoint) regions processed, by strips
+	std::vector<cv::Rect> merged;
+	std::vector<Strip> strips;
+	std::vector<cv::Mat> strips_scratch;
+	std::vector<std::vector<cv::KeyPoint> > strips_kps;
+	std::vector<cv::KeyPoint> region_kps;
+
+	cv::Ptr<cv::FeatureDetector> fast_detector;
+	cv::Ptr<cv::FeatureDetector> surf_detector;
+
+	// Keep the detected keypoints, and detection time, within budget
+	DetectorTuner fast_tuner;
+	DetectorTuner surf_tuner;
+
+	// The reference objects database, used for object recognition
+	RefDB refdb;
+	cv::Ptr<cv::Feature2D> orec_features;
+	cv::Mat orec_desc;
+	uint32_t orec_found;
+	Stats orec_query_ms;
+
+	// Binary descriptors, matched frame-to-frame
+	cv::Ptr<cv::Feature2D> orb_features;
+	cv::Mat orb_desc;
+	cv::Mat orb_prev_desc;
+	std::vector<cv::KeyPoint> orb_prev_kps;
+	std::vector<cv::DMatch> orb_matches;
+	HammingMatcher hamming;
+	Stats orb_match_ms;
+
+	void DetectFast(cv::Mat const &gray,
+			std::vector<cv::Rect> const &regions, Annotations &result);
+	void DetectSurf(cv::Mat const &gray,
+			std::vector<cv::Rect> const &regions, Annotations &result);
+	void DetectObjRec(cv::Mat const &gray, Annotations &result);
+	void DetectOrb(cv::Mat const &gray, Annotations &result);
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_FRAME_EFFECTS_H_
@@ -0,0 +1,221 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_FRAME_SOURCE_H_
+#define BBQUE_OPENCV_DEMO_FRAME_SOURCE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "memory_budget.h"
+#include "shm_ring.h"
+#include "synthetic_source.h"
+
+// The maximum number of stale frames skipped before processing one, when
+// latency bounded (i.e. the depth of a camera driver queue)
+#define LATENCY_SKIPS_MAX 4
+
+// A camera grab returning within this time [ms] got a frame queued by the
+// driver, rather than waiting for a new one
+#define LATENCY_QUEUED_MS 2.0
+
+/**
+ * @brief The source of the frames of the pipeline
+ *
+ * Frames are read from a V4L2 camera, a recorded video, a synthetic
+ * source ("synth:" prefix) or a frames ring shared by another process
+ * ("shm:" prefix), and scaled down to the size of the caller buffer.
+ *
+ * Cameras are grabbed one frame in advance, unless latency bounded: then
+ * frames are grabbed right when read, draining the ones queued by the
+ * driver meanwhile, and rings are read from their newest frame.
+ *
+ * Each frame is tagged with the time it has been captured, on the
+ * AsyncEffect::NowMs() (steady clock, system-wide) timeline: when grabbed
+ * for cameras, when published by the producer for rings, when due for
+ * paced synthetic sources, and when read otherwise (recorded, or unpaced,
+ * sources have no capture time of their own). The latency from that time
+ * thus includes the time a frame waited in a ring, or to be read.
+ */
+class FrameSource {
+
+public:
+
+	enum Type {
+		SRC_CAMERA = 0,
+		SRC_VIDEO,
+		SRC_SYNTH,
+		SRC_SHM,
+		SRC_COUNT // This must be the last element
+	};
+
+	static const char *typeStr[SRC_COUNT];
+
+	enum Status {
+		FRAME_OK = 0,
+		FRAME_END,
+		FRAME_ERROR
+	};
+
+	/**
+	 * @param spec a video path, a synthetic source or ring specification,
+	 * or empty to read from the camera
+	 * @param id the camera (i.e. /dev/videoID) to read from
+	 */
+	FrameSource(std::string const &spec, uint8_t id);
+
+	/**
+	 * @brief Account the buffer of the native (not scaled) frames
+	 */
+	void Attach(MemoryBudget &memory, uint8_t subsys);
+
+	/**
+	 * @brief Open the source, and get its native resolution
+	 *
+	 * This is (most likely) slow, and independent of the rest of the
+	 * pipeline, thus it could be run by another thread meanwhile.
+	 */
+	bool Open();
+
+	void Close();
+
+	uint8_t GetType() const {
+		return type;
+	}
+
+	std::string const & Spec() const {
+		return spec;
+	}
+
+	uint8_t Id() const {
+		return id;
+	}
+
+	/**
+	 * @brief The source name, e.g. to label its window
+	 */
+	std::string const & Name() const {
+		return name;
+	}
+
+	cv::Size NativeSize() const {
+		return native_size;
+	}
+
+	/**
+	 * @brief Check whether frames are delivered at their own pace
+	 *
+	 * Recorded, or unpaced, sources are read at the pace of processing,
+	 * thus the next frame is never newer than the current one.
+	 */
+	bool Live() const {
+		return type == SRC_CAMERA || type == SRC_SHM ||
+			(type == SRC_SYNTH && synth.GetConfig().fps);
+	}
+
+	/**
+	 * @brief Read the newest frames, rather than the next ones
+	 */
+	void SetLatencyBounded(bool bounded) {
+		latency_bounded = bounded;
+	}
+
+	/**
+	 * @brief Start grabbing frames, e.g. at each (re)configuration
+	 */
+	bool Start();
+
+	/**
+	 * @brief Read the next frame, scaled to the size of the frame buffer
+	 *
+	 * @return FRAME_END once a video, or a ring, is over
+	 */
+	Status Read(cv::Mat &frame);
+
+	/**
+	 * @brief Read a video again from its first frame
+	 *
+	 * @return false if the source is not a recorded video
+	 */
+	bool Rewind();
+
+	/**
+	 * @brief The last frame read, at the native resolution
+	 *
+	 * Rings are read in place, thus their frames are just the scaled ones.
+	 */
+	cv::Mat const & Native() const {
+		return native_last;
+	}
+
+	/**
+	 * @brief When the last frame read has been captured [ms]
+	 */
+	double GrabMs() const {
+		return grab_ms;
+	}
+
+	/**
+	 * @brief The stale frames skipped, when latency bounded
+	 */
+	uint32_t Skipped() const {
+		return skipped;
+	}
+
+	void Print(FILE *out) const;
+
+private:
+
+	uint8_t type;
+	std::string spec;
+	uint8_t id;
+	std::string name;
+	cv::Size native_size;
+
+	cv::VideoCapture cap;
+	SyntheticSource synth;
+	ShmRing ring;
+
+	// The frame as read from the source (at max resolution), and the
+	// last one read at that resolution (either this or the caller one)
+	cv::Mat native;
+	cv::Mat native_last;
+
+	bool latency_bounded;
+	uint32_t skipped;
+
+	// When the current frame, and the next one (just for cameras
+	// grabbed in advance), have been grabbed [ms]
+	double grab_ms;
+	double grab_next_ms;
+
+	bool OpenVideo();
+	bool OpenCamera();
+	bool OpenSynth();
+	bool OpenShm();
+
+	bool GrabFromCamera();
+	Status ReadFromVideo(cv::Mat &frame);
+	Status ReadFromCamera(cv::Mat &frame);
+	Status ReadFromSynth(cv::Mat &frame);
+	Status ReadFromShm(cv::Mat &frame);
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_FRAME_SOURCE_H_
@@ -0,0 +1,83 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_HAMMING_H_
+#define BBQUE_OPENCV_DEMO_HAMMING_H_
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A brute force matcher for binary (e.g. ORB, BRIEF) descriptors
+ *
+ * The Hamming distance is computed by the best popcount implementation
+ * available on the running CPU, which is selected at construction time:
+ * - AVX2: 32 bytes per step, by nibble lookup and SAD accumulation
+ * - POPCNT: 8 bytes per step, by the hardware popcount instruction
+ * - Generic: 8 bytes per step, by the compiler provided popcount
+ *
+ * The distance of a train descriptor is abandoned (early exit) as soon as
+ * the partial distance is not better than the second best distance found
+ * so far for the same query descriptor.
+ */
+class HammingMatcher {
+
+public:
+
+	/**
+	 * @brief Compute the Hamming distance, up-to a bound
+	 *
+	 * @param len descriptors length, in bytes (a multiple of 8)
+	 * @param bound the computation is interrupted, returning a value not
+	 * smaller than bound, once the partial distance reaches this bound
+	 */
+	typedef uint32_t (*DistanceFn)(uint8_t const *a, uint8_t const *b,
+			uint32_t len, uint32_t bound);
+
+	HammingMatcher();
+
+	/**
+	 * @brief The name of the selected implementation
+	 */
+	const char *Impl() const {
+		return impl;
+	}
+
+	/**
+	 * @brief Match each query descriptor with its nearest train one
+	 *
+	 * A match is reported only if its distance is not greater than
+	 * max_dist, and smaller than ratio times the distance of the second
+	 * nearest train descriptor.
+	 */
+	void Match(cv::Mat const &query, cv::Mat const &train,
+			std::vector<cv::DMatch> &matches,
+			uint32_t max_dist = 64, float ratio = 0.8);
+
+	DistanceFn Distance() const {
+		return distance;
+	}
+
+private:
+
+	const char *impl;
+
+	DistanceFn distance;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_HAMMING_H_
@@ -0,0 +1,117 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BBQUE_OPENCV_DEMO_KERNELS_H_
+#define BBQUE_OPENCV_DEMO_KERNELS_H_
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Pixel kernels of the frame path, outside of the detectors
+ *
+ * Each kernel is provided by the best implementation available on the
+ * running CPU, which is selected at construction time:
+ * - AVX2: 32 pixels (or bytes) per step
+ * - SSE4.1: 16 pixels (or bytes) per step
+ * - Generic: plain C++, one pixel per step
+ *
+ * All kernels write into already allocated outputs (e.g. ROIs), with the
+ * same size of their inputs, unless otherwise specified.
+ */
+class Kernels {
+
+public:
+
+	enum Isa {
+		ISA_GENERIC = 0,
+		ISA_SSE41,
+		ISA_AVX2,
+		ISA_COUNT // This must be the last element
+	};
+
+	static const char *isaStr[ISA_COUNT];
+
+	/** Convert a row of BGR pixels into gray levels */
+	typedef void (*BgrToGrayFn)(uint8_t const *bgr, uint8_t *gray,
+			uint32_t count);
+
+	/** Expand a row of gray levels into (3 channels) RGB pixels */
+	typedef void (*GrayToRgbFn)(uint8_t const *gray, uint8_t *rgb,
+			uint32_t count);
+
+	/** Accumulate a row of bytes into 16 bits sums */
+	typedef void (*AccumulateFn)(uint8_t const *src, uint16_t *acc,
+			uint32_t count);
+
+	/** Blend a row of bytes: dst = (src * alpha + dst * (256 - alpha)) / 256 */
+	typedef void (*BlendFn)(uint8_t const *src, uint8_t *dst,
+			uint32_t count, uint16_t alpha);
+
+	/**
+	 * @brief Select the best implementation up-to the specified one
+	 */
+	Kernels(uint8_t isa = ISA_AVX2);
+
+	/**
+	 * @brief The selected implementation
+	 */
+	uint8_t Impl() const {
+		return isa;
+	}
+
+	/**
+	 * @brief Convert a BGR image into gray levels (as CV_BGR2GRAY)
+	 */
+	void BgrToGray(cv::Mat const &bgr, cv::Mat &gray) const;
+
+	/**
+	 * @brief Convert a gray levels image into RGB (as CV_GRAY2RGB)
+	 */
+	void GrayToRgb(cv::Mat const &gray, cv::Mat &rgb) const;
+
+	/**
+	 * @brief Scale down a BGR image into a smaller one, e.g. a thumbnail
+	 *
+	 * Each destination pixel is the average of the (integer sized) box of
+	 * source pixels it covers, which is as good as INTER_AREA at integer
+	 * scaling factors and way cheaper than an interpolation.
+	 */
+	void Thumbnail(cv::Mat const &src, cv::Mat &dst) const;
+
+	/**
+	 * @brief Blend an image over another one, with the specified opacity
+	 *
+	 * @param alpha the opacity of src, in [0, 256]
+	 */
+	void Blend(cv::Mat const &src, cv::Mat &dst, uint16_t alpha) const;
+
+private:
+
+	uint8_t isa;
+
+	BgrToGrayFn bgr_to_gray;
+	GrayToRgbFn gray_to_rgb;
+	AccumulateFn accumulate;
+	BlendFn blend;
+
+	/** Thumbnail scratch buffers, reused across frames */
+	mutable std::vector<uint16_t> sums;
+	mutable std::vector<int> cols;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_KERNELS_H_
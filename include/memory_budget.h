@@ -0,0 +1,138 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BBQUE_OPENCV_DEMO_MEMORY_BUDGET_H_
+#define BBQUE_OPENCV_DEMO_MEMORY_BUDGET_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief The subsystems whose memory is accounted
+ */
+enum MemorySubsystem {
+	MEM_FRAMES = 0, // Captured, scaled and composed frames
+	MEM_EFFECTS,    // Effects outputs and scratch buffers
+	MEM_FEATURES,   // Keypoints and descriptors
+	MEM_REFDB,      // The (mapped) reference objects database
+	MEM_COUNT // This must be the last element
+};
+
+extern const char *memorySubsystemStr[MEM_COUNT];
+
+/**
+ * @brief Memory accounting, per subsystem, against a budget
+ *
+ * Mat buffers are accounted by attaching them to the allocator of their
+ * subsystem, before they are (re)allocated. Other memory (e.g. keypoint
+ * vectors and mappings) is accounted by explicitly reporting its size.
+ * All counters are lock-free, thus Mats could be (re)allocated by
+ * worker threads as well.
+ */
+class MemoryBudget {
+
+public:
+
+	MemoryBudget();
+
+	/**
+	 * @brief Account the (future) allocations of a Mat to a subsystem
+	 *
+	 * This is effective only on Mats without any data yet, or at their
+	 * next reallocation. Headers copied from the Mat share its allocator.
+	 */
+	void Attach(cv::Mat &mat, uint8_t subsys);
+
+	/**
+	 * @brief Report the memory used by a subsystem not by means of Mats
+	 */
+	void SetExternal(uint8_t subsys, size_t bytes);
+
+	/**
+	 * @brief Setup the budget for the accounted memory (0: unlimited)
+	 */
+	void SetLimit(size_t bytes) {
+		limit = bytes;
+	}
+
+	size_t Limit() const {
+		return limit;
+	}
+
+	size_t Used(uint8_t subsys) const {
+		return used[subsys] + external[subsys];
+	}
+
+	size_t Used() const;
+
+	size_t Peak(uint8_t subsys) const {
+		return peak[subsys];
+	}
+
+	size_t Peak() const {
+		return peak_total;
+	}
+
+	/**
+	 * @brief Check if the specified additional bytes fit the budget
+	 */
+	bool Fits(size_t bytes) const {
+		return !limit || (Used() + bytes <= limit);
+	}
+
+	bool Exceeded() const {
+		return !Fits(0);
+	}
+
+	/**
+	 * @brief Print usage and high-water marks of all subsystems
+	 */
+	void Print(FILE *out) const;
+
+private:
+
+	/**
+	 * @brief A Mat allocator accounting the memory of one subsystem
+	 */
+	class Allocator : public cv::MatAllocator {
+	public:
+		MemoryBudget *budget;
+		uint8_t subsys;
+
+		void allocate(int dims, const int *sizes, int type,
+				int *&refcount, uchar *&datastart, uchar *&data,
+				size_t *step);
+		void deallocate(int *refcount, uchar *datastart, uchar *data);
+	};
+
+	Allocator allocators[MEM_COUNT];
+
+	std::atomic<size_t> used[MEM_COUNT];
+	std::atomic<size_t> external[MEM_COUNT];
+	std::atomic<size_t> peak[MEM_COUNT];
+	std::atomic<size_t> peak_total;
+
+	size_t limit;
+
+	void Account(uint8_t subsys, ssize_t bytes);
+
+	static void UpdatePeak(std::atomic<size_t> &peak, size_t value);
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_MEMORY_BUDGET_H_
@@ -20,24 +20,105 @@
 #include <opencv2/opencv.hpp>
 #include <bbque/bbque_exc.h>
 
+#include <memory>
+
+#include "annotations.h"
+#include "async_effect.h"
+#include "calibration.h"
+#include "control_channel.h"
+#include "detector_tuner.h"
+#include "frame_composer.h"
+#include "frame_effects.h"
+#include "frame_source.h"
+#include "kernels.h"
+#include "memory_budget.h"
+#include "perf_counters.h"
+#include "preview_sink.h"
+#include "regions.h"
+#include "resolution.h"
+#include "resources.h"
+#include "results_sink.h"
+#include "stats.h"
+#include "strip_stream.h"
+#include "trace.h"
+#include "worker_pool.h"
+
+// The AWMs assumed when the recipe could not be read
 #define AWM_START_ID 	1
 #define AWM_UPPER_ID 	2
 
+// The directory of the installed recipes
+#ifndef BBQUE_OPENCV_DEMO_RECIPES_DIR
+# define BBQUE_OPENCV_DEMO_RECIPES_DIR "/etc/bbque/recipes"
+#endif
+
+// The time of a resolution switching frame, relative to the average frame
+// time, above which the switch is reported (and counted) as a stall. This is
+// just a measured threshold: stalling switches are neither prevented nor
+// reverted.
+#define RESOLUTION_SWITCH_BOUND 1.5
+
+// The fraction of the memory grant left to not accounted allocations,
+// e.g. temporaries internal to OpenCV functions
+#define MEMORY_BUDGET_HEADROOM 0.10
+
+// The margin on the predicted frame time required to scale up resolution
+#define RESOLUTION_UP_MARGIN 1.25
+
+// The maximum effects decimation: effects are applied at least on one
+// frame every DECIMATION_MAX
+#define DECIMATION_MAX 3
+
 using bbque::rtlib::BbqueEXC;
-using cv::VideoCapture;
 using cv::Mat;
 
 class OCVDemo : public BbqueEXC {
 
 public:
 
+	/**
+	 * @brief The options of the demo, as specified on the command line
+	 */
+	struct Config {
+		/** The video path, or source spec (e.g. "synth:", "shm:") */
+		std::string video;
+		/** The ID of the V4L2 webcam, if no video is specified */
+		uint8_t cid;
+		uint8_t fps_max;
+		/** The maximum number of frames to decode (0: all) */
+		uint32_t frames_max;
+		/** The effect to start with */
+		uint8_t effect;
+		bool headless;
+		/** The reference objects database (if not empty) */
+		std::string refdb;
+		/** The recipe to generate by calibration (if not empty) */
+		std::string calib_recipe;
+		uint32_t calib_frames;
+		/** The regions of interest, effects on whole frames if empty */
+		std::vector<RegionOfInterest> regions;
+		std::string trace_path;
+		/** Collect the hardware counters of each stage of the frames */
+		bool perf;
+		DetectorTuner::Budget detect_budget;
+		/** Run keypoints analytics in background */
+		bool async;
+		/** The rows of the streamed strips (0: disabled) */
+		uint32_t stream_rows;
+		PreviewSink::Config preview;
+		/** The named pipe receiving control commands (if not empty) */
+		std::string control_path;
+		ResultsSink::Config results;
+		/** The end-to-end latency budget [ms] of a frame (0: disabled) */
+		double latency_budget_ms;
+
+		Config();
+	};
+
 	OCVDemo(std::string const & name,
 			std::string const & recipe,
 			RTLIB_Services_t *rtlib,
-			std::string const & video,
-			uint8_t cid,
-			uint8_t fps_max,
-			uint32_t frames_max);
+			Config const & cfg);
 
 	virtual ~OCVDemo();
 
@@ -45,39 +126,43 @@ private:
 
 	double tstart;
 
-	enum ResolutionType {
-		RES_LOW = 0,
-		RES_MID,
-		RES_HIG,
-		RES_COUNT // This must be the last element
+public:
+
+	enum PerfStage {
+		STAGE_GRAB = 0,
+		STAGE_PROCESS,
+		STAGE_DISPLAY,
+		STAGE_COUNT // This must be the last element
 	};
-#define CAM_PRESET_WIDTH(TYPE) \
-	resolutions[TYPE].width
-#define CAM_PRESET_HEIGHT(TYPE) \
-	resolutions[TYPE].height
-
-	static const char *resolutionStr[RES_COUNT];
-
-	enum EffectType {
-		EFF_NONE = 0,
-		EFF_CANNY,
-		EFF_FAST,
-		EFF_SURF,
-		EFF_COUNT // This must be the last element
+
+	static const char *stageStr[STAGE_COUNT];
+
+	enum StartupPhase {
+		PHASE_SOURCE = 0,
+		PHASE_INIT,
+		PHASE_BUFFERS,
+		PHASE_GUI,
+		PHASE_SCHEDULE,
+		PHASE_CONFIGURE,
+		PHASE_FRAME,
+		PHASE_COUNT // This must be the last element
 	};
 
-	static const char *effectStr[EFF_COUNT];
+	static const char *phaseStr[PHASE_COUNT];
 
-	static struct Resolution {
-		uint16_t width;
-		uint16_t height;
-	} resolutions[RES_COUNT];
+private:
+
+	// The accounted memory, and its budget within the granted one. This
+	// is declared first, thus destroyed last: the buffers attached to it
+	// (by the members below) are accounted until they are released.
+	MemoryBudget memory;
+	bool memory_exhausted;
+
+	// The source of the frames, either live or recorded
+	FrameSource src;
+#define CAMERA_SOURCE (src.GetType() == FrameSource::SRC_CAMERA)
 
 	struct Camera {
-		bool using_camera;
-#define CAMERA_SOURCE cam.using_camera
-		std::string video;
-		uint8_t id;
 		uint8_t fps_max;
 		float fps_cur;
 		float fps_dev;
@@ -85,9 +170,9 @@ private:
 		uint32_t frames_total;
 		uint32_t frames_max;
 
-		VideoCapture cap;
 		Mat frame;
-		std::string wcap;
+		// The gray-level version of the current frame
+		Mat gray;
 
 		// Current camera resolution
 		Resolution max_res;
@@ -99,48 +184,228 @@ private:
 		// The effect to apply at the image
 		uint8_t effect_idx;
 
+		// Effects are applied on one frame every decimation, while
+		// the others just get the annotations of the last processed
+		uint8_t decimation;
+		uint8_t decimation_phase;
+		uint32_t analytics_count;
+		uint32_t analytics_total;
+		float analytics_fps;
+
 		// Resolution ID
 		uint8_t res_id;
+		// Resolution ID staged for the next frame boundary
+		uint8_t res_next;
+
+		// Frame buffers, pre-allocated for each resolution preset
+		struct Buffers {
+			Mat frame;
+			Mat gray;
+			Mat effects;
+			Mat composition;
+		} buffers[RES_COUNT];
+
+		// The regions to process, at the current resolution
+		std::vector<cv::Rect> regions;
+
+		// The (single channel) output of the current effect
 		Mat effects;
+		// The keypoints and boxes found by the current effect
+		Annotations annotations;
 	} cam;
 #define CAM_WIDTH(CAM) \
 	CAM.frame.cols
 #define CAM_HEIGHT(CAM) \
 	CAM.frame.rows
 
-	// The image to be displayed
-	Mat display;
+	// The 3 channels composition of effects and overlay info
+	Mat composition;
+
+	// The pixel kernels used to convert, scale and blend frames
+	Kernels kernels;
+
+	// The composition of the frames to display, or to preview
+	FrameComposer composer;
+
+	// Do not render any output (analytics only)
+	bool headless;
+
+	// The resources granted by the current AWM
+	ResourceGrant grant;
+
+	// The workers running effects, sized according to the grant
+	WorkerPool pool;
+
+	// The effects, and their detectors tuned within budget
+	FrameEffects fx;
+
+	// Keypoints analytics run in background (if enabled), the latest
+	// completed result being overlaid on the following frames
+	bool async_mode;
+	AsyncEffect async;
+	AsyncEffect::Result async_result;
+	Stats async_latency_ms;
+
+	// Canny and FAST streamed over the strips of the native frames (if
+	// enabled), thus at full resolution, with results at the display one
+	StripStream stream;
+	Stats stream_ms;
+	uint64_t stream_pixels;
+	size_t stream_scratch_peak;
+
+	// The calibration in progress (if any)
+	std::string calib_recipe;
+	uint32_t calib_frames;
+	std::unique_ptr<Calibration> calib;
+
+	// The reference objects database, used for object recognition
+	std::string refdb_path;
+
+	// The time spent in each reconfiguration
+	Stats configure_ms;
+
+	// The time spent in each startup phase, the source opening being
+	// overlapped with the initialization, and the time from construction
+	// to the first processed frame
+	double tcreate;
+	double tphase;
+	double startup_ms[PHASE_COUNT];
+	double first_frame_ms;
+
+	// The time of each frame, either resolution switching or not
+	Stats frame_ms;
+	Stats switch_ms;
+	uint32_t switch_stalls;
+
+	// The recent (moving average) cost of a frame at current resolution,
+	// and of the effect on (not decimated) frames
+	double frame_cost_ms;
+	double effect_cost_ms;
+
+	// The regions of interest, restricting Canny, FAST and SURF
+	std::vector<RegionOfInterest> regions;
+
+	// The Chrome trace written at exit, and on demand, if tracing is
+	// enabled (by the 't' key, or from the command line)
+	std::string trace_path;
+
+	// Hardware counters of the EXC and worker threads, accounted for each
+	// stage of the frames, by effect and resolution
+	bool perf_enabled;
+	PerfCounters perf;
+	uint32_t perf_threads;
+	std::vector<pid_t> perf_tids;
+	PerfCounters::Sample perf_mark;
+	PerfAccount perf_stages[STAGE_COUNT][EFF_COUNT][RES_COUNT];
+
+	// The displayed frames, published to out-of-process viewers, which
+	// are composed (even if headless) only when some viewer is attached
+	PreviewSink preview;
+
+	// Commands from other processes (e.g. to steer headless instances),
+	// applied between two frames
+	std::string control_path;
+	ControlChannel control;
+
+	// The results of each frame processed, for downstream consumers
+	ResultsSink results;
+
+	// Frames older than the latency budget [ms] (if not 0) are skipped, in
+	// favor of the newest one, and the glass-to-result latency accounted,
+	// from the frame capture time (see FrameSource) to its results.
+	// Just live sources (cameras, rings and paced synthetic ones) are
+	// latency bounded, the others are read sequentially anyway.
+	double latency_budget_ms;
+	Stats latency_ms;
+	uint32_t latency_skipped;
+	uint32_t latency_late;
+
+	// The AWM ids of the recipe (sorted), and the one the upper bound is
+	// set to at start, i.e. the second one (if any): the upper bound is
+	// then raised, one AWM at a time, while under framerate
+	std::vector<uint8_t> awms;
+	uint8_t awm_start;
 
 	RTLIB_Constraint_t cnstr;
 
-	RTLIB_ExitCode_t SetupSourceVideo();
-	RTLIB_ExitCode_t SetupSourceCamera();
+	/**
+	 * @brief The lowest AWM of the recipe above the specified one
+	 *
+	 * @return the specified AWM, if there is none above it
+	 */
+	uint8_t NextAWM(uint8_t awm) const;
+
+	RTLIB_ExitCode_t SetupSource();
+	RTLIB_ExitCode_t SetupEager();
+	void StartupReport(FILE *out) const;
 
-	RTLIB_ExitCode_t SetResolutionVideo(uint8_t type);
-	RTLIB_ExitCode_t SetResolutionCamera(uint8_t type);
+	cv::Size ResolutionSize(uint8_t type) const;
+	size_t ResolutionBytes(uint8_t type) const;
+	RTLIB_ExitCode_t PrewarmResolution(uint8_t type);
+	RTLIB_ExitCode_t PrewarmResolutions();
+	void TrimResolution(uint8_t type);
 	RTLIB_ExitCode_t SetResolution(uint8_t type);
+	RTLIB_ExitCode_t ApplyResolution();
+	bool DecimationFits(uint8_t decimation) const;
+	bool DecimationUp();
+	bool DecimationDown();
+	bool ResolutionFits(uint8_t type) const;
 	bool ResolutionUp();
 	bool ResolutionDown();
-	RTLIB_ExitCode_t getImageFromVideo();
-	RTLIB_ExitCode_t getImageFromCamera();
 	RTLIB_ExitCode_t getImage();
 	RTLIB_ExitCode_t showImage();
+	bool FrameStale() const;
+	void LatencyAccount(double grab_ms);
 	double updateFps();
 	void forceFps();
 
 	RTLIB_ExitCode_t doCanny();
-	RTLIB_ExitCode_t doFast();
-	RTLIB_ExitCode_t doSurf();
+	RTLIB_ExitCode_t doAnalytics(uint8_t effect, Mat const &gray,
+			Annotations &result);
 	RTLIB_ExitCode_t postProcess();
+	RTLIB_ExitCode_t postProcessAsync();
+	RTLIB_ExitCode_t doStream();
+
+	bool Streamed() const {
+		return stream.Rows() &&
+			(cam.effect_idx == EFF_CANNY || cam.effect_idx == EFF_FAST);
+	}
+
+	bool AnalyticsAsync() const {
+		return async.Running() && cam.effect_idx != EFF_CANNY &&
+			!Streamed();
+	}
 
 	void Snapshot() const;
 
+	/**
+	 * @brief Apply all the pending control commands
+	 *
+	 * @return RTLIB_EXC_WORKLOAD_NONE if the exit has been required
+	 */
+	RTLIB_ExitCode_t ControlApply();
+
+	/**
+	 * @brief Write the results of the current effect, on the specified frame
+	 */
+	void ResultsWrite(uint32_t frame);
+
+	void CalibrationApply();
+	void CalibrationStep();
+
+	void PerfMark();
+	void PerfStage(uint8_t stage);
+	void PerfReport() const;
+
 	RTLIB_ExitCode_t FrameratePolicy();
+	void MemoryBudgetSetup();
+	RTLIB_ExitCode_t MemoryPolicy();
 
 	RTLIB_ExitCode_t onSetup();
 	RTLIB_ExitCode_t onConfigure(uint8_t awm_id);
 	RTLIB_ExitCode_t onRun();
 	RTLIB_ExitCode_t onMonitor();
+	RTLIB_ExitCode_t onRelease();
 };
 
 #endif // BBQUE_OPENCV_DEMO_EXC_H_
@@ -0,0 +1,150 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_PERF_COUNTERS_H_
+#define BBQUE_OPENCV_DEMO_PERF_COUNTERS_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief Hardware performance counters of a set of threads
+ *
+ * For each monitored thread the counters are opened, by perf_event_open,
+ * as a group, thus all of them are scheduled (and multiplexed) together.
+ * Counts are summed over all the threads, and scaled to account for the
+ * time the group has not been running due to multiplexing.
+ *
+ * The cycles counter is mandatory: if it cannot be opened (e.g. a kernel
+ * without perf events, a too restrictive perf_event_paranoid, or a VM
+ * without a PMU) counters are not available at all. Each one of the other
+ * counters is just skipped if not supported.
+ */
+class PerfCounters {
+
+public:
+
+	typedef enum Counter {
+		PERF_CYCLES = 0,
+		PERF_INSTRUCTIONS,
+		PERF_LLC_MISSES,
+		PERF_BRANCH_MISSES,
+
+		PERF_COUNT
+	} Counter_t;
+
+	static char const *counterStr[PERF_COUNT];
+
+	/**
+	 * @brief A sample of all the counters
+	 */
+	struct Sample {
+		uint64_t values[PERF_COUNT];
+	};
+
+	PerfCounters();
+
+	~PerfCounters();
+
+	/**
+	 * @brief List the threads of this process, sorted by TID
+	 *
+	 * @return false if /proc/self/task is not readable
+	 */
+	static bool ProcessThreads(std::vector<pid_t> &tids);
+
+	/**
+	 * @brief Monitor the specified threads, replacing the current ones
+	 *
+	 * Threads which have already exited are just skipped.
+	 *
+	 * @return false if the counters are not available
+	 */
+	bool Open(std::vector<pid_t> const &tids);
+
+	void Close();
+
+	bool Available() const {
+		return !groups.empty();
+	}
+
+	/**
+	 * @brief Check if the specified counter is being collected
+	 */
+	bool Supported(Counter_t counter) const {
+		return supported[counter];
+	}
+
+	/**
+	 * @brief Read the counts accumulated since the threads were opened
+	 */
+	bool Read(Sample &sample) const;
+
+private:
+
+	struct Group {
+		int fds[PERF_COUNT];
+	};
+
+	std::vector<Group> groups;
+
+	bool supported[PERF_COUNT];
+
+	/** Not available counters are reported just once */
+	bool reported;
+
+};
+
+/**
+ * @brief An accumulator of counter deltas, measured on frames
+ */
+class PerfAccount {
+
+public:
+
+	PerfAccount() : frames(0), pixels(0) {
+		for (uint8_t c = 0; c < PerfCounters::PERF_COUNT; ++c)
+			totals[c] = 0;
+	}
+
+	/**
+	 * @brief Account the counts between two samples, on a frame
+	 */
+	void Add(PerfCounters::Sample const &from,
+			PerfCounters::Sample const &to, uint64_t frame_pixels);
+
+	uint64_t Frames() const {
+		return frames;
+	}
+
+	/**
+	 * @brief Dump the per-frame IPC and the misses per pixel
+	 */
+	void Print(FILE *out, PerfCounters const &perf,
+			char const *name) const;
+
+private:
+
+	uint64_t totals[PerfCounters::PERF_COUNT];
+	uint64_t frames;
+	uint64_t pixels;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_PERF_COUNTERS_H_
@@ -0,0 +1,92 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_PREVIEW_SINK_H_
+#define BBQUE_OPENCV_DEMO_PREVIEW_SINK_H_
+
+#include <cstdint>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "shm_ring.h"
+
+/**
+ * @brief Publish the displayed frames to out-of-process viewers
+ *
+ * Displayed frames are scaled down to a preview resolution, at a preview
+ * frame rate, into a double-buffered shared memory ring, which viewers
+ * (bbque-ocvdemo-viewer) attach to. Publishing a frame costs a single
+ * (scaling) copy, and nothing at all when no viewer is attached, since
+ * the frame is not even composed.
+ */
+class PreviewSink {
+
+public:
+
+	struct Config {
+		/** The ring name, empty to disable the preview */
+		std::string name;
+		/** The preview width, the height keeps the aspect ratio */
+		uint32_t width;
+		double fps;
+
+		Config();
+
+		bool Enabled() const {
+			return !name.empty();
+		}
+	};
+
+	PreviewSink(Config const &cfg);
+
+	bool Enabled() const {
+		return cfg.Enabled();
+	}
+
+	/**
+	 * @brief Create the ring, for frames of the specified aspect ratio
+	 */
+	bool Open(cv::Size native);
+
+	void Close();
+
+	/**
+	 * @brief Check whether a frame should be published now
+	 *
+	 * That is, a viewer is attached and the preview period elapsed.
+	 */
+	bool Due(double now_ms);
+
+	void Publish(cv::Mat const &display, double now_ms);
+
+	uint64_t Frames() const {
+		return ring.Frames();
+	}
+
+private:
+
+	Config cfg;
+
+	ShmRing ring;
+
+	/** The time of the next preview frame [ms] */
+	double next_ms;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_PREVIEW_SINK_H_
@@ -0,0 +1,179 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_REFDB_H_
+#define BBQUE_OPENCV_DEMO_REFDB_H_
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/flann/flann.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "annotations.h"
+
+#define REFDB_MAGIC   "OCVRDB"
+#define REFDB_VERSION 1
+#define REFDB_INDEX_SUFFIX ".flann"
+
+/**
+ * @brief A database of reference objects, indexed by their descriptors
+ *
+ * The database is built offline (by the bbque-ocvdemo-refdb tool) into a
+ * file with this layout:
+ * - a fixed size header (RefDB::Header)
+ * - the table of objects (RefDB::Object)
+ * - one object label (uint32_t) for each reference descriptor
+ * - the (page aligned) matrix of all the reference descriptors
+ *
+ * The FLANN index built on top of these descriptors (a kd-tree for float
+ * descriptors, LSH for binary ones) is saved in a sidecar file, with the
+ * REFDB_INDEX_SUFFIX appended to the database name.
+ *
+ * At load time the database file is memory mapped: the descriptors matrix
+ * is used in place by the FLANN index, and only the header and the objects
+ * table are checked, while the labels are checked by the queries using
+ * them. Thus the descriptors and labels pages are faulted in only when
+ * touched by a query. The FLANN index instead is read from its sidecar
+ * into the heap (by cv::flann::Index::load), thus startup time and memory
+ * still grow with the number of reference descriptors.
+ */
+class RefDB {
+
+public:
+
+	enum DescriptorType {
+		DESC_SURF = 0,
+		DESC_ORB,
+		DESC_COUNT // This must be the last element
+	};
+
+	static const char *descriptorStr[DESC_COUNT];
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t desc_type;
+		uint32_t desc_cols;
+		uint32_t desc_elem_size;
+		uint32_t obj_count;
+		uint32_t desc_count;
+		uint64_t obj_offset;
+		uint64_t labels_offset;
+		uint64_t desc_offset;
+	};
+
+	struct Object {
+		uint32_t id;
+		uint32_t desc_first;
+		uint32_t desc_count;
+		char name[52];
+	};
+
+	/**
+	 * @brief Get a features detector/extractor for the specified type
+	 *
+	 * The same (configuration of) detector must be used both to build the
+	 * database and to query it.
+	 */
+	static cv::Ptr<cv::Feature2D> NewFeatures(uint8_t type);
+
+	/**
+	 * @brief Write a new database, and its index, into the specified path
+	 *
+	 * @param desc the descriptors of all the objects, with the ones of
+	 * the same object being stored in consecutive rows as specified by
+	 * objects[i].desc_first and objects[i].desc_count
+	 */
+	static bool Build(std::string const &path, uint8_t type,
+			std::vector<Object> const &objects, cv::Mat const &desc);
+
+	RefDB();
+
+	~RefDB();
+
+	bool Load(std::string const &path);
+
+	void Unload();
+
+	bool Loaded() const {
+		return (hdr != NULL);
+	}
+
+	uint8_t Type() const {
+		return hdr->desc_type;
+	}
+
+	uint32_t Objects() const {
+		return hdr->obj_count;
+	}
+
+	double LoadTimeMs() const {
+		return load_ms;
+	}
+
+	size_t Size() const {
+		return length;
+	}
+
+	/**
+	 * @brief Recognize reference objects from a set of frame descriptors
+	 *
+	 * A box, and the corresponding label, are appended to the annotations
+	 * for each recognized object.
+	 *
+	 * @return the number of recognized objects
+	 */
+	uint32_t Query(cv::Mat const &desc,
+			std::vector<cv::KeyPoint> const &kps,
+			Annotations &ann);
+
+private:
+
+	/** The memory mapped database file */
+	void *base;
+	size_t length;
+
+	Header const *hdr;
+	Object const *objects;
+	uint32_t const *labels;
+
+	/** The reference descriptors, mapped in place */
+	cv::Mat desc;
+
+	cv::flann::Index index;
+
+	/** Time spent to load the database and its index */
+	double load_ms;
+
+	/** Query scratch buffers, reused across frames */
+	cv::Mat indices;
+	cv::Mat dists;
+	std::vector<uint16_t> votes;
+	std::vector<cv::Rect> boxes;
+
+	/**
+	 * @brief Check the layout of the mapped database, against its size
+	 *
+	 * All the tables must be within the mapping, and each object must
+	 * refer to its descriptors. Labels are not touched here: the queries
+	 * check the label of each match, before voting for its object.
+	 */
+	bool Validate() const;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_REFDB_H_
@@ -0,0 +1,72 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BBQUE_OPENCV_DEMO_REGIONS_H_
+#define BBQUE_OPENCV_DEMO_REGIONS_H_
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A region of interest of a frame
+ *
+ * Coordinates are normalized to the frame size, i.e. in [0, 1], thus the
+ * same region applies to all the resolutions.
+ */
+struct RegionOfInterest {
+	float x;
+	float y;
+	float width;
+	float height;
+
+	/** An (optional) name, e.g. "door" or "belt-2" */
+	std::string name;
+
+	/**
+	 * @brief The region in pixels of a frame of the specified size
+	 */
+	cv::Rect Rect(cv::Size const &frame) const;
+};
+
+/**
+ * @brief Parse a region from its "x,y,width,height[,name]" specification
+ */
+bool ParseRegion(std::string const &spec, RegionOfInterest &roi);
+
+/**
+ * @brief Append the regions listed by a file, one spec for each line
+ *
+ * Empty lines, and lines starting by '#', are ignored.
+ */
+bool LoadRegions(std::string const &path,
+		std::vector<RegionOfInterest> &rois);
+
+/**
+ * @brief Merge the overlapping regions (in pixels) into their bounding box
+ *
+ * Merged regions are disjoint, thus processing each of them never writes
+ * the same pixels, nor finds the same keypoints, of another one. Empty
+ * regions are dropped. The merged vector is cleared, but never shrunk.
+ */
+void MergeRegions(std::vector<cv::Rect> const &regions,
+		std::vector<cv::Rect> &merged);
+
+/**
+ * @brief The fraction of the frame covered by (the union of) the regions
+ */
+float RegionsCoverage(std::vector<RegionOfInterest> const &rois);
+
+#endif // BBQUE_OPENCV_DEMO_REGIONS_H_
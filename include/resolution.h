@@ -0,0 +1,45 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_RESOLUTION_H_
+#define BBQUE_OPENCV_DEMO_RESOLUTION_H_
+
+#include <cstdint>
+
+enum ResolutionType {
+	RES_LOW = 0,
+	RES_MID,
+	RES_HIG,
+	RES_COUNT // This must be the last element
+};
+
+struct Resolution {
+	uint16_t width;
+	uint16_t height;
+};
+
+/**
+ * The resolution presets, shared by the application and its tools
+ */
+extern Resolution resolutions[RES_COUNT];
+extern const char *resolutionStr[RES_COUNT];
+
+#define CAM_PRESET_WIDTH(TYPE) \
+	resolutions[TYPE].width
+#define CAM_PRESET_HEIGHT(TYPE) \
+	resolutions[TYPE].height
+
+#endif // BBQUE_OPENCV_DEMO_RESOLUTION_H_
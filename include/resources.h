@@ -0,0 +1,92 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_RESOURCES_H_
+#define BBQUE_OPENCV_DEMO_RESOURCES_H_
+
+#include <cstdint>
+#include <sched.h>
+
+/**
+ * @brief The resources actually granted to this process
+ *
+ * On Linux hosts the BarbequeRTRM enforces AWM resources by means of
+ * control groups: the assigned processing elements end up in the cpuset
+ * of the application, the PE quota in its CFS bandwidth (cpu controller)
+ * and the memory quota in its memory controller limit.
+ */
+struct ResourceGrant {
+
+	/** The CPUs we are allowed to run on */
+	cpu_set_t cpus;
+	uint32_t cpus_count;
+
+	/** CPU bandwidth, in percentage of a single CPU (0: unlimited) */
+	uint32_t cpu_quota;
+
+	/** Memory limit, in bytes (0: unlimited) */
+	uint64_t mem_limit;
+
+	/**
+	 * @brief The number of threads which best fits the grant
+	 *
+	 * That's the number of CPUs in our cpuset, bounded by the number of
+	 * CPUs worth of bandwidth we are allowed to use.
+	 */
+	uint32_t Threads() const {
+		uint32_t threads = cpus_count ? cpus_count : 1;
+		uint32_t bw_cpus;
+
+		if (!cpu_quota)
+			return threads;
+		bw_cpus = (cpu_quota + 99) / 100;
+		return (bw_cpus < threads) ? bw_cpus : threads;
+	}
+
+};
+
+/**
+ * @brief Read the current resources grant
+ *
+ * The CPU affinity is always available, while cgroup limits are read
+ * (both from v1 and v2 hierarchies) only when the corresponding
+ * controller is mounted, and otherwise reported as unlimited.
+ */
+void ReadResourceGrant(ResourceGrant &grant);
+
+/**
+ * @brief The peak resident memory (VmHWM) of this process, in bytes
+ */
+uint64_t ReadPeakMemory();
+
+/**
+ * @brief The current resident memory (VmRSS) of this process, in bytes
+ */
+uint64_t ReadResidentMemory();
+
+/**
+ * @brief Reset the peak resident memory to the current one
+ *
+ * @return false if not supported by the running kernel
+ */
+bool ResetPeakMemory();
+
+/**
+ * @brief The CPU time consumed by all the threads of this process [ms]
+ */
+double ReadCpuTimeMs();
+
+#endif // BBQUE_OPENCV_DEMO_RESOURCES_H_
@@ -0,0 +1,229 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_RESULTS_SINK_H_
+#define BBQUE_OPENCV_DEMO_RESULTS_SINK_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief The results stream signature, and format version
+ */
+#define RESULTS_MAGIC "OCVDRES"
+#define RESULTS_VERSION 2
+
+/**
+ * @brief The signature of each record, to resynchronize on a stream
+ */
+#define RESULTS_RECORD_MAGIC 0x5244434f
+
+/**
+ * @brief The bytes of the staging buffer of files and pipes
+ */
+#define RESULTS_CHUNK_BYTES 65536
+
+/**
+ * @brief The default bytes of the ring of a shared memory stream
+ */
+#define RESULTS_SHM_BYTES (16 << 20)
+
+/*
+ * The results stream format
+ *
+ * A stream starts with a ResultsHeader, followed by ResultsRecords, each
+ * one followed by its payload of count items and padded to 8 bytes, thus
+ * all fields are naturally aligned and consumers can mmap a stream and
+ * walk it by record bytes, without any parsing. All values are in the
+ * producer byte order.
+ *
+ * Files and pipes are a plain sequence of records. A shared memory stream
+ * is a ring of capacity bytes, at header_bytes from the header, where
+ * written (updated once each record is complete) is the number of bytes
+ * written since the beginning. Records never wrap: the tail of the ring is
+ * skipped by a padding record, or just skipped if shorter than a record
+ * header. A consumer lagging more than capacity bytes lost some records.
+ *
+ * Before overwriting any byte of the ring, the writer publishes into
+ * reserved the end of the record being written. Thus a consumer, once
+ * read a record at position pos (below written), checks (after an acquire
+ * fence) that reserved - capacity <= pos: otherwise the record could have
+ * been overwritten while being read.
+ */
+
+struct ResultsHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_bytes;
+	/** The bytes of the ring, 0 for files and pipes */
+	uint64_t capacity;
+	/** The bytes written into the ring */
+	uint64_t written;
+	/** The bytes written, or being written, into the ring */
+	uint64_t reserved;
+};
+
+struct ResultsRecord {
+
+	enum Kind {
+		RESULTS_KEYPOINTS = 0,
+		RESULTS_EDGES,
+		RESULTS_PAD
+	};
+
+	uint32_t magic;
+	/** The bytes of the record, payload and padding included */
+	uint32_t bytes;
+	uint32_t frame;
+	uint8_t effect;
+	uint8_t kind;
+	uint16_t reserved;
+	/** The (wall-clock) time the results have been written at [ns] */
+	uint64_t timestamp_ns;
+	/** The resolution of the frame processed */
+	uint16_t width;
+	uint16_t height;
+	/** The payload items */
+	uint32_t count;
+};
+
+/**
+ * @brief A keypoint, in frame coordinates
+ */
+struct ResultsKeypoint {
+	float x;
+	float y;
+	float size;
+	float response;
+	int32_t octave;
+};
+
+/**
+ * @brief An horizontal run of edge pixels
+ */
+struct ResultsRun {
+	uint16_t row;
+	uint16_t col;
+	uint16_t length;
+	uint16_t reserved;
+};
+
+/**
+ * @brief A sink of the analytics results, as a binary stream
+ *
+ * Results are written into a file, a named pipe (blocking the writer when
+ * full, as a back-pressure) or, with a "shm:<name>" path, a shared memory
+ * ring (never blocking the writer). Records are serialized into a staging
+ * buffer or straight into the shared memory, thus never allocating.
+ */
+class ResultsSink {
+
+public:
+
+	struct Config {
+		/** The file, pipe or shared memory ring, empty to disable */
+		std::string path;
+		/** Write the edges of Canny, run-length encoded */
+		bool edges;
+
+		Config();
+
+		bool Enabled() const {
+			return !path.empty();
+		}
+	};
+
+	ResultsSink(Config const &cfg);
+
+	~ResultsSink();
+
+	Config const & GetConfig() const {
+		return cfg;
+	}
+
+	bool Open();
+
+	void Close();
+
+	bool IsOpen() const {
+		return fd >= 0 || hdr != NULL;
+	}
+
+	void WriteKeypoints(uint32_t frame, uint8_t effect, cv::Size size,
+			std::vector<cv::KeyPoint> const &kps);
+
+	/**
+	 * @brief Write an edges map (of 0 and non 0 pixels)
+	 */
+	void WriteEdges(uint32_t frame, uint8_t effect, cv::Mat const &edges);
+
+	uint64_t Records() const {
+		return records;
+	}
+
+	uint64_t Bytes() const {
+		return bytes;
+	}
+
+	uint64_t Dropped() const {
+		return dropped;
+	}
+
+private:
+
+	Config cfg;
+
+	/** The file or pipe */
+	int fd;
+	uint8_t chunk[RESULTS_CHUNK_BYTES];
+	size_t chunk_used;
+
+	/** The padding of the record being written */
+	uint32_t record_pad;
+
+	/** The shared memory ring */
+	ResultsHeader *hdr;
+	size_t length;
+	uint8_t *ring;
+	/** The position of the record being written, into the ring */
+	uint64_t cursor;
+
+	uint64_t records;
+	uint64_t bytes;
+	uint64_t dropped;
+
+	bool OpenShm(std::string const &name);
+
+	/**
+	 * @brief Start a record of the specified payload
+	 *
+	 * @return false if the record must be dropped
+	 */
+	bool Begin(ResultsRecord &rec, size_t item_bytes);
+
+	void Put(void const *data, size_t size);
+
+	void End(ResultsRecord const &rec);
+
+	void Flush();
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_RESULTS_SINK_H_
@@ -0,0 +1,56 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_RTLIB_SIM_H_
+#define BBQUE_OPENCV_DEMO_RTLIB_SIM_H_
+
+#include <cstdio>
+#include <string>
+
+#include <bbque/rtlib.h>
+
+/**
+ * @brief Setup an in-process stand-in of the RTLib
+ *
+ * The returned services drive the (single) registered EXC without any
+ * Barbeque daemon, by replaying the AWM timeline read from the specified
+ * schedule file, where each (not empty and not commented) line is one of:
+ * - "<time> <awm>": switch to AWM <awm> at <time> [ms] since Enable
+ * - "<time> block": suspend the EXC at <time> [ms] since Enable
+ * - "cpus <awm> <count>": the CPUs granted by AWM <awm>, emulated by
+ *   restricting the EXC affinity to the first <count> CPUs available
+ * - "gap <delay>": react to a goal-gap assertion by promoting the EXC to
+ *   the next AWM after <delay> [ms] (default 100, 0 to ignore goal-gaps)
+ *
+ * AWM constraints asserted by the EXC are honored: scheduled (and
+ * promoted) AWMs are clamped within the asserted bounds.
+ *
+ * @return RTLIB_ERROR if the schedule could not be loaded
+ */
+RTLIB_ExitCode_t RTLIB_SimInit(std::string const &schedule,
+		RTLIB_Services_t **rtlib);
+
+/**
+ * @brief Report the reconfiguration metrics collected so far
+ *
+ * For each AWM switch the report includes the time required to pick up
+ * the switch (the EXC polls for a new AWM only once per cycle), the time
+ * to complete the first cycle after the switch, and the frames lost
+ * around it, with respect to the cycle rate before the switch.
+ */
+void RTLIB_SimReport(FILE *out);
+
+#endif // BBQUE_OPENCV_DEMO_RTLIB_SIM_H_
@@ -0,0 +1,187 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_SHM_RING_H_
+#define BBQUE_OPENCV_DEMO_SHM_RING_H_
+
+#include <cstdint>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief The prefix of the input path selecting a shared memory ring
+ */
+#define SHM_RING_PREFIX "shm:"
+
+/**
+ * @brief The maximum number of consumers attached to a ring
+ */
+#define SHM_RING_CONSUMERS 16
+
+/**
+ * @brief The maximum number of frame slots of a ring
+ */
+#define SHM_RING_SLOTS_MAX 64
+
+/**
+ * @brief A ring of frame slots, in POSIX shared memory
+ *
+ * A single producer decodes each frame once, straight into the next slot,
+ * while any number of consumer processes read the slots in place, each one
+ * from its own cursor, which is kept in the shared memory too.
+ *
+ * The producer never waits for consumers: it just overwrites the oldest
+ * slot. Each slot is guarded by a sequence number, which is invalidated
+ * while the slot is written, thus a consumer checks, once done with a
+ * slot, whether it has been overwritten meanwhile (a torn frame). A
+ * consumer lagging more than the ring size skips to the latest frame,
+ * accounting the skipped ones as dropped.
+ */
+class ShmRing {
+
+public:
+
+	/**
+	 * @brief The status of a consumer, as seen by the producer
+	 */
+	struct Consumer {
+		int32_t pid;
+		/** The frames published, and not yet read */
+		uint64_t lag;
+		uint64_t dropped;
+		uint64_t torn;
+	};
+
+	ShmRing();
+
+	~ShmRing();
+
+	/**
+	 * @brief Create a ring (producer side)
+	 *
+	 * @param type the OpenCV type of the frames, e.g. CV_8UC3
+	 */
+	bool Create(std::string const &name, cv::Size size, int type,
+			uint32_t slots);
+
+	/**
+	 * @brief Attach to a ring (consumer side), as a new consumer
+	 */
+	bool Open(std::string const &name);
+
+	/**
+	 * @brief Detach from the ring, removing it if the producer
+	 *
+	 * Consumers get the end of stream once the producer closed the ring.
+	 */
+	void Close();
+
+	bool IsOpen() const {
+		return hdr != NULL;
+	}
+
+	cv::Size FrameSize() const;
+
+	/**
+	 * @brief The next slot to write (producer side)
+	 *
+	 * The slot is invalidated, thus it must be published once written.
+	 */
+	cv::Mat Writable();
+
+	/**
+	 * @brief Publish the slot returned by the last Writable()
+	 */
+	void Publish();
+
+	/**
+	 * @brief The number of consumers attached, with their status
+	 *
+	 * Consumers whose process terminated are detached.
+	 */
+	uint32_t Consumers(Consumer *status);
+
+	/**
+	 * @brief The next frame, mapped in place (consumer side)
+	 *
+	 * The frame must not be modified, and it is valid until Release().
+	 *
+	 * @return false at the end of stream
+	 */
+	bool Acquire(cv::Mat &frame);
+
+	/**
+	 * @brief When the frame returned by the last Acquire() has been
+	 * published [ms]
+	 *
+	 * This is on the steady clock timeline, which is system-wide, thus
+	 * the time a frame waited in the ring is accounted too.
+	 */
+	double PublishedMs() const {
+		return published_ms;
+	}
+
+	/**
+	 * @brief Skip to the most recent frame (consumer side)
+	 *
+	 * The frames published before it, and not yet read, are dropped.
+	 *
+	 * @return the number of frames skipped
+	 */
+	uint64_t SkipToLatest();
+
+	/**
+	 * @brief Release the frame returned by the last Acquire()
+	 *
+	 * @return false if the frame has been overwritten meanwhile
+	 */
+	bool Release();
+
+	uint64_t Frames() const {
+		return frames;
+	}
+
+	uint64_t Dropped() const;
+
+	uint64_t Torn() const;
+
+private:
+
+	struct Header;
+
+	std::string name;
+	bool producer;
+	size_t length;
+	Header *hdr;
+	uint8_t *data;
+
+	/** The entry of this consumer, in the header */
+	int32_t consumer;
+
+	/** The frame being written, or read */
+	uint64_t current;
+	uint64_t frames;
+
+	/** When the frame being read has been published [ms] */
+	double published_ms;
+
+	uint8_t * SlotData(uint64_t frame) const;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_SHM_RING_H_
@@ -0,0 +1,94 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_SPSC_QUEUE_H_
+#define BBQUE_OPENCV_DEMO_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief The cache line size, which indexes are padded to
+ */
+#define SPSC_QUEUE_LINE 64
+
+/**
+ * @brief A bounded, lock-free, single producer single consumer queue
+ *
+ * Each index is written by just one side, thus pushing and popping are a
+ * couple of plain loads and stores, with no locking nor atomic
+ * read-modify-write. Indexes are padded to different cache lines, to not
+ * bounce them between the producer and the consumer cores.
+ *
+ * @param SIZE the capacity, which must be a power of two
+ */
+template <typename T, size_t SIZE>
+class SpscQueue {
+
+public:
+
+	SpscQueue() :
+		head(0),
+		tail(0) {
+		static_assert((SIZE & (SIZE - 1)) == 0,
+				"SpscQueue size must be a power of two");
+	}
+
+	/**
+	 * @brief Enqueue an item (producer side)
+	 *
+	 * @return false if the queue is full
+	 */
+	bool Push(T const &item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		if (t - head.load(std::memory_order_acquire) == SIZE)
+			return false;
+		items[t & (SIZE - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Dequeue an item (consumer side)
+	 *
+	 * @return false if the queue is empty
+	 */
+	bool Pop(T &item) {
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = items[h & (SIZE - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+
+	/** The next item to pop, written by the consumer */
+	std::atomic<size_t> head;
+	char head_pad[SPSC_QUEUE_LINE - sizeof(std::atomic<size_t>)];
+	/** The next item to push, written by the producer */
+	std::atomic<size_t> tail;
+	char tail_pad[SPSC_QUEUE_LINE - sizeof(std::atomic<size_t>)];
+
+	T items[SIZE];
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_SPSC_QUEUE_H_
@@ -0,0 +1,100 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_STATS_H_
+#define BBQUE_OPENCV_DEMO_STATS_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+/**
+ * @brief A simple accumulator of measurement samples
+ *
+ * Keeps track of count, min, max and average of all the samples, as well
+ * as of the last (up-to) max_samples values, which are used to compute
+ * percentiles. The samples buffer is allocated just once, at construction
+ * time, thus adding a sample never allocates.
+ */
+class Stats {
+
+public:
+
+	Stats(size_t max_samples = 1024) :
+		samples(max_samples) {
+		reset();
+	}
+
+	void reset() {
+		cnt = 0;
+		sum = 0;
+		vmin = 0;
+		vmax = 0;
+	}
+
+	void add(double value) {
+		if (!cnt || value < vmin)
+			vmin = value;
+		if (!cnt || value > vmax)
+			vmax = value;
+		samples[cnt % samples.size()] = value;
+		sum += value;
+		++cnt;
+	}
+
+	unsigned long count() const { return cnt; }
+	double min() const { return vmin; }
+	double max() const { return vmax; }
+	double avg() const { return cnt ? sum / cnt : 0; }
+
+	/**
+	 * @brief Get the specified percentile (0-100) of the last samples
+	 *
+	 * This sorts a copy of the samples, thus it is intended to be used
+	 * only for (not frequent) reporting.
+	 */
+	double percentile(double pct) const {
+		size_t n = std::min<size_t>(cnt, samples.size());
+		std::vector<double> sorted(samples.begin(), samples.begin() + n);
+		size_t idx;
+
+		if (!n)
+			return 0;
+		idx = static_cast<size_t>((pct / 100.0) * (n - 1) + 0.5);
+		std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+		return sorted[idx];
+	}
+
+	/**
+	 * @brief Dump a one line summary of the collected samples
+	 */
+	void print(FILE *out, const char *name, const char *unit) const {
+		fprintf(out, "%-24s: cnt %7lu, min %9.3f, avg %9.3f, "
+				"p50 %9.3f, p99 %9.3f, max %9.3f [%s]\n",
+				name, cnt, vmin, avg(),
+				percentile(50), percentile(99), vmax, unit);
+	}
+
+private:
+
+	std::vector<double> samples;
+	unsigned long cnt;
+	double sum;
+	double vmin;
+	double vmax;
+};
+
+#endif // BBQUE_OPENCV_DEMO_STATS_H_
@@ -0,0 +1,105 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_STRIP_STREAM_H_
+#define BBQUE_OPENCV_DEMO_STRIP_STREAM_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "effects.h"
+#include "kernels.h"
+#include "memory_budget.h"
+#include "worker_pool.h"
+
+/**
+ * @brief Effects streamed over the strips of (high resolution) frames
+ *
+ * A color frame is processed by horizontal strips of a fixed number of
+ * rows, each one converted to gray-level and processed, together with its
+ * halo, within buffers private to the worker processing it. Results are
+ * produced directly at the (lower) output resolution. Thus, beside the
+ * input frame, the working set depends just on the strip size and on the
+ * number of workers, not on the frame height. Keypoints are the same of
+ * the whole frame, while Canny edges approximate them near the strips
+ * boundaries (see EFFECT_CANNY_HALO).
+ *
+ * Workers process one batch of strips at a time, each worker using always
+ * its own scratch buffers.
+ */
+class StripStream {
+
+public:
+
+	/**
+	 * @param rows the rows of each strip
+	 */
+	StripStream(uint32_t rows = 0);
+
+	/**
+	 * @brief Account the scratch buffers to a subsystem
+	 */
+	void Attach(MemoryBudget &memory, uint8_t subsys);
+
+	uint32_t Rows() const {
+		return rows;
+	}
+
+	/**
+	 * @brief Canny edges of a color frame, scaled to the output size
+	 */
+	void Canny(cv::Mat const &bgr, cv::Mat &edges, WorkerPool &pool,
+			Kernels const &kernels);
+
+	/**
+	 * @brief Keypoints of a color frame, in coordinates of the output size
+	 */
+	void Detect(cv::Mat const &bgr, cv::Size const &out,
+			cv::FeatureDetector const &fd, WorkerPool &pool,
+			Kernels const &kernels, std::vector<cv::KeyPoint> &kps);
+
+	/**
+	 * @brief The memory currently used by the scratch buffers
+	 */
+	size_t ScratchBytes() const;
+
+private:
+
+	struct Scratch {
+		cv::Mat gray;
+		cv::Mat work;
+		std::vector<cv::KeyPoint> kps;
+	};
+
+	uint32_t rows;
+
+	std::vector<Strip> strips;
+	std::vector<Scratch> scratch;
+
+	MemoryBudget *memory;
+	uint8_t subsys;
+
+	/**
+	 * @brief Split a frame into strips, and setup a scratch for each worker
+	 */
+	void Split(cv::Size const &frame, int halo, uint32_t workers);
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_STRIP_STREAM_H_
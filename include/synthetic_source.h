@@ -0,0 +1,143 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_SYNTHETIC_SOURCE_H_
+#define BBQUE_OPENCV_DEMO_SYNTHETIC_SOURCE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief The prefix of the input path selecting the synthetic source
+ */
+#define SYNTHETIC_SOURCE_PREFIX "synth:"
+
+/**
+ * @brief The number of (pre-generated) noise frames cycled over
+ */
+#define SYNTHETIC_NOISE_FRAMES 4
+
+/**
+ * @brief A procedural, seeded, source of frames
+ *
+ * Frames show textured shapes moving (and bouncing) over a smooth
+ * background, with some noise on top. The scene complexity, i.e. the
+ * number of shapes, controls the density of keypoints, since the shapes
+ * are the only textured areas.
+ *
+ * Everything is pre-rendered at setup, thus generating a frame costs just
+ * a copy of the background, a masked copy of each shape and a saturated
+ * add of the noise. The same seed generates the same sequence of frames.
+ *
+ * A frame rate can be set to emulate a camera, which delivers frames at a
+ * fixed pace, optionally delayed by a random jitter. Frames are dropped
+ * when not read in time, as a camera would do.
+ */
+class SyntheticSource {
+
+public:
+
+	struct Config {
+		cv::Size size;
+		uint32_t seed;
+		/** The number of shapes */
+		uint32_t shapes;
+		/** The noise amplitude, in [0, 255] */
+		uint32_t noise;
+		/** The frame rate, 0 to deliver frames as fast as read */
+		double fps;
+		/** The maximum delay of a frame [ms] */
+		double jitter_ms;
+
+		Config();
+	};
+
+	/**
+	 * @brief Parse a "[WxH][,seed=S][,shapes=N][,noise=A][,fps=F]
+	 * [,jitter=J]" specification
+	 */
+	static bool Parse(std::string const &spec, Config &cfg);
+
+	SyntheticSource();
+
+	/**
+	 * @brief Pre-render the scene described by the configuration
+	 */
+	void Setup(Config const &cfg);
+
+	/**
+	 * @brief Generate the next frame (blocking, if paced)
+	 */
+	void Read(cv::Mat &frame);
+
+	Config const & GetConfig() const {
+		return cfg;
+	}
+
+	uint64_t Frames() const {
+		return frame;
+	}
+
+	uint64_t Dropped() const {
+		return dropped;
+	}
+
+	/**
+	 * @brief When the last frame has been captured [ms]
+	 *
+	 * This is the time the frame was due, when paced, thus its jitter
+	 * and the time it waited to be read are accounted too.
+	 */
+	double CapturedMs() const {
+		return captured_ms;
+	}
+
+private:
+
+	struct Shape {
+		cv::Mat sprite;
+		cv::Mat mask;
+		cv::Point2f origin;
+		/** The motion [pixels per frame] */
+		cv::Point2f speed;
+	};
+
+	Config cfg;
+
+	cv::Mat background;
+	std::vector<Shape> shapes;
+	cv::Mat noise[SYNTHETIC_NOISE_FRAMES];
+
+	cv::RNG rng;
+
+	uint64_t frame;
+	uint64_t dropped;
+
+	/** The time of the first frame [ms], for paced sources */
+	double tstart;
+
+	/** The time the last frame has been captured [ms] */
+	double captured_ms;
+
+	void Pace();
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_SYNTHETIC_SOURCE_H_
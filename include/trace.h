@@ -0,0 +1,169 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_TRACE_H_
+#define BBQUE_OPENCV_DEMO_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief The number of events kept by the ring of each thread
+ */
+#define TRACE_RING_EVENTS 16384
+
+/**
+ * @brief A timeline of the events of the processing pipeline
+ *
+ * Each thread records its events into its own fixed-size ring, thus
+ * recording is lock-free and, once the ring is full, the oldest events
+ * are overwritten. Rings are allocated by the first event recorded by a
+ * thread, and they are recycled by the threads started once their owner
+ * has terminated.
+ *
+ * Tracing can be enabled and disabled at any time: while disabled,
+ * recording an event costs just the check of a flag. The recorded events
+ * are exported in the Chrome trace JSON format, which can be loaded by
+ * chrome://tracing or by the Perfetto UI.
+ */
+class Trace {
+
+public:
+
+	static bool Enabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	static void Enable(bool on);
+
+	/**
+	 * @brief The current time [ns], on the timeline of the events
+	 */
+	static uint64_t Now();
+
+	/**
+	 * @brief Name the calling thread on the timeline
+	 */
+	static void ThreadName(char const *name);
+
+	/**
+	 * @brief Record an event of the specified duration
+	 *
+	 * @param name the event name, which must be a string literal
+	 * (only its address is recorded)
+	 * @param arg a value to attach to the event, or a negative one for
+	 * none
+	 */
+	static void Complete(char const *name, uint64_t start, uint64_t end,
+			int64_t arg = -1);
+
+	/**
+	 * @brief Record an instantaneous event
+	 */
+	static void Instant(char const *name, int64_t arg = -1);
+
+	/**
+	 * @brief Record a sample of a value plotted on the timeline
+	 */
+	static void Counter(char const *name, int64_t value);
+
+	/**
+	 * @brief Write all the recorded events, and drop them
+	 *
+	 * Events are consistent as long as they are not being overwritten by
+	 * their thread while flushing, i.e. flushes should happen in between
+	 * frames, or once the processing threads have been stopped.
+	 *
+	 * @return the number of events written, or -1 on errors
+	 */
+	static int Flush(std::string const &path);
+
+	/**
+	 * @brief Ask for a flush at the next safe point
+	 *
+	 * This is async-signal-safe, thus it can be called by signal handlers.
+	 */
+	static void RequestFlush() {
+		flush_requested.store(true);
+	}
+
+	/**
+	 * @brief Check (and clear) a pending flush request
+	 */
+	static bool FlushRequested() {
+		return flush_requested.load(std::memory_order_relaxed) &&
+			flush_requested.exchange(false);
+	}
+
+private:
+
+	static std::atomic<bool> enabled;
+
+	static std::atomic<bool> flush_requested;
+
+};
+
+/**
+ * @brief Record the duration of the enclosing scope
+ *
+ * The scope is recorded only if tracing is enabled when it is entered.
+ */
+class TraceScope {
+
+public:
+
+	TraceScope(char const *name, int64_t arg = -1) :
+		name(Trace::Enabled() ? name : NULL),
+		arg(arg),
+		start(this->name ? Trace::Now() : 0) {
+	}
+
+	~TraceScope() {
+		if (name)
+			Trace::Complete(name, start, Trace::Now(), arg);
+	}
+
+private:
+
+	char const *name;
+
+	int64_t arg;
+
+	uint64_t start;
+
+};
+
+#define TRACE_CONCAT_(A, B) A ## B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_(A, B)
+
+#define TRACE_SCOPE(NAME, ...) \
+	TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(NAME, ##__VA_ARGS__)
+
+#define TRACE_INSTANT(NAME, ...) \
+	do { \
+		if (Trace::Enabled()) \
+			Trace::Instant(NAME, ##__VA_ARGS__); \
+	} while (0)
+
+#define TRACE_COUNTER(NAME, VALUE) \
+	do { \
+		if (Trace::Enabled()) \
+			Trace::Counter(NAME, VALUE); \
+	} while (0)
+
+#endif // BBQUE_OPENCV_DEMO_TRACE_H_
@@ -0,0 +1,105 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_UTILS_H_
+#define BBQUE_OPENCV_DEMO_UTILS_H_
+
+#include <chrono>
+#include <cstdio>
+
+/**
+ * @brief Logging and timing helpers of the frame pipeline core
+ *
+ * The core library, and the tools built on top of it, must build and run
+ * without the BOSP RTLib: these replace the few helpers they used to take
+ * from the BBQ utilities, keeping the same names and message format. Each
+ * translation unit defines its own BBQUE_LOG_MODULE, as before.
+ */
+
+#ifndef BBQUE_LOG_MODULE
+# define BBQUE_LOG_MODULE "ocvdemo"
+#endif
+
+#ifndef FI
+# define FI(fmt) "[INF] " BBQUE_LOG_MODULE ": " fmt
+# define FW(fmt) "[WRN] " BBQUE_LOG_MODULE ": " fmt
+# define FE(fmt) "[ERR] " BBQUE_LOG_MODULE ": " fmt
+# define FD(fmt) "[DBG] " BBQUE_LOG_MODULE ": " fmt
+#endif
+
+#ifndef DB
+# ifdef DEBUG
+#  define DB(x) x
+# else
+#  define DB(x)
+# endif
+#endif
+
+#ifndef likely
+# define likely(x)   __builtin_expect(!!(x), 1)
+# define unlikely(x) __builtin_expect(!!(x), 0)
+#endif
+
+/**
+ * @brief A monotonic stopwatch
+ *
+ * Same interface of the BBQ utilities Timer: the elapsed time is measured
+ * since the last start(), or up to the stop() which follows it.
+ */
+class Timer {
+
+public:
+
+	Timer(bool start_now = false) :
+		running(false) {
+		if (start_now)
+			start();
+	}
+
+	void start() {
+		tstart = clock::now();
+		running = true;
+	}
+
+	void stop() {
+		if (!running)
+			return;
+		tstop = clock::now();
+		running = false;
+	}
+
+	bool Running() const { return running; }
+
+	double getElapsedTime() const { return Elapsed() / 1e9; }
+	double getElapsedTimeMs() const { return Elapsed() / 1e6; }
+	double getElapsedTimeUs() const { return Elapsed() / 1e3; }
+
+private:
+
+	typedef std::chrono::steady_clock clock;
+
+	clock::time_point tstart;
+	clock::time_point tstop;
+	bool running;
+
+	double Elapsed() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				(running ? clock::now() : tstop) - tstart).count();
+	}
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_UTILS_H_
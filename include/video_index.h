@@ -0,0 +1,121 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef BBQUE_OPENCV_DEMO_VIDEO_INDEX_H_
+#define BBQUE_OPENCV_DEMO_VIDEO_INDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief A persistent index of the exact seek points of a video
+ *
+ * VideoCapture does not expose the keyframes of a stream, while seeking
+ * (by frame number) is exact only with some codecs and containers, i.e.
+ * when the backend seeks to the previous keyframe and decodes forward.
+ * Thus, seek points are candidate frames, one every interval, each one
+ * recorded with the hash of its content, as decoded sequentially, and
+ * kept only if seeking to it decodes exactly the same frame.
+ *
+ * Frames from a seek point to the next one can be decoded independently
+ * of all the others, e.g. by a different VideoCapture. Building the index
+ * requires decoding the whole video once, thus it is saved in a text file
+ * which lists the video properties and then one seek point for each line.
+ * The size and modification time of the indexed video are recorded too,
+ * thus an index is not loaded once the video has been changed.
+ */
+class VideoIndex {
+
+public:
+
+	struct SeekPoint {
+		uint32_t frame;
+		uint64_t hash;
+	};
+
+	VideoIndex();
+
+	/**
+	 * @brief Index a video, with candidate seek points every interval
+	 */
+	bool Build(std::string const &video, uint32_t interval);
+
+	/**
+	 * @brief Load the index of a video
+	 *
+	 * @return false if the index is missing or malformed, or it is stale,
+	 * i.e. the video size or modification time is not the indexed one
+	 */
+	bool Load(std::string const &path, std::string const &video);
+
+	bool Save(std::string const &path) const;
+
+	/**
+	 * @brief The default path of the index of a video
+	 */
+	static std::string DefaultPath(std::string const &video);
+
+	uint32_t Frames() const {
+		return frames;
+	}
+
+	double Fps() const {
+		return fps;
+	}
+
+	std::vector<SeekPoint> const & Points() const {
+		return points;
+	}
+
+	/**
+	 * @brief Split the video into (up-to) count chunks of frames
+	 *
+	 * Chunks start at seek points, and are as balanced as the seek points
+	 * allow.
+	 */
+	void Chunks(uint32_t count, std::vector<cv::Range> &chunks) const;
+
+	/**
+	 * @brief Seek a capture to a seek point, reading its frame
+	 *
+	 * @return false if the point is not a seek point of the index, or the
+	 * frame read does not match the indexed one, e.g. a stale index
+	 */
+	bool Seek(cv::VideoCapture &cap, uint32_t frame, cv::Mat &first) const;
+
+	/**
+	 * @brief The hash (64-bit FNV-1a) of the content of a frame
+	 */
+	static uint64_t Hash(cv::Mat const &frame);
+
+private:
+
+	std::string video;
+	uint64_t video_size;
+	int64_t video_mtime;
+	uint32_t frames;
+	double fps;
+	uint32_t interval;
+
+	std::vector<SeekPoint> points;
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_VIDEO_INDEX_H_
@@ -0,0 +1,132 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BBQUE_OPENCV_DEMO_WORKER_POOL_H_
+#define BBQUE_OPENCV_DEMO_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fork-join pool of worker threads
+ *
+ * The pool runs a batch of (independent) tasks, identified by their index,
+ * on all of its workers and on the calling thread, returning once all of
+ * them have been completed. Each worker is pinned to one of the CPUs of
+ * the configured affinity set, in a round-robin fashion.
+ */
+class WorkerPool {
+
+public:
+
+	typedef std::function<void(uint32_t)> Task;
+
+	WorkerPool();
+
+	~WorkerPool();
+
+	/**
+	 * @brief Setup the pool parallelism
+	 *
+	 * @param parallelism the number of threads running a batch, including
+	 * the calling one; thus (parallelism - 1) workers are spawned.
+	 */
+	void Resize(uint32_t parallelism);
+
+	uint32_t Size() const {
+		return workers.size() + 1;
+	}
+
+	/**
+	 * @brief Pin workers to the specified set of CPUs
+	 */
+	void SetAffinity(cpu_set_t const &cpus);
+
+	/**
+	 * @brief The (kernel) thread IDs of the workers
+	 *
+	 * The calling thread, which runs its share of each batch, is not
+	 * included.
+	 */
+	std::vector<pid_t> const & Tids() const {
+		return tids;
+	}
+
+	/**
+	 * @brief The number of times the workers have been respawned
+	 *
+	 * Each resize respawns all the workers, thus a different generation
+	 * means different Tids(), even if the pool size is the same.
+	 */
+	uint32_t Generation() const {
+		return generation;
+	}
+
+	/**
+	 * @brief Run the tasks [0, count) and wait for their completion
+	 */
+	void Run(uint32_t count, Task const &task);
+
+private:
+
+	std::vector<std::thread> workers;
+	std::vector<pid_t> tids;
+	uint32_t generation;
+
+	/** Workers which have already started */
+	uint32_t started;
+
+	std::mutex mtx;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+
+	/** The current batch of tasks */
+	Task const *task;
+	uint32_t count;
+	std::atomic<uint32_t> next;
+	uint64_t batch;
+
+	/** Workers which have not yet completed the current batch */
+	uint32_t busy;
+
+	bool stopping;
+
+	cpu_set_t cpus;
+
+	void Stop();
+
+	void Pin(uint32_t id, pthread_t thread);
+
+	void Drain();
+
+	/**
+	 * @brief The worker thread body
+	 *
+	 * @param done_batch the last batch run before the worker was spawned
+	 */
+	void Worker(uint32_t id, uint64_t done_batch);
+
+};
+
+#endif // BBQUE_OPENCV_DEMO_WORKER_POOL_H_
@@ -0,0 +1,144 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+
+#include "async_effect.h"
+#include "trace.h"
+
+AsyncEffect::AsyncEffect() :
+	has_pending(false),
+	busy(false),
+	stopping(false),
+	has_done(false),
+	completed(0),
+	dropped(0) {
+}
+
+AsyncEffect::~AsyncEffect() {
+	Stop();
+}
+
+void AsyncEffect::Attach(MemoryBudget &memory, uint8_t subsys) {
+	memory.Attach(pending, subsys);
+	memory.Attach(working, subsys);
+}
+
+double AsyncEffect::NowMs() {
+	return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void AsyncEffect::Start(Effect const &effect) {
+	Stop();
+	this->effect = effect;
+	worker = std::thread(&AsyncEffect::Worker, this);
+}
+
+void AsyncEffect::Stop() {
+	if (!Running())
+		return;
+
+	std::unique_lock<std::mutex> lck(mtx);
+	stopping = true;
+	lck.unlock();
+	submit_cv.notify_one();
+
+	worker.join();
+	has_pending = false;
+	stopping = false;
+}
+
+void AsyncEffect::Submit(uint8_t effect, cv::Mat const &gray,
+		uint32_t frame, double grab_ms) {
+	std::unique_lock<std::mutex> lck(mtx);
+
+	// The pending frame is too old by now
+	if (has_pending)
+		++dropped;
+
+	gray.copyTo(pending);
+	pending_tag.effect = effect;
+	pending_tag.frame = frame;
+	pending_tag.size = gray.size();
+	pending_tag.grab_ms = grab_ms;
+	pending_tag.submit_ms = NowMs();
+	has_pending = true;
+
+	lck.unlock();
+	submit_cv.notify_one();
+}
+
+bool AsyncEffect::Fetch(Result &result) {
+	std::unique_lock<std::mutex> lck(mtx);
+
+	if (!has_done)
+		return false;
+
+	// Swapping keeps the capacity of the vectors of both results
+	std::swap(result, done);
+	has_done = false;
+	return true;
+}
+
+void AsyncEffect::Wait() {
+	std::unique_lock<std::mutex> lck(mtx);
+
+	while (Running() && (has_pending || busy))
+		idle_cv.wait(lck);
+}
+
+void AsyncEffect::Worker() {
+	std::unique_lock<std::mutex> lck(mtx);
+
+	Trace::ThreadName("analytics");
+
+	while (true) {
+		while (!stopping && !has_pending)
+			submit_cv.wait(lck);
+		if (stopping)
+			break;
+
+		// Take the pending frame, thus a new one can be submitted
+		std::swap(pending, working);
+		work.effect = pending_tag.effect;
+		work.frame = pending_tag.frame;
+		work.size = pending_tag.size;
+		work.grab_ms = pending_tag.grab_ms;
+		work.submit_ms = pending_tag.submit_ms;
+		has_pending = false;
+		busy = true;
+		lck.unlock();
+
+		{
+			TRACE_SCOPE("analytics", work.frame);
+			work.annotations.clear();
+			effect(work.effect, working, work.annotations);
+			work.done_ms = NowMs();
+		}
+
+		lck.lock();
+		std::swap(work, done);
+		has_done = true;
+		++completed;
+		busy = false;
+		idle_cv.notify_all();
+	}
+
+	busy = false;
+	idle_cv.notify_all();
+}
@@ -0,0 +1,237 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+#include <bbque/utils/utility.h>
+
+#include "calibration.h"
+#include "resources.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.cal"
+
+// Frames skipped before measuring each configuration
+#define CALIBRATION_WARMUP 10
+// Safety margin on the measured peak memory [%]
+#define CALIBRATION_MEM_MARGIN 10
+
+using namespace bbque::utils;
+
+Calibration::Calibration(std::string const &recipe,
+		std::vector<uint8_t> const &effects,
+		uint8_t resolutions, uint32_t threads_max,
+		uint8_t fps_max, uint32_t frames) :
+	recipe(recipe),
+	fps_max(fps_max),
+	cur(0),
+	warmup(CALIBRATION_WARMUP),
+	frames(frames),
+	count(0),
+	tmr(true),
+	tstart(0),
+	tcpu(0) {
+	std::vector<uint32_t> threads;
+
+	// Powers of two, plus the maximum
+	for (uint32_t t = 1; t < threads_max; t *= 2)
+		threads.push_back(t);
+	threads.push_back(threads_max);
+
+	for (size_t t = 0; t < threads.size(); ++t) {
+		for (size_t e = 0; e < effects.size(); ++e) {
+			for (uint8_t r = 0; r < resolutions; ++r) {
+				Config cfg = {effects[e], r, threads[t]};
+				plan.push_back(cfg);
+			}
+		}
+	}
+
+	fprintf(stderr, FI("Calibration plan: %lu configurations, "
+				"%d frames each\n"), plan.size(), frames);
+}
+
+bool Calibration::Frame(uint32_t pixels) {
+	double tnow = tmr.getElapsedTimeMs();
+	double wall;
+	Measure m;
+
+	if (Done())
+		return false;
+
+	// Start measuring once warmed up
+	if (++count == warmup) {
+		ResetPeakMemory();
+		tstart = tnow;
+		tcpu = ReadCpuTimeMs();
+		return false;
+	}
+	if (count < warmup + frames)
+		return false;
+
+	wall = tnow - tstart;
+	m.cfg = plan[cur];
+	m.pixels = pixels;
+	m.fps = frames * 1e3 / wall;
+	m.cpu_pct = (ReadCpuTimeMs() - tcpu) * 100.0 / wall;
+	m.mem_peak = ReadPeakMemory();
+	measures.push_back(m);
+
+	fprintf(stderr, FI("Calibration [%3lu/%3lu]: effect %d, res %d, "
+				"threads %2d => %6.2f [fps], %6.1f [%% CPU], "
+				"%6lu [MB]\n"), cur + 1, plan.size(),
+			m.cfg.effect, m.cfg.res, m.cfg.threads, m.fps, m.cpu_pct,
+			static_cast<unsigned long>(m.mem_peak >> 20));
+
+	++cur;
+	count = 0;
+	return true;
+}
+
+bool Calibration::WriteRecipe(char const * const *effect_names) const {
+	struct AWM {
+		uint32_t threads;
+		uint32_t pe;
+		uint32_t mem_mb;
+		double value;
+	};
+	std::vector<uint8_t> effects;
+	std::vector<AWM> awms;
+	uint32_t max_pixels = 0;
+	char host[64] = "unknown";
+	double max_value = 0;
+	FILE *out;
+
+	for (size_t i = 0; i < measures.size(); ++i) {
+		max_pixels = std::max(max_pixels, measures[i].pixels);
+		if (std::find(effects.begin(), effects.end(),
+					measures[i].cfg.effect) == effects.end())
+			effects.push_back(measures[i].cfg.effect);
+	}
+	if (!max_pixels)
+		return false;
+
+	// Measures are sorted by thread count: one AWM each
+	for (size_t i = 0; i < measures.size(); ) {
+		AWM awm = {measures[i].cfg.threads, 0, 0, 0};
+		std::vector<double> best(effects.size(), 0);
+
+		for ( ; i < measures.size() &&
+				measures[i].cfg.threads == awm.threads; ++i) {
+			Measure const &m = measures[i];
+			size_t e = std::find(effects.begin(), effects.end(),
+					m.cfg.effect) - effects.begin();
+			double quality = (double)m.pixels / max_pixels *
+				std::min(1.0, m.fps / fps_max);
+
+			awm.pe = std::max<uint32_t>(awm.pe, ceil(m.cpu_pct));
+			awm.mem_mb = std::max<uint32_t>(awm.mem_mb,
+					ceil((m.mem_peak >> 20) *
+						(100 + CALIBRATION_MEM_MARGIN) / 100.0));
+			best[e] = std::max(best[e], quality);
+		}
+		for (size_t e = 0; e < best.size(); ++e)
+			awm.value += best[e] / best.size();
+
+		// Drop AWMs which are not worth their cost
+		if (!awms.empty() && awm.value <= awms.back().value)
+			continue;
+		awms.push_back(awm);
+		max_value = std::max(max_value, awm.value);
+	}
+
+	out = fopen(recipe.c_str(), "w");
+	if (!out) {
+		fprintf(stderr, FE("ERROR: opening recipe [%s] FAILED!\n"),
+				recipe.c_str());
+		return false;
+	}
+	gethostname(host, sizeof(host) - 1);
+
+	fprintf(out, "<?xml version=\"1.0\"?>\n");
+	fprintf(out, "<!-- Generated by OCVDemo calibration on [%s] -->\n", host);
+	fprintf(out, "<!-- Target framerate: %d [fps] -->\n", fps_max);
+	fprintf(out, "<!-- effect  res threads      fps  CPU[%%]  mem[MB] -->\n");
+	for (size_t i = 0; i < measures.size(); ++i) {
+		Measure const &m = measures[i];
+		fprintf(out, "<!-- %-7s %4d %7d %8.2f %7.1f %8lu -->\n",
+				effect_names[m.cfg.effect], m.cfg.res,
+				m.cfg.threads, m.fps, m.cpu_pct,
+				static_cast<unsigned long>(m.mem_peak >> 20));
+	}
+	fprintf(out, "<BarbequeRTRM recipe_version=\"0.8\">\n");
+	fprintf(out, "\t<application priority=\"3\">\n");
+	fprintf(out, "\t\t<platform id=\"org.linux.cgroup\">\n");
+	fprintf(out, "\t\t\t<awms>\n");
+	for (size_t i = 0; i < awms.size(); ++i) {
+		fprintf(out, "\t\t\t\t<!-- %d threads -->\n", awms[i].threads);
+		fprintf(out, "\t\t\t\t<awm id=\"%lu\" name=\"wm%lu\" value=\"%d\">\n",
+				i, i, (int)ceil(awms[i].value * 100 / max_value));
+		fprintf(out, "\t\t\t\t\t<resources>\n");
+		fprintf(out, "\t\t\t\t\t\t<tile id=\"0\">\n");
+		fprintf(out, "\t\t\t\t\t\t\t<cluster id=\"0\">\n");
+		fprintf(out, "\t\t\t\t\t\t\t\t<pe qty=\"%d\"/>\n", awms[i].pe);
+		fprintf(out, "\t\t\t\t\t\t\t\t<mem units=\"Mb\" qty=\"%d\"/>\n",
+				awms[i].mem_mb);
+		fprintf(out, "\t\t\t\t\t\t\t</cluster>\n");
+		fprintf(out, "\t\t\t\t\t\t</tile>\n");
+		fprintf(out, "\t\t\t\t\t</resources>\n");
+		fprintf(out, "\t\t\t\t</awm>\n");
+	}
+	fprintf(out, "\t\t\t</awms>\n");
+	fprintf(out, "\t\t</platform>\n");
+	fprintf(out, "\t</application>\n");
+	fprintf(out, "</BarbequeRTRM>\n");
+	fprintf(out, "<!-- vim: set tabstop=4 filetype=xml : -->\n");
+	fclose(out);
+
+	fprintf(stderr, FI("Recipe [%s]: %lu AWMs generated\n"),
+			recipe.c_str(), awms.size());
+
+	return true;
+}
+
+bool Calibration::ReadRecipeAWMs(std::string const &path,
+		std::vector<uint8_t> &awms) {
+	std::ifstream in(path.c_str());
+	std::string line;
+	unsigned int id;
+	size_t pos;
+
+	awms.clear();
+	if (!in)
+		return false;
+
+	while (std::getline(in, line)) {
+		pos = line.find("<awm ");
+		if (pos == std::string::npos)
+			continue;
+		pos = line.find(" id=\"", pos);
+		if (pos == std::string::npos ||
+				sscanf(line.c_str() + pos, " id=\"%u\"", &id) != 1)
+			continue;
+		awms.push_back(id);
+	}
+	std::sort(awms.begin(), awms.end());
+	awms.erase(std::unique(awms.begin(), awms.end()), awms.end());
+
+	return !awms.empty();
+}
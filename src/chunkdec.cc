@@ -0,0 +1,324 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "effects.h"
+#include "frame_effects.h"
+#include "utils.h"
+#include "video_index.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.cdc"
+
+// The default interval of candidate seek points [frames]
+#define CHUNKS_INTERVAL 250
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each tool parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Chunked Decoding Options");
+
+/**
+ * The map of all tool parameters values
+ */
+po::variables_map opts_vm;
+
+/**
+ * @brief The video to process
+ */
+std::string input_path;
+
+/**
+ * @brief The index of the video
+ */
+std::string index_path;
+
+/**
+ * @brief The per-frame results (CSV), if not empty
+ */
+std::string output_path;
+
+/**
+ * @brief The analytics run on each frame, either "canny" or "fast"
+ */
+std::string effect;
+
+/**
+ * @brief The per-frame result of the analytics
+ *
+ * Edge pixels, for Canny, or keypoints, for FAST.
+ */
+typedef std::vector<uint32_t> Results;
+
+/**
+ * @brief A range of frames, decoded from its seek point by its own capture
+ */
+struct Chunk {
+	Range frames;
+	Results results;
+	double decode_ms;
+	double process_ms;
+	bool failed;
+};
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help") || input_path.empty() ||
+			(effect != "canny" && effect != "fast")) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+/**
+ * @brief Decode and process a chunk, with a capture of its own
+ */
+void ProcessChunk(VideoIndex const &index, Chunk &chunk) {
+	FastFeatureDetector fd(FAST_THRESHOLD, true);
+	std::vector<KeyPoint> kps;
+	std::vector<Strip> strips;
+	VideoCapture cap(input_path);
+	Mat frame, gray, edges, scratch;
+	Timer tmr;
+
+	chunk.decode_ms = chunk.process_ms = 0;
+	chunk.failed = true;
+	chunk.results.clear();
+
+	tmr.start();
+	if (!cap.isOpened() || !index.Seek(cap, chunk.frames.start, frame)) {
+		fprintf(stderr, FE("Seeking frame %d FAILED (stale index?)\n"),
+				chunk.frames.start);
+		return;
+	}
+	chunk.decode_ms += tmr.getElapsedTimeMs();
+
+	for (int f = chunk.frames.start; f < chunk.frames.end; ++f) {
+		if (f != chunk.frames.start) {
+			tmr.start();
+			if (!cap.read(frame)) {
+				fprintf(stderr, FE("Decoding frame %d FAILED\n"), f);
+				return;
+			}
+			chunk.decode_ms += tmr.getElapsedTimeMs();
+		}
+
+		// The same effects of the demo, on a single whole-frame strip:
+		// no halo approximation, thus results do not depend on chunking
+		tmr.start();
+		cvtColor(frame, gray, CV_BGR2GRAY);
+		strips.clear();
+		if (effect == "canny") {
+			SplitStrips(Rect(Point(), gray.size()), gray.size(), 1,
+					EFFECT_CANNY_HALO, strips);
+			edges.create(gray.size(), CV_8UC1);
+			CannyStrip(gray, edges, strips[0], scratch);
+			chunk.results.push_back(countNonZero(edges));
+		} else {
+			SplitStrips(Rect(Point(), gray.size()), gray.size(), 1,
+					EFFECT_FAST_HALO, strips);
+			DetectStrip(gray, fd, strips[0], kps);
+			chunk.results.push_back(kps.size());
+		}
+		chunk.process_ms += tmr.getElapsedTimeMs();
+	}
+
+	chunk.failed = false;
+}
+
+/**
+ * @brief Process all the chunks, by the specified number of workers
+ *
+ * @return the elapsed time [ms]
+ */
+double ProcessChunks(VideoIndex const &index, std::vector<Chunk> &chunks,
+		unsigned workers) {
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
+	Timer tmr;
+
+	// Workers pull the next chunk, thus balancing chunks of uneven cost
+	tmr.start();
+	for (unsigned w = 0; w < workers; ++w)
+		threads.push_back(std::thread([&]() {
+			size_t c;
+			while ((c = next++) < chunks.size())
+				ProcessChunk(index, chunks[c]);
+		}));
+	for (size_t w = 0; w < threads.size(); ++w)
+		threads[w].join();
+
+	return tmr.getElapsedTimeMs();
+}
+
+/**
+ * @brief Merge the per-chunk results, in frames order
+ */
+bool MergeChunks(std::vector<Chunk> const &chunks, Results &results) {
+	results.clear();
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		if (chunks[c].failed)
+			return false;
+		results.insert(results.end(), chunks[c].results.begin(),
+				chunks[c].results.end());
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<Chunk> chunks;
+	std::vector<Range> ranges;
+	Results results, baseline;
+	double elapsed_ms, decode_ms = 0, process_ms = 0;
+	unsigned workers, chunks_count, interval;
+	VideoIndex index;
+	bool verify;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("input,i", po::value<std::string>(&input_path),
+			"the video to process")
+		("index,x", po::value<std::string>(&index_path),
+			"the index of the video (default: <input>.idx), "
+			"built if missing or stale")
+		("rebuild,r", "rebuild the index, even if up-to-date")
+		("interval,n", po::value<unsigned>(&interval)->
+			default_value(CHUNKS_INTERVAL),
+			"the interval of candidate seek points [frames]")
+		("workers,w", po::value<unsigned>(&workers)->
+			default_value(std::thread::hardware_concurrency()),
+			"the number of parallel decoders")
+		("chunks,c", po::value<unsigned>(&chunks_count)->
+			default_value(0),
+			"the number of chunks (default: 4 for each worker)")
+		("effect,e", po::value<std::string>(&effect)->
+			default_value("canny"),
+			"the per-frame analytics, either canny or fast")
+		("output,o", po::value<std::string>(&output_path),
+			"the per-frame results (CSV)")
+		("verify,v", po::value<bool>(&verify)->
+			default_value(false),
+			"compare with a sequential run, by a single decoder")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	if (!workers)
+		workers = 1;
+	if (!chunks_count)
+		chunks_count = 4 * workers;
+	if (index_path.empty())
+		index_path = VideoIndex::DefaultPath(input_path);
+
+	// Index a video once, to process it many times
+	if (opts_vm.count("rebuild") || !index.Load(index_path, input_path)) {
+		if (!index.Build(input_path, interval))
+			return EXIT_FAILURE;
+		index.Save(index_path);
+	}
+
+	index.Chunks(chunks_count, ranges);
+	chunks.resize(ranges.size());
+	for (size_t c = 0; c < ranges.size(); ++c)
+		chunks[c].frames = ranges[c];
+	fprintf(stderr, FI("Processing [%s]: %u frames, %zu chunks, %u workers\n"),
+			input_path.c_str(), index.Frames(), chunks.size(), workers);
+
+	elapsed_ms = ProcessChunks(index, chunks, workers);
+	if (!MergeChunks(chunks, results)) {
+		fprintf(stderr, FE("Processing [%s] FAILED, remove index [%s] "
+					"to rebuild it\n"),
+				input_path.c_str(), index_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "%-6s %-15s %8s %10s %10s\n",
+			"Chunk", "Frames", "Count", "Decode", "Process");
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		Chunk const &ch = chunks[c];
+		char range[32];
+
+		snprintf(range, sizeof(range), "%d-%d",
+				ch.frames.start, ch.frames.end - 1);
+		fprintf(stdout, "%-6zu %-15s %8d %10.1f %10.1f\n",
+				c, range, ch.frames.size(), ch.decode_ms, ch.process_ms);
+		decode_ms += ch.decode_ms;
+		process_ms += ch.process_ms;
+	}
+	fprintf(stdout, "Frames %zu in %.1f [ms]: %.1f [fps], "
+			"decode %.1f [ms], process %.1f [ms], parallelism %.2f\n",
+			results.size(), elapsed_ms,
+			results.size() * 1000.0 / elapsed_ms,
+			decode_ms, process_ms, (decode_ms + process_ms) / elapsed_ms);
+
+	if (verify) {
+		std::vector<Chunk> sequential(1);
+		double sequential_ms;
+		size_t mismatches = 0;
+
+		sequential[0].frames = Range(0, index.Frames());
+		sequential_ms = ProcessChunks(index, sequential, 1);
+		MergeChunks(sequential, baseline);
+		for (size_t f = 0; f < results.size(); ++f)
+			if (f >= baseline.size() || results[f] != baseline[f])
+				++mismatches;
+		fprintf(stdout, "Sequential %zu frames in %.1f [ms]: %.1f [fps], "
+				"speedup %.2f, %zu mismatching frames\n",
+				baseline.size(), sequential_ms,
+				baseline.size() * 1000.0 / sequential_ms,
+				sequential_ms / elapsed_ms, mismatches);
+		if (mismatches || baseline.size() != results.size())
+			return EXIT_FAILURE;
+	}
+
+	if (!output_path.empty()) {
+		FILE *out = fopen(output_path.c_str(), "w");
+		if (!out) {
+			fprintf(stderr, FE("Writing [%s] FAILED\n"),
+					output_path.c_str());
+			return EXIT_FAILURE;
+		}
+		fprintf(out, "frame,%s\n", effect == "canny" ? "edges" : "keypoints");
+		for (size_t f = 0; f < results.size(); ++f)
+			fprintf(out, "%zu,%u\n", f, results[f]);
+		fclose(out);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "control_channel.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.ctl"
+
+// The period the listener checks for being stopped [ms]
+#define CONTROL_POLL_MS 200
+
+// The longest command line accepted
+#define CONTROL_LINE_MAX 64
+
+const char *ControlCommand::typeStr[] = {
+	"effect",
+	"resolution",
+	"fps",
+	"snapshot",
+	"exit"
+};
+
+bool ControlCommand::Parse(char const *line, ControlCommand &cmd) {
+	char name[16];
+	int fields;
+
+	cmd.arg[0] = 0;
+	fields = sscanf(line, "%15s %15s", name, cmd.arg);
+	if (fields < 1)
+		return false;
+
+	for (cmd.type = 0; cmd.type < CMD_COUNT; ++cmd.type) {
+		if (strcasecmp(name, typeStr[cmd.type]) == 0)
+			break;
+	}
+	switch (cmd.type) {
+	case CMD_EFFECT:
+	case CMD_RESOLUTION:
+	case CMD_FPS:
+		return (fields == 2);
+	case CMD_SNAPSHOT:
+	case CMD_EXIT:
+		return (fields == 1);
+	}
+	return false;
+}
+
+ControlChannel::ControlChannel() :
+	fd(-1),
+	running(false) {
+}
+
+ControlChannel::~ControlChannel() {
+	Close();
+}
+
+bool ControlChannel::Open(std::string const &_path) {
+	path = _path;
+
+	if (mkfifo(path.c_str(), 0600) != 0 && errno != EEXIST) {
+		fprintf(stderr, FE("Creating control [%s] FAILED (%s)\n"),
+				path.c_str(), strerror(errno));
+		return false;
+	}
+
+	// Opened also for writing, to not get an end of file each time the
+	// last client closes the pipe
+	fd = open(path.c_str(), O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, FE("Opening control [%s] FAILED (%s)\n"),
+				path.c_str(), strerror(errno));
+		return false;
+	}
+
+	running = true;
+	listener = std::thread(&ControlChannel::Listen, this);
+	fprintf(stderr, FI("Control commands on [%s]\n"), path.c_str());
+	return true;
+}
+
+void ControlChannel::Close() {
+	if (fd < 0)
+		return;
+
+	running = false;
+	listener.join();
+	close(fd);
+	unlink(path.c_str());
+	fd = -1;
+}
+
+void ControlChannel::Listen() {
+	char line[CONTROL_LINE_MAX];
+	size_t len = 0;
+	struct pollfd pfd;
+	ControlCommand cmd;
+	char c;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (running) {
+		if (poll(&pfd, 1, CONTROL_POLL_MS) <= 0)
+			continue;
+
+		// Commands are short, and rare: read them byte by byte
+		while (read(fd, &c, 1) == 1) {
+			if (c != '\n') {
+				if (len < sizeof(line) - 1)
+					line[len++] = c;
+				continue;
+			}
+			line[len] = 0;
+			if (!len)
+				continue;
+			len = 0;
+
+			if (!ControlCommand::Parse(line, cmd)) {
+				fprintf(stderr, FW("Control: invalid command [%s]\n"),
+						line);
+				continue;
+			}
+			if (!queue.Push(cmd))
+				fprintf(stderr, FW("Control: queue full, [%s] "
+							"dropped\n"), line);
+		}
+	}
+}
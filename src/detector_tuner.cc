@@ -0,0 +1,91 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "detector_tuner.h"
+
+DetectorTuner::DetectorTuner(char const *name, double value,
+		double min, double max, bool integral) :
+	name(name),
+	value(value),
+	min(min),
+	max(max),
+	integral(integral),
+	used_min(value),
+	used_max(value),
+	frames(0),
+	compliant(0) {
+	budget.keypoints = 0;
+	budget.effect_ms = 0;
+}
+
+void DetectorTuner::SetBudget(Budget const &budget) {
+	this->budget = budget;
+}
+
+bool DetectorTuner::Update(uint32_t keypoints, double effect_ms) {
+	double load = 0;
+	double next;
+
+	if (!Enabled())
+		return false;
+
+	// The load is the worst ratio between the usage and its budget
+	if (budget.keypoints)
+		load = static_cast<double>(keypoints) / budget.keypoints;
+	if (budget.effect_ms)
+		load = std::max(load, effect_ms / budget.effect_ms);
+
+	++frames;
+	if (load <= DETECTOR_TUNER_HIGH_WATER)
+		++compliant;
+
+	if (load > DETECTOR_TUNER_HIGH_WATER)
+		next = value * std::min(load / DETECTOR_TUNER_TARGET,
+				DETECTOR_TUNER_STEP_MAX);
+	else if (load < DETECTOR_TUNER_LOW_WATER)
+		next = value / DETECTOR_TUNER_STEP_DOWN;
+	else
+		return false;
+
+	// Integer parameters must move by one at least
+	if (integral) {
+		next = (next > value) ?
+			std::max(std::floor(next), value + 1) :
+			std::min(std::ceil(next), value - 1);
+	}
+	next = std::min(std::max(next, min), max);
+	if (next == value)
+		return false;
+
+	value = next;
+	used_min = std::min(used_min, value);
+	used_max = std::max(used_max, value);
+	return true;
+}
+
+void DetectorTuner::Print(FILE *out) const {
+	if (!frames)
+		return;
+
+	fprintf(out, "%-24s: cur %9.1f, min %9.1f, max %9.1f, "
+			"in budget %5.1f%% of %u frames\n",
+			name, value, used_min, used_max,
+			100 * Compliance(), frames);
+}
@@ -0,0 +1,88 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "effects.h"
+
+using namespace cv;
+
+Rect HaloRegion(Rect const &region, Size const &frame, int halo) {
+	int x = std::max(region.x - halo, 0);
+	int y = std::max(region.y - halo, 0);
+
+	return Rect(x, y,
+		std::min(region.x + region.width + halo, frame.width) - x,
+		std::min(region.y + region.height + halo, frame.height) - y);
+}
+
+void SplitStrips(Rect const &region, Size const &frame,
+		uint32_t count, int halo, std::vector<Strip> &strips) {
+	Rect area = HaloRegion(region, frame, halo);
+	int end = region.y + region.height;
+	int step;
+
+	if (count < 1)
+		count = 1;
+	step = (region.height + count - 1) / count;
+
+	for (int r = region.y; r < end; r += step) {
+		Strip s = {
+			Range(r, std::min(r + step, end)),
+			Range(std::max(r - halo, 0), std::min(r + step + halo,
+						frame.height)),
+			Range(region.x, region.x + region.width),
+			Range(area.x, area.x + area.width)
+		};
+		strips.push_back(s);
+	}
+}
+
+void CannyStrip(Mat const &gray, Mat &edges,
+		Strip const &strip, Mat &scratch) {
+	Mat in(gray, strip.halo, strip.halo_cols);
+	int skip = strip.rows.start - strip.halo.start;
+	int skip_cols = strip.cols.start - strip.halo_cols.start;
+
+	GaussianBlur(in, scratch, Size(7,7), 1.5, 1.5);
+	Canny(scratch, scratch, 0, 30, 3);
+
+	// Keep just the strip rows and columns
+	scratch(Range(skip, skip + strip.rows.size()),
+			Range(skip_cols, skip_cols + strip.cols.size())).copyTo(
+			Mat(edges, strip.rows, strip.cols));
+}
+
+void DetectStrip(Mat const &gray, FeatureDetector const &fd,
+		Strip const &strip, std::vector<KeyPoint> &kps) {
+	Mat in(gray, strip.halo, strip.halo_cols);
+	std::vector<KeyPoint>::iterator it;
+
+	fd.detect(in, kps);
+
+	// Back to image coordinates, dropping keypoints in the halos
+	for (it = kps.begin(); it != kps.end(); ++it) {
+		it->pt.x += strip.halo_cols.start;
+		it->pt.y += strip.halo.start;
+	}
+	kps.erase(std::remove_if(kps.begin(), kps.end(),
+		[&strip](KeyPoint const &kp) {
+			return (kp.pt.y < strip.rows.start ||
+				kp.pt.y >= strip.rows.end ||
+				kp.pt.x < strip.cols.start ||
+				kp.pt.x >= strip.cols.end);
+		}), kps.end());
+}
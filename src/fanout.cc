@@ -0,0 +1,189 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <csignal>
+#include <iostream>
+
+#include <unistd.h>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "shm_ring.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.fan"
+
+// The period of the consumers report [ms]
+#define FANOUT_REPORT_MS 5000
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each producer parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Frames Fan-out Options");
+
+/**
+ * The map of all producer parameters values
+ */
+po::variables_map opts_vm;
+
+/**
+ * @brief The video to decode, the camera if empty
+ */
+std::string input_path;
+
+/**
+ * @brief Set on SIGINT/SIGTERM, to close the ring
+ */
+volatile sig_atomic_t done = 0;
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help")) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+static void Terminate(int) {
+	done = 1;
+}
+
+/**
+ * @brief Report the status of all the consumers attached
+ */
+void Report(ShmRing &ring, double elapsed_ms) {
+	ShmRing::Consumer status[SHM_RING_CONSUMERS];
+	uint32_t count = ring.Consumers(status);
+
+	fprintf(stderr, FI("Published %lu frames, %.1f [fps], %u consumers\n"),
+			static_cast<unsigned long>(ring.Frames()),
+			ring.Frames() * 1000.0 / elapsed_ms, count);
+	for (uint32_t c = 0; c < count; ++c)
+		fprintf(stderr, FI("  pid %6d: lag %3lu, dropped %6lu, torn %6lu\n"),
+				status[c].pid,
+				static_cast<unsigned long>(status[c].lag),
+				static_cast<unsigned long>(status[c].dropped),
+				static_cast<unsigned long>(status[c].torn));
+}
+
+int main(int argc, char *argv[]) {
+	std::string ring_name;
+	unsigned short cam_id;
+	unsigned slots, frames_max;
+	double fps, period_ms, report_ms = 0;
+	VideoCapture cap;
+	ShmRing ring;
+	Mat frame;
+	Timer tmr;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("input,i", po::value<std::string>(&input_path),
+			"the video to decode (default: the camera)")
+		("cam,c", po::value<unsigned short>(&cam_id)->
+			default_value(0),
+			"the ID of the V4L2 webcam to use")
+		("ring,r", po::value<std::string>(&ring_name)->
+			default_value("ocvdemo"),
+			"the ring name, consumers read it as \"shm:<name>\"")
+		("slots,s", po::value<unsigned>(&slots)->
+			default_value(8),
+			"the number of frame slots")
+		("fps,f", po::value<double>(&fps)->
+			default_value(25),
+			"the frame rate of a video (0: as fast as decoded)")
+		("num,n", po::value<unsigned>(&frames_max)->
+			default_value(0),
+			"the number of frames to publish (0: all)")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	if (input_path.empty()) {
+		cap.open(cam_id);
+		fps = 0;
+	} else {
+		cap.open(input_path);
+	}
+	if (!cap.isOpened() || !cap.read(frame) || frame.empty()) {
+		fprintf(stderr, FE("ERROR: opening input [%s] FAILED!\n"),
+				input_path.empty() ? "camera" : input_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	if (!ring.Create(ring_name, frame.size(), frame.type(), slots))
+		return EXIT_FAILURE;
+	signal(SIGINT, Terminate);
+	signal(SIGTERM, Terminate);
+
+	// The first frame, read to size the ring, is copied into its slot
+	frame.copyTo(ring.Writable());
+	ring.Publish();
+
+	period_ms = fps > 0 ? 1000.0 / fps : 0;
+	tmr.start();
+	while (!done && (!frames_max || ring.Frames() < frames_max)) {
+		Mat slot;
+
+		// Paced as a camera: the producer never waits for consumers
+		while (period_ms && !done &&
+				tmr.getElapsedTimeMs() < ring.Frames() * period_ms)
+			usleep(1000);
+		if (done)
+			break;
+
+		// Decode straight into the slot, i.e. the decoder output is
+		// copied just once, into the shared memory. The slot is taken
+		// just now, thus consumers can still read its previous frame
+		// while pacing.
+		slot = ring.Writable();
+		frame = slot;
+		if (!cap.read(frame) || frame.empty())
+			break;
+		if (frame.data != slot.data)
+			frame.copyTo(slot);
+		ring.Publish();
+
+		if (tmr.getElapsedTimeMs() - report_ms >= FANOUT_REPORT_MS) {
+			report_ms = tmr.getElapsedTimeMs();
+			Report(ring, report_ms);
+		}
+	}
+
+	Report(ring, tmr.getElapsedTimeMs());
+	ring.Close();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <iostream>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "hamming.h"
+#include "refdb.h"
+#include "resolution.h"
+#include "stats.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.fbc"
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each benchmark parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Features Benchmark Options");
+
+/**
+ * The map of all benchmark parameters values
+ */
+po::variables_map opts_vm;
+
+/**
+ * @brief The image, or video, used as input
+ */
+std::string input_path;
+
+/**
+ * @brief The number of timed iterations for each configuration
+ */
+unsigned iterations;
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help") || input_path.empty()) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+/**
+ * @brief Get two consecutive frames from the input
+ *
+ * For a still image the second frame is the first one shifted by few
+ * pixels, which gives something meaningful to match.
+ */
+bool LoadFrames(Mat &prev, Mat &next) {
+	VideoCapture cap;
+	Mat frame;
+
+	frame = imread(input_path);
+	if (!frame.empty()) {
+		cvtColor(frame, prev, CV_BGR2GRAY);
+		next = Mat::zeros(prev.size(), prev.type());
+		prev(Rect(0, 0, prev.cols - 4, prev.rows - 4)).copyTo(
+			next(Rect(4, 4, prev.cols - 4, prev.rows - 4)));
+		return true;
+	}
+
+	cap.open(input_path);
+	if (!cap.read(frame))
+		return false;
+	cvtColor(frame, prev, CV_BGR2GRAY);
+	if (!cap.read(frame))
+		return false;
+	cvtColor(frame, next, CV_BGR2GRAY);
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	Ptr<Feature2D> surf = RefDB::NewFeatures(RefDB::DESC_SURF);
+	Ptr<Feature2D> orb = RefDB::NewFeatures(RefDB::DESC_ORB);
+	std::vector<std::vector<DMatch> > knn;
+	std::vector<KeyPoint> kps_prev, kps;
+	BFMatcher bf_l2(NORM_L2);
+	BFMatcher bf_hamming(NORM_HAMMING);
+	std::vector<DMatch> matches;
+	HammingMatcher hamming;
+	Mat desc_prev, desc;
+	Mat prev, next;
+	Timer tmr;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("input,i", po::value<std::string>(&input_path),
+			"the image, or video, to use as input")
+		("iterations,n", po::value<unsigned>(&iterations)->
+			default_value(20),
+			"the number of timed iterations")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	if (!LoadFrames(prev, next)) {
+		fprintf(stderr, FE("ERROR: loading frames from [%s] FAILED!\n"),
+				input_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "%-4s %-9s %-12s %6s %10s %10s %10s\n",
+			"Res", "Size", "Path", "Kps", "Extract", "Match", "Total");
+	for (uint8_t res = 0; res < RES_COUNT; ++res) {
+		Size size(CAM_PRESET_WIDTH(res), CAM_PRESET_HEIGHT(res));
+		Mat prev_res, next_res;
+		char res_size[16];
+
+		snprintf(res_size, sizeof(res_size), "%dx%d",
+				size.width, size.height);
+		resize(prev, prev_res, size);
+		resize(next, next_res, size);
+
+#define BENCH_PATH(NAME, FEATURES, MATCH)\
+		if (1) {\
+		Stats extract_ms, match_ms;\
+		(*FEATURES)(prev_res, Mat(), kps_prev, desc_prev);\
+		for (unsigned i = 0; i < iterations; ++i) {\
+			tmr.start();\
+			(*FEATURES)(next_res, Mat(), kps, desc);\
+			extract_ms.add(tmr.getElapsedTimeMs());\
+			tmr.start();\
+			MATCH;\
+			match_ms.add(tmr.getElapsedTimeMs());\
+		}\
+		fprintf(stdout, "%-4s %-9s %-12s %6lu %10.3f %10.3f %10.3f\n",\
+				resolutionStr[res], res_size, NAME, kps.size(),\
+				extract_ms.avg(), match_ms.avg(),\
+				extract_ms.avg() + match_ms.avg());\
+		}
+
+		BENCH_PATH("SURF+L2", surf,
+				bf_l2.knnMatch(desc, desc_prev, knn, 2));
+		BENCH_PATH("ORB+BF", orb,
+				bf_hamming.knnMatch(desc, desc_prev, knn, 2));
+		BENCH_PATH(hamming.Impl(), orb,
+				hamming.Match(desc, desc_prev, matches));
+	}
+
+	return EXIT_SUCCESS;
+}
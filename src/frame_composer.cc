@@ -0,0 +1,123 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
+#include "frame_composer.h"
+
+using namespace cv;
+
+FrameComposer::FrameComposer(Kernels const &kernels) :
+	kernels(kernels),
+	info_lines(0) {
+}
+
+void FrameComposer::Attach(MemoryBudget &memory, uint8_t subsys) {
+	memory.Attach(info_box, subsys);
+}
+
+void FrameComposer::Info(char const *fmt, ...) {
+	va_list args;
+
+	if (info_lines >= INFO_LINES_MAX)
+		return;
+
+	va_start(args, fmt);
+	vsnprintf(info[info_lines], INFO_LINE_LEN, fmt, args);
+	va_end(args);
+	++info_lines;
+}
+
+#define TEST_FONT(YPOS, TYPE)\
+	putText(display,\
+			"Test font: " #TYPE,\
+			Point(15, 15*YPOS),\
+			TYPE, 0.5,\
+			Scalar(0,0,0), 1, CV_AA);
+
+Mat & FrameComposer::Compose(Mat &frame, Mat const &effects,
+		Annotations const &annotations, std::vector<Rect> const &regions,
+		Mat &composition) {
+	uint16_t xorg = frame.cols - INFO_BOX_WIDTH;
+	uint16_t yorg = frame.rows - 8 - (INFO_LINE_YSPACE * info_lines);
+	uint16_t xend = frame.cols - 5;
+	uint16_t yend = frame.rows - 5;
+	uint16_t xthm = frame.cols - 5;
+	uint8_t  next_line = 1; // The first test line to write
+	Mat roi; // A generic image ROI
+#define TEXT_LINE(IMG, TXT)\
+	if ( 1 ) {\
+	putText(IMG, TXT,\
+		Point(xorg + 5, yorg + (INFO_LINE_YSPACE * next_line)),\
+		FONT_HERSHEY_COMPLEX_SMALL, 0.5,\
+		Scalar(200,200,200), 1, CV_AA);\
+	++next_line;\
+	}
+
+	// The image to be displayed (by default the captured frame)
+	display = frame;
+
+#if 0
+	TEST_FONT(0, FONT_HERSHEY_SIMPLEX);
+	TEST_FONT(1, FONT_HERSHEY_PLAIN);
+	TEST_FONT(2, FONT_HERSHEY_DUPLEX);
+	TEST_FONT(3, FONT_HERSHEY_COMPLEX);
+	TEST_FONT(4, FONT_HERSHEY_TRIPLEX);
+	TEST_FONT(5, FONT_HERSHEY_COMPLEX_SMALL);
+	TEST_FONT(6, FONT_HERSHEY_SCRIPT_SIMPLEX);
+#endif
+
+	// Render frame as thumbnail if effects are enabled
+	if (!effects.empty()) {
+		// Effects are single channel: the 3 channels RGB composition,
+		// required by colored overlay info, is done only here
+		kernels.GrayToRgb(effects, composition);
+		annotations.draw(composition);
+		display = composition;
+		xthm -= round(frame.cols*0.25);
+		roi = display(Rect(xthm, 10,
+			round(frame.cols*0.25),
+			round(frame.rows*0.25)
+		));
+		kernels.Thumbnail(frame, roi);
+	}
+
+	// Outline the regions of interest, unless the whole frame is
+	for (uint32_t r = 0; r < regions.size(); ++r) {
+		if (regions[r] == Rect(0, 0, frame.cols, frame.rows))
+			continue;
+		rectangle(display, regions[r], Scalar(255,128,0));
+	}
+
+	// Overlay the (semi-transparent) information box
+	if (frame.cols > INFO_BOX_WIDTH &&
+			frame.rows > 8 + (INFO_LINE_YSPACE * info_lines)) {
+		roi = display(Rect(xorg, yorg, xend - xorg, yend - yorg));
+		if (info_box.size() != roi.size()) {
+			info_box.create(roi.size(), CV_8UC3);
+			info_box = Scalar(63,103,157);
+		}
+		kernels.Blend(info_box, roi, INFO_BOX_ALPHA);
+	}
+
+	for (uint8_t l = 0; l < info_lines; ++l)
+		TEXT_LINE(display, info[l]);
+
+	return display;
+}
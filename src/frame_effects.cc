@@ -0,0 +1,273 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "frame_effects.h"
+#include "regions.h"
+#include "trace.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.fx"
+
+using namespace cv;
+
+const char *effectStr[] = {
+	"None",
+	"Canny",
+	"FAST",
+	"SURF",
+	"ObjRec",
+	"ORB"
+};
+
+FrameEffects::FrameEffects(WorkerPool &pool, Kernels const &kernels) :
+	pool(pool),
+	kernels(kernels),
+	memory(NULL),
+	fast_tuner("FAST threshold", FAST_THRESHOLD,
+			FAST_THRESHOLD_MIN, FAST_THRESHOLD_MAX, true),
+	surf_tuner("SURF hessian", SURF_HESSIAN,
+			SURF_HESSIAN_MIN, SURF_HESSIAN_MAX, false),
+	orec_found(0) {
+
+	// FAST Detector with (threshold = 10 and nonmax_suppression)
+	fast_detector = new FastFeatureDetector(FAST_THRESHOLD, true);
+
+	// SURF Detector with (hessianThreshold = 400., octaves = 3, octaveLayers = 4)
+	surf_detector = new SurfFeatureDetector(SURF_HESSIAN, 3, 4);
+
+	// Binary descriptors extractor, for the ORB effect
+	orb_features = new ORB(500);
+}
+
+void FrameEffects::Attach(MemoryBudget &_memory) {
+	memory = &_memory;
+	memory->Attach(orec_desc, MEM_FEATURES);
+	memory->Attach(orb_desc, MEM_FEATURES);
+	memory->Attach(orb_prev_desc, MEM_FEATURES);
+}
+
+bool FrameEffects::LoadRefDB(std::string const &path) {
+	if (!refdb.Load(path))
+		return false;
+	if (memory)
+		memory->SetExternal(MEM_REFDB, refdb.Size());
+	orec_features = RefDB::NewFeatures(refdb.Type());
+	return true;
+}
+
+void FrameEffects::SetBudget(DetectorTuner::Budget const &budget) {
+	fast_tuner.SetBudget(budget);
+	surf_tuner.SetBudget(budget);
+}
+
+void FrameEffects::Prewarm(Mat &gray) {
+	std::vector<KeyPoint> kps;
+	Mat desc;
+
+	// Run each detector once, on a few keypoints
+	gray = Scalar(0);
+	rectangle(gray, Rect(gray.cols / 4, gray.rows / 4,
+				gray.cols / 2, gray.rows / 2), Scalar(255), CV_FILLED);
+	fast_detector->detect(gray, kps);
+	surf_detector->detect(gray, kps);
+	(*orb_features)(gray, Mat(), kps, desc);
+	if (orec_features)
+		(*orec_features)(gray, Mat(), kps, desc);
+}
+
+void FrameEffects::Reset() {
+	orb_prev_desc.release();
+	orb_prev_kps.clear();
+}
+
+void FrameEffects::Canny(Mat const &frame, std::vector<Rect> const &regions,
+		Mat &gray, Mat &edges) {
+
+	// Strips of overlapping regions would write the same edges
+	MergeRegions(regions, merged);
+	strips.clear();
+	for (uint32_t r = 0; r < merged.size(); ++r) {
+		Rect area = HaloRegion(merged[r], frame.size(),
+				EFFECT_CANNY_HALO);
+		Mat roi(gray, area);
+		kernels.BgrToGray(frame(area), roi);
+
+		// One strip for each worker
+		SplitStrips(merged[r], frame.size(), pool.Size(),
+				EFFECT_CANNY_HALO, strips);
+	}
+	strips_scratch.resize(strips.size());
+	for (uint32_t i = 0; memory && i < strips.size(); ++i)
+		memory->Attach(strips_scratch[i], MEM_EFFECTS);
+	pool.Run(strips.size(), [this, &gray, &edges](uint32_t i) {
+		CannyStrip(gray, edges, strips[i], strips_scratch[i]);
+	});
+}
+
+bool FrameEffects::Detect(uint8_t effect, Mat const &gray,
+		std::vector<Rect> const &regions, Annotations &result) {
+	Timer tmr;
+
+	tmr.start();
+
+	// Overlapping regions would find the same keypoints
+	MergeRegions(regions, merged);
+	switch (effect) {
+	case EFF_FAST:
+		DetectFast(gray, merged, result);
+		break;
+	case EFF_SURF:
+		DetectSurf(gray, merged, result);
+		break;
+	case EFF_OREC:
+		if (!refdb.Loaded())
+			return false;
+		DetectObjRec(gray, result);
+		break;
+	case EFF_ORB:
+		DetectOrb(gray, result);
+		break;
+	default:
+		return false;
+	}
+	Tune(effect, result.keypoints.size(), tmr.getElapsedTimeMs());
+
+	return true;
+}
+
+void FrameEffects::DetectFast(Mat const &gray, std::vector<Rect> const &regions,
+		Annotations &result) {
+	std::vector<KeyPoint> &kps = result.keypoints;
+
+	// Keypoints detaction, one strip of each region for each worker
+	strips.clear();
+	for (uint32_t r = 0; r < regions.size(); ++r)
+		SplitStrips(regions[r], gray.size(), pool.Size(),
+				EFFECT_FAST_HALO, strips);
+	strips_kps.resize(strips.size());
+	pool.Run(strips.size(), [this, &gray](uint32_t i) {
+		DetectStrip(gray, *fast_detector, strips[i], strips_kps[i]);
+	});
+
+	// These are just annotations, which are rendered by the sink
+	for (uint32_t i = 0; i < strips.size(); ++i)
+		kps.insert(kps.end(), strips_kps[i].begin(), strips_kps[i].end());
+}
+
+void FrameEffects::DetectSurf(Mat const &gray, std::vector<Rect> const &regions,
+		Annotations &result) {
+
+	// Keypoints detaction
+	// These are just annotations, which are rendered by the sink
+	if (regions.size() == 1 && regions[0].size() == gray.size()) {
+		surf_detector->detect(gray, result.keypoints);
+		return;
+	}
+
+	// Keypoints of each region, back to frame coordinates
+	for (uint32_t r = 0; r < regions.size(); ++r) {
+		std::vector<KeyPoint>::iterator it;
+		surf_detector->detect(gray(regions[r]), region_kps);
+		for (it = region_kps.begin(); it != region_kps.end(); ++it) {
+			it->pt.x += regions[r].x;
+			it->pt.y += regions[r].y;
+		}
+		result.keypoints.insert(result.keypoints.end(),
+				region_kps.begin(), region_kps.end());
+	}
+}
+
+void FrameEffects::DetectObjRec(Mat const &gray, Annotations &result) {
+	Timer tmr;
+
+	// Keypoints detection and description
+	(*orec_features)(gray, Mat(), result.keypoints, orec_desc);
+
+	// Match against the reference objects, which are annotated as
+	// labelled boxes
+	tmr.start();
+	orec_found = refdb.Query(orec_desc, result.keypoints, result);
+	orec_query_ms.add(tmr.getElapsedTimeMs());
+}
+
+void FrameEffects::DetectOrb(Mat const &gray, Annotations &result) {
+	std::vector<KeyPoint> &kps = result.keypoints;
+	Timer tmr;
+
+	// Keypoints detection and (binary) description
+	(*orb_features)(gray, Mat(), kps, orb_desc);
+
+	// Track keypoints by matching with the previous frame
+	tmr.start();
+	hamming.Match(orb_desc, orb_prev_desc, orb_matches);
+	orb_match_ms.add(tmr.getElapsedTimeMs());
+
+	std::vector<DMatch>::const_iterator it = orb_matches.begin();
+	for ( ; it != orb_matches.end(); ++it) {
+		result.tracks.push_back(std::make_pair(
+					orb_prev_kps[it->trainIdx].pt,
+					kps[it->queryIdx].pt));
+	}
+
+	// The current frame is the reference for the next one
+	std::swap(orb_desc, orb_prev_desc);
+	orb_prev_kps = kps;
+}
+
+void FrameEffects::Tune(uint8_t effect, uint32_t kps, double teffect) {
+
+	// Keypoints are rendered too, thus their count bounds both the
+	// detection and the display cost
+	switch (effect) {
+	case EFF_FAST:
+		if (!fast_tuner.Update(kps, teffect))
+			return;
+		fast_detector->set("threshold",
+				static_cast<int>(fast_tuner.Value()));
+		TRACE_COUNTER("FAST threshold", fast_tuner.Value());
+		break;
+	case EFF_SURF:
+		if (!surf_tuner.Update(kps, teffect))
+			return;
+		surf_detector->set("hessianThreshold", surf_tuner.Value());
+		TRACE_COUNTER("SURF hessian", surf_tuner.Value());
+		break;
+	}
+}
+
+size_t FrameEffects::KeypointsBytes() const {
+	size_t kps = orb_prev_kps.capacity() + region_kps.capacity();
+
+	for (uint32_t i = 0; i < strips_kps.size(); ++i)
+		kps += strips_kps[i].capacity();
+	return kps * sizeof(KeyPoint);
+}
+
+void FrameEffects::Print(FILE *out) const {
+	fast_tuner.Print(out);
+	surf_tuner.Print(out);
+
+	if (refdb.Loaded()) {
+		fprintf(out, FI("RefDB load time: %.3f [ms]\n"),
+				refdb.LoadTimeMs());
+		orec_query_ms.print(out, "RefDB query", "ms");
+	}
+	if (orb_match_ms.count())
+		orb_match_ms.print(out, hamming.Impl(), "ms");
+}
@@ -0,0 +1,351 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+
+#include "async_effect.h"
+#include "frame_source.h"
+#include "resolution.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.src"
+
+using namespace cv;
+
+const char *FrameSource::typeStr[] = {
+	"camera",
+	"video",
+	"synthetic",
+	"ring"
+};
+
+FrameSource::FrameSource(std::string const &spec, uint8_t id) :
+	type(SRC_CAMERA),
+	spec(spec),
+	id(id),
+	latency_bounded(false),
+	skipped(0),
+	grab_ms(0),
+	grab_next_ms(0) {
+
+	if (spec.compare(0, strlen(SYNTHETIC_SOURCE_PREFIX),
+				SYNTHETIC_SOURCE_PREFIX) == 0)
+		type = SRC_SYNTH;
+	else if (spec.compare(0, strlen(SHM_RING_PREFIX),
+				SHM_RING_PREFIX) == 0)
+		type = SRC_SHM;
+	else if (spec != "")
+		type = SRC_VIDEO;
+}
+
+void FrameSource::Attach(MemoryBudget &memory, uint8_t subsys) {
+	memory.Attach(native, subsys);
+}
+
+bool FrameSource::OpenVideo() {
+	Mat frame;
+
+	fprintf(stderr, FI("Opening video [%s]...\n"), spec.c_str());
+	cap = VideoCapture(spec);
+
+	// Setup camera name
+	name = spec;
+
+	// Check if video soure has been properly initialized
+	if (!cap.isOpened()) {
+		fprintf(stderr, FE("ERROR: opening video [%s] FAILED!\n"),
+				spec.c_str());
+		return false;
+	}
+
+	// Setup maximum (native) resoulution, from the container when
+	// available, thus without decoding any frame
+	native_size.width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
+	native_size.height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
+	if (native_size.area())
+		return true;
+
+	// Otherwise, from the first frame (which is then decoded again)
+	cap >> frame;
+	if (frame.empty()) {
+		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
+				name.c_str());
+		return false;
+	}
+	cap.set(CV_CAP_PROP_POS_FRAMES, 0);
+	native_size = frame.size();
+
+	return native_size.area();
+}
+
+bool FrameSource::OpenSynth() {
+	SyntheticSource::Config cfg;
+
+	if (!SyntheticSource::Parse(
+			spec.substr(strlen(SYNTHETIC_SOURCE_PREFIX)), cfg)) {
+		fprintf(stderr, FE("ERROR: invalid synthetic source [%s]\n"),
+				spec.c_str());
+		return false;
+	}
+
+	// Setup source name
+	name = "SYNTH";
+
+	synth.Setup(cfg);
+	native_size = cfg.size;
+	fprintf(stderr, FI("Synthetic source: seed %u, %u shapes, noise %u, "
+				"%.1f [fps] (0: unpaced), jitter %.1f [ms]\n"),
+			cfg.seed, cfg.shapes, cfg.noise, cfg.fps, cfg.jitter_ms);
+
+	return true;
+}
+
+bool FrameSource::OpenShm() {
+
+	// Setup source name
+	name = "SHM";
+
+	if (!ring.Open(spec.substr(strlen(SHM_RING_PREFIX))))
+		return false;
+
+	native_size = ring.FrameSize();
+
+	return true;
+}
+
+bool FrameSource::OpenCamera() {
+	char wcap[] = "CAM99";
+
+	// Setup camera name
+	snprintf(wcap, sizeof(wcap), "CAM%02d", id);
+	name = std::string(wcap);
+
+	// Open input device
+	fprintf(stderr, FI("Opening V4L2 device [/dev/video%d]...\n"), id);
+	cap = VideoCapture(id);
+
+	// Check if video soure has been properly initialized
+	if (!cap.isOpened()) {
+		fprintf(stderr, FE("ERROR: opening camera [%s] FAILED!\n"),
+				name.c_str());
+		return false;
+	}
+
+	// Capture always at the maximum (native) resolution: resetting the
+	// capture size mid-stream stalls the camera
+	cap.set(CV_CAP_PROP_FRAME_WIDTH, CAM_PRESET_WIDTH(RES_HIG));
+	cap.set(CV_CAP_PROP_FRAME_HEIGHT, CAM_PRESET_HEIGHT(RES_HIG));
+	native_size.width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
+	native_size.height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
+	if (!native_size.area()) {
+		native_size.width = CAM_PRESET_WIDTH(RES_HIG);
+		native_size.height = CAM_PRESET_HEIGHT(RES_HIG);
+	}
+
+	return true;
+}
+
+bool FrameSource::Open() {
+
+	switch (type) {
+	case SRC_CAMERA:
+		return OpenCamera();
+	case SRC_SYNTH:
+		return OpenSynth();
+	case SRC_SHM:
+		return OpenShm();
+	}
+	return OpenVideo();
+}
+
+void FrameSource::Close() {
+
+	if (type == SRC_SHM)
+		ring.Close();
+	else if (cap.isOpened())
+		cap.release();
+}
+
+bool FrameSource::Start() {
+
+	// Videos are read in a single step, and latency bounded cameras grab
+	// at each frame
+	if (type != SRC_CAMERA || latency_bounded)
+		return true;
+
+	if (!GrabFromCamera()) {
+		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
+				name.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool FrameSource::Rewind() {
+
+	if (type != SRC_VIDEO)
+		return false;
+
+	return cap.set(CV_CAP_PROP_POS_FRAMES, 0);
+}
+
+FrameSource::Status FrameSource::ReadFromVideo(Mat &frame) {
+
+	// Recorded frames are captured when decoded
+	grab_ms = AsyncEffect::NowMs();
+
+	// Scaled down the frame (if required)
+	if (frame.size() != native_size) {
+		if (!cap.read(native))
+			return FRAME_END;
+		resize(native, frame, frame.size());
+		native_last = native;
+	} else if (!cap.read(frame)) {
+		return FRAME_END;
+	} else {
+		native_last = frame;
+	}
+	if (frame.empty()) {
+		fprintf(stderr, FE("ERROR: video frame grabbing FAILED!\n"));
+		return FRAME_ERROR;
+	}
+
+	return FRAME_OK;
+}
+
+bool FrameSource::GrabFromCamera() {
+	double tgrab = AsyncEffect::NowMs();
+
+	if (!cap.grab())
+		return false;
+	grab_next_ms = AsyncEffect::NowMs();
+
+	// A frame got without waiting has been queued by the driver, thus it
+	// is older than its timestamp: when latency bounded, drain the queue
+	for (uint8_t i = 0; latency_bounded && i < LATENCY_SKIPS_MAX &&
+			grab_next_ms - tgrab < LATENCY_QUEUED_MS; ++i) {
+		tgrab = grab_next_ms;
+		if (!cap.grab())
+			return false;
+		grab_next_ms = AsyncEffect::NowMs();
+		++skipped;
+	}
+
+	return true;
+}
+
+FrameSource::Status FrameSource::ReadFromCamera(Mat &frame) {
+
+	// When latency bounded, frames are grabbed right when required, since
+	// one grabbed in advance is (at least) one cycle old once processed
+	if (latency_bounded && !GrabFromCamera()) {
+		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
+				name.c_str());
+		return FRAME_ERROR;
+	}
+
+	// Acquire a frame from the camera, scaled down (if required)
+	if (!cap.retrieve(native)) {
+		fprintf(stderr, FE("ERROR: %s frame retriving FAILED!\n"),
+				name.c_str());
+		return FRAME_ERROR;
+	}
+	grab_ms = grab_next_ms;
+	resize(native, frame, frame.size());
+	native_last = native;
+	if (latency_bounded)
+		return FRAME_OK;
+
+	// Start next frame grabbing
+	if (!GrabFromCamera()) {
+		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
+				name.c_str());
+		return FRAME_ERROR;
+	}
+
+	return FRAME_OK;
+}
+
+FrameSource::Status FrameSource::ReadFromSynth(Mat &frame) {
+
+	// Generated at the native resolution, thus scaled as camera frames
+	if (frame.size() != native_size) {
+		synth.Read(native);
+		resize(native, frame, frame.size());
+		native_last = native;
+	} else {
+		synth.Read(frame);
+		native_last = frame;
+	}
+	grab_ms = synth.CapturedMs();
+
+	return FRAME_OK;
+}
+
+FrameSource::Status FrameSource::ReadFromShm(Mat &frame) {
+	Mat slot;
+
+	// Frames are read in place, and scaled (or copied) into the frame
+	// buffer, which is then annotated. A frame overwritten meanwhile, by
+	// the producer, is torn: just skip to the next one.
+	// When latency bounded, frames not yet read are stale already.
+	if (latency_bounded)
+		skipped += ring.SkipToLatest();
+	do {
+		if (!ring.Acquire(slot))
+			return FRAME_END;
+		if (frame.size() != slot.size())
+			resize(slot, frame, frame.size());
+		else
+			slot.copyTo(frame);
+	} while (!ring.Release());
+	grab_ms = ring.PublishedMs();
+	native_last = frame;
+
+	return FRAME_OK;
+}
+
+FrameSource::Status FrameSource::Read(Mat &frame) {
+
+	switch (type) {
+	case SRC_CAMERA:
+		return ReadFromCamera(frame);
+	case SRC_SYNTH:
+		return ReadFromSynth(frame);
+	case SRC_SHM:
+		return ReadFromShm(frame);
+	}
+	return ReadFromVideo(frame);
+}
+
+void FrameSource::Print(FILE *out) const {
+
+	if (type == SRC_SYNTH && synth.Dropped()) {
+		fprintf(out, FI("Synthetic frames dropped: %lu\n"),
+				static_cast<unsigned long>(synth.Dropped()));
+	}
+	if (type == SRC_SHM) {
+		fprintf(out, FI("Ring frames: %lu read, %lu dropped, "
+					"%lu torn\n"),
+				static_cast<unsigned long>(ring.Frames()),
+				static_cast<unsigned long>(ring.Dropped()),
+				static_cast<unsigned long>(ring.Torn()));
+	}
+}
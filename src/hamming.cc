@@ -0,0 +1,136 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <immintrin.h>
+
+#include "hamming.h"
+
+using namespace cv;
+
+static inline uint64_t Load64(uint8_t const *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t DistanceGeneric(uint8_t const *a, uint8_t const *b,
+		uint32_t len, uint32_t bound) {
+	uint32_t dist = 0;
+
+	for (uint32_t i = 0; i < len && dist < bound; i += 8)
+		dist += __builtin_popcountll(Load64(a + i) ^ Load64(b + i));
+
+	return dist;
+}
+
+__attribute__((target("popcnt")))
+static uint32_t DistancePopcnt(uint8_t const *a, uint8_t const *b,
+		uint32_t len, uint32_t bound) {
+	uint32_t dist = 0;
+	uint32_t i = 0;
+
+	// Two words per step, checking the bound every 16 bytes
+	for ( ; i + 16 <= len && dist < bound; i += 16) {
+		dist += _mm_popcnt_u64(Load64(a + i) ^ Load64(b + i));
+		dist += _mm_popcnt_u64(Load64(a + i + 8) ^ Load64(b + i + 8));
+	}
+	if (i < len && dist < bound)
+		dist += _mm_popcnt_u64(Load64(a + i) ^ Load64(b + i));
+
+	return dist;
+}
+
+__attribute__((target("avx2")))
+static uint32_t DistanceAVX2(uint8_t const *a, uint8_t const *b,
+		uint32_t len, uint32_t bound) {
+	// Popcount of each nibble value
+	__m256i const lut = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	__m256i const low = _mm256_set1_epi8(0x0f);
+	uint32_t dist = 0;
+	uint32_t i = 0;
+
+	for ( ; i + 32 <= len && dist < bound; i += 32) {
+		__m256i x = _mm256_xor_si256(
+			_mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i)),
+			_mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i)));
+		__m256i cnt = _mm256_add_epi8(
+			_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)),
+			_mm256_shuffle_epi8(lut,
+				_mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+		// Sum up bytes into the four 64bit lanes
+		cnt = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+		dist += _mm256_extract_epi64(cnt, 0) + _mm256_extract_epi64(cnt, 1) +
+			_mm256_extract_epi64(cnt, 2) + _mm256_extract_epi64(cnt, 3);
+	}
+	for ( ; i < len && dist < bound; i += 8)
+		dist += _mm_popcnt_u64(Load64(a + i) ^ Load64(b + i));
+
+	return dist;
+}
+
+HammingMatcher::HammingMatcher() :
+	impl("Generic"),
+	distance(DistanceGeneric) {
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		impl = "AVX2";
+		distance = DistanceAVX2;
+	} else if (__builtin_cpu_supports("popcnt")) {
+		impl = "POPCNT";
+		distance = DistancePopcnt;
+	}
+}
+
+void HammingMatcher::Match(Mat const &query, Mat const &train,
+		std::vector<DMatch> &matches,
+		uint32_t max_dist, float ratio) {
+	uint32_t len = query.cols;
+
+	matches.clear();
+	if (query.empty() || train.empty() || train.cols != query.cols)
+		return;
+
+	for (int q = 0; q < query.rows; ++q) {
+		uint8_t const *qd = query.ptr<uint8_t>(q);
+		uint32_t best = len * 8 + 1;
+		uint32_t second = len * 8 + 1;
+		int best_idx = -1;
+
+		for (int t = 0; t < train.rows; ++t) {
+			// Nothing better than the second best is of interest
+			uint32_t d = distance(qd, train.ptr<uint8_t>(t), len, second);
+			if (d >= second)
+				continue;
+			if (d < best) {
+				second = best;
+				best = d;
+				best_idx = t;
+			} else {
+				second = d;
+			}
+		}
+
+		if (best_idx < 0 || best > max_dist)
+			continue;
+		if (train.rows > 1 && best >= ratio * second)
+			continue;
+		matches.push_back(DMatch(q, best_idx, static_cast<float>(best)));
+	}
+}
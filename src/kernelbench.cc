@@ -0,0 +1,199 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <iostream>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "kernels.h"
+#include "resolution.h"
+#include "stats.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.kbc"
+
+// The opacity used to benchmark blending
+#define BENCH_ALPHA 160
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each benchmark parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Kernels Benchmark Options");
+
+/**
+ * The map of all benchmark parameters values
+ */
+po::variables_map opts_vm;
+
+/**
+ * @brief The image, or video, used as input
+ */
+std::string input_path;
+
+/**
+ * @brief The number of timed iterations for each configuration
+ */
+unsigned iterations;
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help") || input_path.empty()) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+/**
+ * @brief Get a (BGR) frame from the input, either an image or a video
+ */
+bool LoadFrame(Mat &frame) {
+	VideoCapture cap;
+
+	frame = imread(input_path);
+	if (!frame.empty())
+		return true;
+
+	cap.open(input_path);
+	return cap.read(frame);
+}
+
+int main(int argc, char *argv[]) {
+	Kernels kernels[Kernels::ISA_COUNT];
+	Mat frame;
+	Timer tmr;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("input,i", po::value<std::string>(&input_path),
+			"the image, or video, to use as input")
+		("iterations,n", po::value<unsigned>(&iterations)->
+			default_value(100),
+			"the number of timed iterations")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	if (!LoadFrame(frame)) {
+		fprintf(stderr, FE("ERROR: loading a frame from [%s] FAILED!\n"),
+				input_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	// One set of kernels for each implementation
+	for (uint8_t isa = 0; isa < Kernels::ISA_COUNT; ++isa)
+		kernels[isa] = Kernels(isa);
+
+	// Timings [ms], then the maximum difference from the OpenCV output,
+	// for each implementation
+	fprintf(stdout, "%-4s %-9s %-10s %10s", "Res", "Size", "Kernel", "OpenCV");
+	for (uint8_t isa = 0; isa < Kernels::ISA_COUNT; ++isa)
+		fprintf(stdout, " %10s", Kernels::isaStr[isa]);
+	fprintf(stdout, " |");
+	for (uint8_t isa = 0; isa < Kernels::ISA_COUNT; ++isa)
+		fprintf(stdout, " %7s", Kernels::isaStr[isa]);
+	fprintf(stdout, "\n");
+
+	for (uint8_t res = 0; res < RES_COUNT; ++res) {
+		Size size(CAM_PRESET_WIDTH(res), CAM_PRESET_HEIGHT(res));
+		Mat bgr, gray, rgb, overlay, out, ref;
+		Rect thumb(0, 0, size.width / 4, size.height / 4);
+		char res_size[16];
+
+		snprintf(res_size, sizeof(res_size), "%dx%d",
+				size.width, size.height);
+		resize(frame, bgr, size);
+		cvtColor(bgr, gray, CV_BGR2GRAY);
+		overlay.create(size, CV_8UC3);
+		overlay = Scalar(63,103,157);
+
+// Time the OpenCV call, and the kernel with each implementation, reporting
+// the maximum difference between the OpenCV output and each kernel one,
+// thus the fallbacks are verified too
+#define BENCH_KERNEL(NAME, SETUP, OPENCV, KERNEL)\
+		if (1) {\
+		Stats ocv_ms;\
+		double diff[Kernels::ISA_COUNT];\
+		for (unsigned i = 0; i < iterations; ++i) {\
+			SETUP;\
+			tmr.start();\
+			OPENCV;\
+			ocv_ms.add(tmr.getElapsedTimeMs());\
+		}\
+		ref = out.clone();\
+		fprintf(stdout, "%-4s %-9s %-10s %10.3f",\
+				resolutionStr[res], res_size, NAME, ocv_ms.avg());\
+		for (uint8_t isa = 0; isa < Kernels::ISA_COUNT; ++isa) {\
+			Kernels const &k = kernels[isa];\
+			Stats kernel_ms;\
+			diff[isa] = -1;\
+			if (k.Impl() != isa) {\
+				fprintf(stdout, " %10s", "-");\
+				continue;\
+			}\
+			for (unsigned i = 0; i < iterations; ++i) {\
+				SETUP;\
+				tmr.start();\
+				KERNEL;\
+				kernel_ms.add(tmr.getElapsedTimeMs());\
+			}\
+			fprintf(stdout, " %10.3f", kernel_ms.avg());\
+			diff[isa] = norm(out, ref, NORM_INF);\
+		}\
+		fprintf(stdout, " |");\
+		for (uint8_t isa = 0; isa < Kernels::ISA_COUNT; ++isa) {\
+			if (diff[isa] < 0)\
+				fprintf(stdout, " %7s", "-");\
+			else\
+				fprintf(stdout, " %7.0f", diff[isa]);\
+		}\
+		fprintf(stdout, "\n");\
+		}
+
+		BENCH_KERNEL("BGR2Gray", ,
+				cvtColor(bgr, out, CV_BGR2GRAY),
+				k.BgrToGray(bgr, out));
+		BENCH_KERNEL("Gray2RGB", ,
+				cvtColor(gray, out, CV_GRAY2RGB),
+				k.GrayToRgb(gray, out));
+		BENCH_KERNEL("Thumbnail", out.create(thumb.size(), CV_8UC3),
+				resize(bgr, out, out.size()),
+				k.Thumbnail(bgr, out));
+		BENCH_KERNEL("Blend", bgr.copyTo(out),
+				addWeighted(overlay, BENCH_ALPHA / 256.0,
+					out, 1 - BENCH_ALPHA / 256.0, 0, out),
+				k.Blend(overlay, out, BENCH_ALPHA));
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,451 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <immintrin.h>
+
+#include "kernels.h"
+
+using namespace cv;
+
+// Gray levels as for CV_BGR2GRAY: fixed point ITU-R BT.601 weights
+#define GRAY_SHIFT 14
+#define GRAY_B 1868
+#define GRAY_G 9617
+#define GRAY_R 4899
+
+const char *Kernels::isaStr[ISA_COUNT] = {
+	"Generic",
+	"SSE4.1",
+	"AVX2"
+};
+
+/*******************************************************************************
+ * Generic
+ ******************************************************************************/
+
+static void BgrToGrayGeneric(uint8_t const *bgr, uint8_t *gray,
+		uint32_t count) {
+
+	for (uint32_t i = 0; i < count; ++i, bgr += 3) {
+		gray[i] = (bgr[0] * GRAY_B + bgr[1] * GRAY_G + bgr[2] * GRAY_R +
+				(1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+	}
+}
+
+static void GrayToRgbGeneric(uint8_t const *gray, uint8_t *rgb,
+		uint32_t count) {
+
+	for (uint32_t i = 0; i < count; ++i, rgb += 3)
+		rgb[0] = rgb[1] = rgb[2] = gray[i];
+}
+
+static void AccumulateGeneric(uint8_t const *src, uint16_t *acc,
+		uint32_t count) {
+
+	for (uint32_t i = 0; i < count; ++i)
+		acc[i] += src[i];
+}
+
+static void BlendGeneric(uint8_t const *src, uint8_t *dst,
+		uint32_t count, uint16_t alpha) {
+	uint16_t beta = 256 - alpha;
+
+	for (uint32_t i = 0; i < count; ++i)
+		dst[i] = (src[i] * alpha + dst[i] * beta + 128) >> 8;
+}
+
+/*******************************************************************************
+ * SSE4.1
+ ******************************************************************************/
+
+/**
+ * @brief Gray levels of the 4 BGR pixels in the lower 12 bytes of w
+ *
+ * Pixels are zero extended to [B G R 0] words, thus a multiply-add with
+ * the weights, followed by an horizontal add, gives the weighted sums.
+ */
+__attribute__((target("sse4.1")))
+static inline __m128i Gray4SSE41(__m128i w) {
+	__m128i const lo = _mm_setr_epi8(
+			0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1);
+	__m128i const hi = _mm_setr_epi8(
+			6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1);
+	__m128i const weights = _mm_setr_epi16(
+			GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0);
+	__m128i const round = _mm_set1_epi32(1 << (GRAY_SHIFT - 1));
+	__m128i sum;
+
+	sum = _mm_hadd_epi32(
+			_mm_madd_epi16(_mm_shuffle_epi8(w, lo), weights),
+			_mm_madd_epi16(_mm_shuffle_epi8(w, hi), weights));
+	return _mm_srli_epi32(_mm_add_epi32(sum, round), GRAY_SHIFT);
+}
+
+__attribute__((target("sse4.1")))
+static void BgrToGraySSE41(uint8_t const *bgr, uint8_t *gray,
+		uint32_t count) {
+	uint32_t i = 0;
+
+	for ( ; i + 16 <= count; i += 16) {
+		uint8_t const *p = bgr + 3 * i;
+		__m128i v0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+		__m128i v1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + 16));
+		__m128i v2 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + 32));
+		// Four windows of 4 pixels (12 bytes) each
+		__m128i g0 = Gray4SSE41(v0);
+		__m128i g1 = Gray4SSE41(_mm_alignr_epi8(v1, v0, 12));
+		__m128i g2 = Gray4SSE41(_mm_alignr_epi8(v2, v1, 8));
+		__m128i g3 = Gray4SSE41(_mm_srli_si128(v2, 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(gray + i),
+			_mm_packus_epi16(_mm_packs_epi32(g0, g1),
+				_mm_packs_epi32(g2, g3)));
+	}
+
+	BgrToGrayGeneric(bgr + 3 * i, gray + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static void GrayToRgbSSE41(uint8_t const *gray, uint8_t *rgb,
+		uint32_t count) {
+	// Output byte j is gray level j/3
+	__m128i const m0 = _mm_setr_epi8(
+			0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	__m128i const m1 = _mm_setr_epi8(
+			5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+	__m128i const m2 = _mm_setr_epi8(
+			10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+	uint32_t i = 0;
+
+	for ( ; i + 16 <= count; i += 16) {
+		__m128i g = _mm_loadu_si128(reinterpret_cast<__m128i const *>(gray + i));
+		__m128i *p = reinterpret_cast<__m128i *>(rgb + 3 * i);
+		_mm_storeu_si128(p, _mm_shuffle_epi8(g, m0));
+		_mm_storeu_si128(p + 1, _mm_shuffle_epi8(g, m1));
+		_mm_storeu_si128(p + 2, _mm_shuffle_epi8(g, m2));
+	}
+
+	GrayToRgbGeneric(gray + i, rgb + 3 * i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static void AccumulateSSE41(uint8_t const *src, uint16_t *acc,
+		uint32_t count) {
+	uint32_t i = 0;
+
+	for ( ; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+		__m128i *a = reinterpret_cast<__m128i *>(acc + i);
+		_mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a),
+					_mm_cvtepu8_epi16(v)));
+		_mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1),
+					_mm_cvtepu8_epi16(_mm_srli_si128(v, 8))));
+	}
+
+	AccumulateGeneric(src + i, acc + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static void BlendSSE41(uint8_t const *src, uint8_t *dst,
+		uint32_t count, uint16_t alpha) {
+	__m128i const a = _mm_set1_epi16(alpha);
+	__m128i const b = _mm_set1_epi16(256 - alpha);
+	__m128i const round = _mm_set1_epi16(128);
+	uint32_t i = 0;
+
+	// Sums fit 16 bits: 255 * 256 + 128 < 65536
+	for ( ; i + 16 <= count; i += 16) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + i));
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_cvtepu8_epi16(s), a),
+				_mm_mullo_epi16(_mm_cvtepu8_epi16(d), b)), round);
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(s, 8)), a),
+				_mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(d, 8)), b)),
+				round);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+			_mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+
+	BlendGeneric(src + i, dst + i, count - i, alpha);
+}
+
+/*******************************************************************************
+ * AVX2
+ ******************************************************************************/
+
+__attribute__((target("avx2")))
+static inline __m256i Pair(__m128i lo, __m128i hi) {
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+/**
+ * @brief Gray levels of two windows of 4 BGR pixels, one for each lane
+ */
+__attribute__((target("avx2")))
+static inline __m256i Gray8AVX2(__m256i w) {
+	__m256i const lo = _mm256_setr_epi8(
+			0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1,
+			0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1);
+	__m256i const hi = _mm256_setr_epi8(
+			6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1,
+			6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1);
+	__m256i const weights = _mm256_setr_epi16(
+			GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0,
+			GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0);
+	__m256i const round = _mm256_set1_epi32(1 << (GRAY_SHIFT - 1));
+	__m256i sum;
+
+	sum = _mm256_hadd_epi32(
+			_mm256_madd_epi16(_mm256_shuffle_epi8(w, lo), weights),
+			_mm256_madd_epi16(_mm256_shuffle_epi8(w, hi), weights));
+	return _mm256_srli_epi32(_mm256_add_epi32(sum, round), GRAY_SHIFT);
+}
+
+__attribute__((target("avx2")))
+static void BgrToGrayAVX2(uint8_t const *bgr, uint8_t *gray,
+		uint32_t count) {
+	// Lanes packing leaves groups of 4 pixels as: 0 2 4 6 | 1 3 5 7
+	__m256i const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	uint32_t i = 0;
+
+	for ( ; i + 32 <= count; i += 32) {
+		__m128i const *p = reinterpret_cast<__m128i const *>(bgr + 3 * i);
+		__m128i v0 = _mm_loadu_si128(p);
+		__m128i v1 = _mm_loadu_si128(p + 1);
+		__m128i v2 = _mm_loadu_si128(p + 2);
+		__m128i v3 = _mm_loadu_si128(p + 3);
+		__m128i v4 = _mm_loadu_si128(p + 4);
+		__m128i v5 = _mm_loadu_si128(p + 5);
+		// Eight windows of 4 pixels (12 bytes) each, two per register
+		__m256i g0 = Gray8AVX2(Pair(v0, _mm_alignr_epi8(v1, v0, 12)));
+		__m256i g1 = Gray8AVX2(Pair(_mm_alignr_epi8(v2, v1, 8),
+					_mm_srli_si128(v2, 4)));
+		__m256i g2 = Gray8AVX2(Pair(v3, _mm_alignr_epi8(v4, v3, 12)));
+		__m256i g3 = Gray8AVX2(Pair(_mm_alignr_epi8(v5, v4, 8),
+					_mm_srli_si128(v5, 4)));
+		__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(g0, g1),
+				_mm256_packs_epi32(g2, g3));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(gray + i),
+			_mm256_permutevar8x32_epi32(packed, order));
+	}
+
+	BgrToGraySSE41(bgr + 3 * i, gray + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void GrayToRgbAVX2(uint8_t const *gray, uint8_t *rgb,
+		uint32_t count) {
+	// Each lane expands 16 output bytes, out of a 16 bytes window of
+	// gray levels starting at (16 * lane) / 3; masks repeat every 3 lanes
+	__m256i const m01 = _mm256_setr_epi8(
+			0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5,
+			0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5);
+	__m256i const m20 = _mm256_setr_epi8(
+			0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 5,
+			0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	__m256i const m12 = _mm256_setr_epi8(
+			0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5,
+			0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 5);
+	uint32_t i = 0;
+
+	// Windows read up-to 10 gray levels past the processed ones
+	for ( ; i + 48 <= count; i += 32) {
+		uint8_t const *g = gray + i;
+		__m256i *p = reinterpret_cast<__m256i *>(rgb + 3 * i);
+#define GRAY_WINDOW(OFFSET)\
+		_mm_loadu_si128(reinterpret_cast<__m128i const *>(g + OFFSET))
+		_mm256_storeu_si256(p, _mm256_shuffle_epi8(
+					Pair(GRAY_WINDOW(0), GRAY_WINDOW(5)), m01));
+		_mm256_storeu_si256(p + 1, _mm256_shuffle_epi8(
+					Pair(GRAY_WINDOW(10), GRAY_WINDOW(16)), m20));
+		_mm256_storeu_si256(p + 2, _mm256_shuffle_epi8(
+					Pair(GRAY_WINDOW(21), GRAY_WINDOW(26)), m12));
+#undef GRAY_WINDOW
+	}
+
+	GrayToRgbSSE41(gray + i, rgb + 3 * i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void AccumulateAVX2(uint8_t const *src, uint16_t *acc,
+		uint32_t count) {
+	uint32_t i = 0;
+
+	for ( ; i + 32 <= count; i += 32) {
+		__m128i const *s = reinterpret_cast<__m128i const *>(src + i);
+		__m256i *a = reinterpret_cast<__m256i *>(acc + i);
+		_mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a),
+					_mm256_cvtepu8_epi16(_mm_loadu_si128(s))));
+		_mm256_storeu_si256(a + 1, _mm256_add_epi16(_mm256_loadu_si256(a + 1),
+					_mm256_cvtepu8_epi16(_mm_loadu_si128(s + 1))));
+	}
+
+	AccumulateSSE41(src + i, acc + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void BlendAVX2(uint8_t const *src, uint8_t *dst,
+		uint32_t count, uint16_t alpha) {
+	__m256i const a = _mm256_set1_epi16(alpha);
+	__m256i const b = _mm256_set1_epi16(256 - alpha);
+	__m256i const round = _mm256_set1_epi16(128);
+	uint32_t i = 0;
+
+	for ( ; i + 32 <= count; i += 32) {
+		__m128i const *s = reinterpret_cast<__m128i const *>(src + i);
+		__m128i const *d = reinterpret_cast<__m128i const *>(dst + i);
+		__m256i lo = _mm256_add_epi16(_mm256_add_epi16(
+				_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(s)), a),
+				_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(d)), b)),
+				round);
+		__m256i hi = _mm256_add_epi16(_mm256_add_epi16(
+				_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(s + 1)), a),
+				_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(d + 1)), b)),
+				round);
+		// Packing is per lane: restore the order of the 64bit groups
+		__m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8),
+				_mm256_srli_epi16(hi, 8));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+			_mm256_permute4x64_epi64(packed, 0xD8));
+	}
+
+	BlendSSE41(src + i, dst + i, count - i, alpha);
+}
+
+/*******************************************************************************
+ * Kernels
+ ******************************************************************************/
+
+Kernels::Kernels(uint8_t isa) :
+	isa(ISA_GENERIC),
+	bgr_to_gray(BgrToGrayGeneric),
+	gray_to_rgb(GrayToRgbGeneric),
+	accumulate(AccumulateGeneric),
+	blend(BlendGeneric) {
+
+	__builtin_cpu_init();
+	if (isa >= ISA_AVX2 && __builtin_cpu_supports("avx2")) {
+		this->isa = ISA_AVX2;
+		bgr_to_gray = BgrToGrayAVX2;
+		gray_to_rgb = GrayToRgbAVX2;
+		accumulate = AccumulateAVX2;
+		blend = BlendAVX2;
+	} else if (isa >= ISA_SSE41 && __builtin_cpu_supports("sse4.1")) {
+		this->isa = ISA_SSE41;
+		bgr_to_gray = BgrToGraySSE41;
+		gray_to_rgb = GrayToRgbSSE41;
+		accumulate = AccumulateSSE41;
+		blend = BlendSSE41;
+	}
+}
+
+/**
+ * @brief Run a row kernel on all the rows of two images
+ *
+ * Continuous images are processed as a single row.
+ */
+#define FOR_EACH_ROW(SRC, DST, KERNEL, ...)\
+	if (SRC.isContinuous() && DST.isContinuous()) {\
+		KERNEL(SRC.ptr<uint8_t>(0), DST.ptr<uint8_t>(0),\
+				SRC.total(), ##__VA_ARGS__);\
+	} else {\
+		for (int r = 0; r < SRC.rows; ++r)\
+			KERNEL(SRC.ptr<uint8_t>(r), DST.ptr<uint8_t>(r),\
+					SRC.cols, ##__VA_ARGS__);\
+	}
+
+void Kernels::BgrToGray(Mat const &bgr, Mat &gray) const {
+
+	if (bgr.type() != CV_8UC3) {
+		cvtColor(bgr, gray, CV_BGR2GRAY);
+		return;
+	}
+	gray.create(bgr.size(), CV_8UC1);
+	FOR_EACH_ROW(bgr, gray, bgr_to_gray);
+}
+
+void Kernels::GrayToRgb(Mat const &gray, Mat &rgb) const {
+
+	if (gray.type() != CV_8UC1) {
+		cvtColor(gray, rgb, CV_GRAY2RGB);
+		return;
+	}
+	rgb.create(gray.size(), CV_8UC3);
+	FOR_EACH_ROW(gray, rgb, gray_to_rgb);
+}
+
+void Kernels::Thumbnail(Mat const &src, Mat &dst) const {
+	int fx = dst.cols ? src.cols / dst.cols : 0;
+	int fy = dst.rows ? src.rows / dst.rows : 0;
+	int cn = src.channels();
+	uint64_t inv;
+	uint32_t count;
+
+	// Just scaling down (by less than 256) 8bit images
+	if (!fx || !fy || fy > 256 || src.depth() != CV_8U ||
+			src.type() != dst.type()) {
+		resize(src, dst, dst.size(), 0, 0, INTER_AREA);
+		return;
+	}
+
+	// The first (source) byte of each destination pixel
+	count = src.cols * cn;
+	sums.resize(count);
+	cols.resize(dst.cols);
+	for (int x = 0; x < dst.cols; ++x)
+		cols[x] = (x * src.cols / dst.cols) * cn;
+
+	// Box averaging, by the fixed point inverse of the box area
+	inv = ((1ULL << 32) + (fx * fy) / 2) / (fx * fy);
+
+	for (int y = 0; y < dst.rows; ++y) {
+		int sy = y * src.rows / dst.rows;
+		uint8_t *out = dst.ptr<uint8_t>(y);
+
+		// Vertical sums, by the accumulation kernel
+		std::fill(sums.begin(), sums.end(), 0);
+		for (int r = 0; r < fy; ++r)
+			accumulate(src.ptr<uint8_t>(sy + r), &sums[0], count);
+
+		// Horizontal sums, and scaling
+		for (int x = 0; x < dst.cols; ++x, out += cn) {
+			uint16_t const *box = &sums[cols[x]];
+			for (int c = 0; c < cn; ++c) {
+				uint32_t sum = 0;
+				for (int k = 0; k < fx; ++k)
+					sum += box[k * cn + c];
+				out[c] = (sum * inv + (1ULL << 31)) >> 32;
+			}
+		}
+	}
+}
+
+void Kernels::Blend(Mat const &src, Mat &dst, uint16_t alpha) const {
+
+	if (src.type() != dst.type() || src.depth() != CV_8U) {
+		addWeighted(src, alpha / 256.0, dst, 1 - alpha / 256.0, 0, dst);
+		return;
+	}
+
+	if (src.isContinuous() && dst.isContinuous()) {
+		blend(src.ptr<uint8_t>(0), dst.ptr<uint8_t>(0),
+				src.total() * src.channels(), alpha);
+		return;
+	}
+	for (int r = 0; r < src.rows; ++r)
+		blend(src.ptr<uint8_t>(r), dst.ptr<uint8_t>(r),
+				src.cols * src.channels(), alpha);
+}
@@ -0,0 +1,132 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "memory_budget.h"
+
+using cv::Mat;
+
+const char *memorySubsystemStr[MEM_COUNT] = {
+	"Frames",
+	"Effects",
+	"Features",
+	"RefDB"
+};
+
+/**
+ * @brief The header prepended to each accounted block
+ *
+ * Its size keeps the data aligned as for cv::fastMalloc.
+ */
+struct BlockHeader {
+	size_t bytes;
+	int refcount;
+} __attribute__((aligned(16)));
+
+MemoryBudget::MemoryBudget() :
+	peak_total(0),
+	limit(0) {
+
+	for (uint8_t s = 0; s < MEM_COUNT; ++s) {
+		allocators[s].budget = this;
+		allocators[s].subsys = s;
+		used[s] = 0;
+		external[s] = 0;
+		peak[s] = 0;
+	}
+}
+
+void MemoryBudget::Attach(Mat &mat, uint8_t subsys) {
+	mat.allocator = &allocators[subsys];
+}
+
+void MemoryBudget::SetExternal(uint8_t subsys, size_t bytes) {
+
+	// Growing external memory could raise the high-water marks
+	if (external[subsys].exchange(bytes) < bytes)
+		Account(subsys, 0);
+}
+
+size_t MemoryBudget::Used() const {
+	size_t total = 0;
+
+	for (uint8_t s = 0; s < MEM_COUNT; ++s)
+		total += Used(s);
+	return total;
+}
+
+void MemoryBudget::UpdatePeak(std::atomic<size_t> &peak, size_t value) {
+	size_t cur = peak.load();
+
+	while (value > cur && !peak.compare_exchange_weak(cur, value))
+		;
+}
+
+void MemoryBudget::Account(uint8_t subsys, ssize_t bytes) {
+
+	used[subsys] += bytes;
+	if (bytes < 0)
+		return;
+
+	UpdatePeak(peak[subsys], Used(subsys));
+	UpdatePeak(peak_total, Used());
+}
+
+void MemoryBudget::Print(FILE *out) const {
+
+	fprintf(out, "%-10s %10s %10s\n", "Memory", "Used[KB]", "Peak[KB]");
+	for (uint8_t s = 0; s < MEM_COUNT; ++s) {
+		fprintf(out, "%-10s %10lu %10lu\n", memorySubsystemStr[s],
+				static_cast<unsigned long>(Used(s) >> 10),
+				static_cast<unsigned long>(Peak(s) >> 10));
+	}
+	fprintf(out, "%-10s %10lu %10lu\n", "Total",
+			static_cast<unsigned long>(Used() >> 10),
+			static_cast<unsigned long>(Peak() >> 10));
+	if (limit)
+		fprintf(out, "%-10s %10lu\n", "Budget",
+				static_cast<unsigned long>(limit >> 10));
+}
+
+void MemoryBudget::Allocator::allocate(int dims, const int *sizes, int type,
+		int *&refcount, uchar *&datastart, uchar *&data, size_t *step) {
+	BlockHeader *hdr;
+	size_t bytes;
+
+	// Continuous layout, as the default allocator does
+	step[dims - 1] = CV_ELEM_SIZE(type);
+	for (int i = dims - 2; i >= 0; --i)
+		step[i] = step[i + 1] * sizes[i + 1];
+	bytes = step[0] * sizes[0];
+
+	hdr = static_cast<BlockHeader *>(
+			cv::fastMalloc(sizeof(BlockHeader) + bytes));
+	hdr->bytes = bytes;
+	hdr->refcount = 1;
+
+	refcount = &hdr->refcount;
+	datastart = data = reinterpret_cast<uchar *>(hdr + 1);
+
+	budget->Account(subsys, bytes);
+}
+
+void MemoryBudget::Allocator::deallocate(int *refcount, uchar *datastart,
+		uchar *data) {
+	BlockHeader *hdr = reinterpret_cast<BlockHeader *>(datastart) - 1;
+	(void)refcount;
+	(void)data;
+
+	budget->Account(subsys, -static_cast<ssize_t>(hdr->bytes));
+	cv::fastFree(hdr);
+}
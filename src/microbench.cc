@@ -0,0 +1,223 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <iostream>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "frame_effects.h"
+#include "kernels.h"
+#include "resolution.h"
+#include "stats.h"
+#include "synthetic_source.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.mbc"
+
+// The opacity used to benchmark blending
+#define BENCH_ALPHA 160
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each benchmark parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Micro-Benchmark Options");
+
+/**
+ * The map of all benchmark parameters values
+ */
+po::variables_map opts_vm;
+
+/**
+ * @brief The synthetic scene used as input (see the --video option of
+ * bbque-ocvdemo), rendered at each resolution
+ */
+std::string scene_spec;
+
+/**
+ * @brief The reference objects database, to benchmark ObjRec too
+ */
+std::string refdb_path;
+
+/**
+ * @brief The number of fixed input frames, cycled by iterations
+ */
+unsigned frames_count;
+
+/**
+ * @brief The number of timed iterations for each configuration
+ */
+unsigned iterations;
+
+/**
+ * @brief The number of threads running the effects
+ */
+unsigned workers;
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help") || !frames_count || !iterations) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+/**
+ * @brief Report the timings of a benchmark (and its keypoints, if any)
+ */
+void Report(char const *res, char const *size, char const *name,
+		Stats const &ms, Stats const &kps) {
+	fprintf(stdout, "%-4s %-9s %-10s %9.3f %9.3f %9.3f %9.3f",
+			res, size, name, ms.avg(), ms.percentile(50),
+			ms.percentile(99), ms.max());
+	if (kps.count())
+		fprintf(stdout, " %7.0f\n", kps.avg());
+	else
+		fprintf(stdout, " %7s\n", "-");
+}
+
+int main(int argc, char *argv[]) {
+	SyntheticSource::Config scene;
+	SyntheticSource source;
+	WorkerPool pool;
+	Kernels kernels;
+	FrameEffects fx(pool, kernels);
+	Timer tmr;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("scene,s", po::value<std::string>(&scene_spec)->
+			default_value("shapes=16"),
+			"the synthetic scene: [,seed=S][,shapes=N][,noise=A]")
+		("refdb,d", po::value<std::string>(&refdb_path)->
+			default_value(""),
+			"the reference objects database, to benchmark ObjRec too")
+		("frames,f", po::value<unsigned>(&frames_count)->
+			default_value(8),
+			"the number of input frames, cycled by iterations")
+		("iterations,n", po::value<unsigned>(&iterations)->
+			default_value(100),
+			"the number of timed iterations")
+		("workers,w", po::value<unsigned>(&workers)->
+			default_value(1),
+			"the number of threads running the effects")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	if (!SyntheticSource::Parse(scene_spec, scene)) {
+		fprintf(stderr, FE("ERROR: bad scene [%s]\n"), scene_spec.c_str());
+		return EXIT_FAILURE;
+	}
+	if (!refdb_path.empty() && !fx.LoadRefDB(refdb_path))
+		return EXIT_FAILURE;
+	pool.Resize(workers);
+
+	fprintf(stderr, FI("Pixel kernels: %s, %u workers, %u frames "
+				"(seed %u)\n"),
+			Kernels::isaStr[kernels.Impl()], pool.Size(),
+			frames_count, scene.seed);
+
+	fprintf(stdout, "%-4s %-9s %-10s %9s %9s %9s %9s %7s\n",
+			"Res", "Size", "Bench", "Avg", "P50", "P99", "Max", "Kps");
+
+	for (uint8_t res = 0; res < RES_COUNT; ++res) {
+		Size size(CAM_PRESET_WIDTH(res), CAM_PRESET_HEIGHT(res));
+		std::vector<Mat> bgr(frames_count), gray(frames_count);
+		std::vector<Rect> regions(1, Rect(Point(0, 0), size));
+		Mat rgb, thumb, overlay, out, edges, scratch;
+		char res_size[16];
+
+		snprintf(res_size, sizeof(res_size), "%dx%d",
+				size.width, size.height);
+
+		// The same (seeded) frames at each resolution, and for each
+		// benchmark, thus results are comparable across runs
+		scene.size = size;
+		scene.fps = 0;
+		source.Setup(scene);
+		for (unsigned f = 0; f < frames_count; ++f) {
+			source.Read(bgr[f]);
+			cvtColor(bgr[f], gray[f], CV_BGR2GRAY);
+		}
+		thumb.create(size.height / 4, size.width / 4, CV_8UC3);
+		overlay.create(size, CV_8UC3);
+		overlay = Scalar(63,103,157);
+		edges.create(size, CV_8UC1);
+		scratch.create(size, CV_8UC1);
+
+		// Get rid of the first call costs, as the demo does
+		fx.Prewarm(scratch);
+
+// Time each call on its own, cycling the input frames
+#define BENCH(NAME, SETUP, CALL, KPS)\
+		if (1) {\
+		Stats ms, kps;\
+		for (unsigned i = 0; i < iterations; ++i) {\
+			unsigned f = i % frames_count;\
+			SETUP;\
+			tmr.start();\
+			CALL;\
+			ms.add(tmr.getElapsedTimeMs());\
+			KPS;\
+		}\
+		Report(resolutionStr[res], res_size, NAME, ms, kps);\
+		}
+
+		BENCH("BGR2Gray", ,
+				kernels.BgrToGray(bgr[f], out), );
+		BENCH("Gray2RGB", ,
+				kernels.GrayToRgb(gray[f], rgb), );
+		BENCH("Thumbnail", ,
+				kernels.Thumbnail(bgr[f], thumb), );
+		BENCH("Blend", bgr[f].copyTo(out),
+				kernels.Blend(overlay, out, BENCH_ALPHA), );
+
+		// The effects, restricted to the whole frame
+		BENCH(effectStr[EFF_CANNY], ,
+				fx.Canny(bgr[f], regions, scratch, edges), );
+		for (uint8_t eff = EFF_FAST; eff < EFF_COUNT; ++eff) {
+			Annotations result;
+
+			if (!fx.Available(eff))
+				continue;
+			fx.Reset();
+			BENCH(effectStr[eff], result.clear(),
+					fx.Detect(eff, gray[f], regions, result),
+					kps.add(result.keypoints.size()));
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
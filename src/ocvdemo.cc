@@ -14,10 +14,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <csignal>
 #include <cstdio>
 #include <iostream>
 #include <random>
 #include <cstring>
+#include <strings.h>
 #include <memory>
 
 #include <boost/program_options/options_description.hpp>
@@ -26,6 +28,7 @@
 
 #include "version.h"
 #include "ocvdemo_exc.h"
+#include "rtlib_sim.h"
 #include <bbque/utils/utility.h>
 
 #define EXC_BASENAME "OCVDemo"
@@ -89,9 +92,137 @@ unsigned short cam_id;
 
 /**
  * @brief The path of the .AVI video to use
+ *
+ * A path with the "synth:" prefix selects the synthetic source instead, while
+ * one with the "shm:" prefix reads the frames published, on the named shared
+ * memory ring, by a (bbque-ocvdemo-fanout) producer.
  */
 std::string video_path;
 
+/**
+ * @brief The name of the effect to start with
+ */
+std::string effect_name;
+
+/**
+ * @brief The effect to start with
+ */
+uint8_t effect_id = EFF_NONE;
+
+/**
+ * @brief Run without any display (analytics only)
+ */
+bool headless = false;
+
+/**
+ * @brief The reference objects database used for object recognition
+ */
+std::string refdb_path;
+
+/**
+ * @brief The recipe to generate by calibration
+ *
+ * If not empty, all the effects, resolutions and thread counts are
+ * calibrated, and the measured costs are used to generate a new recipe.
+ */
+std::string calib_recipe;
+
+/**
+ * @brief The number of frames measured for each calibration point
+ */
+unsigned calib_frames;
+
+/**
+ * @brief The AWM schedule replayed by the stand-in RTLib
+ *
+ * If not empty, the EXC is driven by an in-process stand-in of the RTLib,
+ * instead of the Barbeque RTRM, to benchmark reconfigurations.
+ */
+std::string rtlib_sim;
+
+/**
+ * @brief The regions of interest, as specified on the command line
+ */
+std::vector<std::string> region_specs;
+
+/**
+ * @brief The file listing the regions of interest
+ */
+std::string regions_path;
+
+/**
+ * @brief The regions of interest where effects are applied
+ *
+ * If empty, effects are applied to whole frames.
+ */
+std::vector<RegionOfInterest> regions;
+
+/**
+ * @brief The Chrome trace of the pipeline events
+ *
+ * If specified, tracing is enabled from the start; otherwise it can be
+ * enabled at run-time (by the 't' key), tracing into a default path.
+ */
+std::string trace_path;
+
+/**
+ * @brief Collect the hardware counters of each stage of the frames
+ */
+bool perf = false;
+
+/**
+ * @brief The per-frame budgets of the FAST and SURF detectors
+ *
+ * If any is not null, the detectors threshold is adapted frame-to-frame
+ * to keep both the keypoints count and the effect time within them.
+ */
+DetectorTuner::Budget detect_budget;
+
+/**
+ * @brief Run keypoints analytics in background, decoupled from display
+ */
+bool async = false;
+
+/**
+ * @brief The rows of the strips streaming Canny and FAST (0: disabled)
+ *
+ * Effects are streamed over the native frames, e.g. 4K or 8K ones, with a
+ * working set bounded by the strip size.
+ */
+unsigned stream_rows;
+
+/**
+ * @brief The preview published to out-of-process viewers (if named)
+ */
+PreviewSink::Config preview;
+
+/**
+ * @brief The named pipe receiving control commands (if not empty)
+ *
+ * E.g. "echo effect fast > <path>", see control_channel.h for the commands.
+ */
+std::string control_path;
+
+/**
+ * @brief The stream of the analytics results (if a path is given)
+ */
+ResultsSink::Config results;
+
+/**
+ * @brief The end-to-end latency budget [ms] of a frame (0: disabled)
+ *
+ * Frames older than this at processing time are skipped in favor of the
+ * newest one, trading completeness for freshness.
+ */
+double latency_budget_ms;
+
+/**
+ * @brief Dump the recorded trace events (on SIGUSR1)
+ */
+void on_trace_flush(int) {
+	Trace::RequestFlush();
+}
+
 void ParseCommandLine(int argc, char *argv[]) {
 	// Parse command line params
 	try {
@@ -103,6 +234,42 @@ void ParseCommandLine(int argc, char *argv[]) {
 	}
 	po::notify(opts_vm);
 
+	// Check for a valid effect name
+	for (effect_id = 0; effect_id < EFF_COUNT; ++effect_id) {
+		if (!strcasecmp(effect_name.c_str(),
+					effectStr[effect_id]))
+			break;
+	}
+	if (effect_id == EFF_COUNT) {
+		std::cout << "Unknown effect: " << effect_name << "\n";
+		::exit(EXIT_FAILURE);
+	}
+
+	// Each calibration point needs at least a measured frame
+	if (calib_frames < 1) {
+		std::cout << "Invalid calibration frames: " << calib_frames << "\n";
+		::exit(EXIT_FAILURE);
+	}
+
+	// Collect all the regions of interest
+	for (size_t i = 0; i < region_specs.size(); ++i) {
+		RegionOfInterest roi;
+		if (!ParseRegion(region_specs[i], roi)) {
+			std::cout << "Invalid region: " << region_specs[i] << "\n";
+			::exit(EXIT_FAILURE);
+		}
+		regions.push_back(roi);
+	}
+	if (!regions_path.empty() && !LoadRegions(regions_path, regions)) {
+		std::cout << "Invalid regions file: " << regions_path << "\n";
+		::exit(EXIT_FAILURE);
+	}
+
+	// Tracing since the start, if a trace has been required
+	Trace::Enable(!trace_path.empty());
+	if (trace_path.empty())
+		trace_path = "/tmp/ocvdemo_trace.json";
+
 	// Check for help request
 	if (opts_vm.count("help")) {
 		std::cout << "Usage: " << argv[0] << " [options]\n";
@@ -137,15 +304,36 @@ pBbqueEXC_t SetupEXC(uint8_t cam_id,
 		std::string const &video,
 		std::string const &recipe) {
 	char exc_name[] = EXC_BASENAME "_99";
+	OCVDemo::Config cfg;
 	pBbqueEXC_t pexc;
 
 	// Setup EXC name and recipe name
 	::snprintf(exc_name+sizeof(exc_name)-3, 3, "%02d", cam_id);
 
+	// Collect the command line options of the EXC
+	cfg.video = video;
+	cfg.cid = cam_id;
+	cfg.fps_max = fps_max;
+	cfg.frames_max = num_frames;
+	cfg.effect = effect_id;
+	cfg.headless = headless;
+	cfg.refdb = refdb_path;
+	cfg.calib_recipe = calib_recipe;
+	cfg.calib_frames = calib_frames;
+	cfg.regions = regions;
+	cfg.trace_path = trace_path;
+	cfg.perf = perf;
+	cfg.detect_budget = detect_budget;
+	cfg.async = async;
+	cfg.stream_rows = stream_rows;
+	cfg.preview = preview;
+	cfg.control_path = control_path;
+	cfg.results = results;
+	cfg.latency_budget_ms = latency_budget_ms;
+
 	// Build a new EXC (without enabling it yet)
 	assert(rtlib);
-	pexc = pBbqueEXC_t(new OCVDemo(exc_name, recipe, rtlib,
-				video, cam_id, fps_max, num_frames));
+	pexc = pBbqueEXC_t(new OCVDemo(exc_name, recipe, rtlib, cfg));
 
 	// Saving the EXC (if registration to BBQ was successfull)
 	if (!pexc->isRegistered())
@@ -174,16 +362,92 @@ int main(int argc, char *argv[]) {
 			"the ID of the V4L2 webcam to use")
 		("input,i", po::value<std::string>(&video_path)->
 			default_value(""),
-			"the path of the .AVI video to use")
+			"the path of the .AVI video to use, or a synthetic source as "
+			"\"synth:[WxH][,seed=S][,shapes=N][,noise=A][,fps=F]"
+			"[,jitter=J]\" (see synthetic_source.h), or a shared memory "
+			"ring as \"shm:<name>\" (see bbque-ocvdemo-fanout)")
 		("fps_max,f", po::value<unsigned short>(&fps_max)->
 			default_value(25),
 			"the maximum framerate required")
 		("num,n", po::value<unsigned>(&num_frames)->
 			default_value(0),
 			"the maximum number of frames to decode")
+		("effect,e", po::value<std::string>(&effect_name)->
+			default_value("None"),
+			"the effect to start with (None, Canny, FAST, SURF, ObjRec, ORB)")
+		("headless,H", po::bool_switch(&headless),
+			"do not display anything (analytics only)")
+		("refdb,d", po::value<std::string>(&refdb_path)->
+			default_value(""),
+			"the reference objects database (see bbque-ocvdemo-refdb)")
+		("calibrate,C", po::value<std::string>(&calib_recipe)->
+			default_value(""),
+			"calibrate on this platform and generate the specified recipe "
+			"(requires an AWM granting all the CPUs to be calibrated)")
+		("calib-frames", po::value<unsigned>(&calib_frames)->
+			default_value(100),
+			"the number of frames measured for each calibration point "
+			"(at least 1)")
+		("rtlib-sim", po::value<std::string>(&rtlib_sim)->
+			default_value(""),
+			"replay the specified AWM schedule without the BBQ daemon "
+			"(see rtlib_sim.h for the format)")
+		("roi", po::value<std::vector<std::string> >(&region_specs)->
+			composing(),
+			"a region of interest, as \"x,y,width,height[,name]\" "
+			"normalized to the frame size (can be repeated)")
+		("roi-file", po::value<std::string>(&regions_path)->
+			default_value(""),
+			"a file listing regions of interest, one for each line")
+		("trace", po::value<std::string>(&trace_path)->
+			default_value(""),
+			"record the pipeline events into the specified Chrome trace "
+			"(written at exit, or on SIGUSR1)")
+		("perf", po::bool_switch(&perf),
+			"report IPC and cache/branch misses of each frame stage "
+			"(requires perf events)")
+		("kps-budget", po::value<uint32_t>(&detect_budget.keypoints)->
+			default_value(0),
+			"tune FAST and SURF thresholds to detect up-to this number "
+			"of keypoints per frame (0: no limit)")
+		("effect-budget", po::value<double>(&detect_budget.effect_ms)->
+			default_value(0),
+			"tune FAST and SURF thresholds to detect keypoints within "
+			"this time [ms] per frame (0: no limit)")
+		("async", po::bool_switch(&async),
+			"run keypoints effects in background, overlaying their "
+			"latest result on the following frames")
+		("stream-rows", po::value<unsigned>(&stream_rows)->
+			default_value(0),
+			"stream Canny and FAST over strips of this many rows of "
+			"the native (e.g. 4K) frames, displayed at camera presets "
+			"(0: disabled)")
+		("preview", po::value<std::string>(&preview.name),
+			"publish the displayed frames, even if headless, on this "
+			"shared memory ring (see bbque-ocvdemo-viewer)")
+		("preview-width", po::value<uint32_t>(&preview.width)->
+			default_value(320),
+			"the width of the preview frames")
+		("preview-fps", po::value<double>(&preview.fps)->
+			default_value(5),
+			"the frame rate of the preview")
+		("control", po::value<std::string>(&control_path),
+			"the named pipe (created if missing) receiving control "
+			"commands: effect, resolution, fps, snapshot and exit")
+		("results", po::value<std::string>(&results.path),
+			"write the keypoints of each frame processed, as binary "
+			"records (see results_sink.h), into this file, named pipe "
+			"or \"shm:<name>\" shared memory ring")
+		("results-edges", po::bool_switch(&results.edges),
+			"write also the Canny edges, run-length encoded")
+		("latency-budget", po::value<double>(&latency_budget_ms)->
+			default_value(0),
+			"skip frames older than this [ms] at processing time, in "
+			"favor of the newest one (0: disabled)")
 	;
 
 	ParseCommandLine(argc, argv);
+	signal(SIGUSR1, on_trace_flush);
 
 	// Welcome screen
 	fprintf(stdout, FI(".:: BBQ OpenCV Demo Application (ver. %s)::.\n"),
@@ -191,7 +455,12 @@ int main(int argc, char *argv[]) {
 	fprintf(stdout, FI("Built: " __DATE__  " " __TIME__ "\n\n"));
 
 	// Init  RTLib library and setup the BBQ communication channel
-	RTLIB_Init(::basename(argv[0]), &rtlib);
+	if (!rtlib_sim.empty()) {
+		if (RTLIB_SimInit(rtlib_sim, &rtlib) != RTLIB_OK)
+			return EXIT_FAILURE;
+	} else {
+		RTLIB_Init(::basename(argv[0]), &rtlib);
+	}
 	assert(rtlib);
 
 	// Configuring required Execution Contexts
@@ -201,6 +470,8 @@ int main(int argc, char *argv[]) {
 
 	// Wait for the demo to complete
 	pexc->WaitCompletion();
+	if (!rtlib_sim.empty())
+		RTLIB_SimReport(stderr);
 
 	fprintf(stderr, FI("===== BBQ OpenCV Demo DONE! =====\n"));
 	return EXIT_SUCCESS;
@@ -15,8 +15,14 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <thread>
+#include <strings.h>
+#include <unistd.h>
 #include <bbque/utils/timer.h>
 #include <bbque/utils/utility.h>
 
@@ -32,23 +38,20 @@
 using namespace bbque::utils;
 using namespace cv;
 
-OCVDemo::Resolution OCVDemo::resolutions[] = {
-	{ 320,  240},
-	{ 640,  480},
-	{1280, 1024}
+const char *OCVDemo::stageStr[] = {
+	"grab",
+	"process",
+	"display"
 };
 
-const char *OCVDemo::resolutionStr[] = {
-	"LOW",
-	"MID",
-	"HIG"
-};
-
-const char *OCVDemo::effectStr[] = {
-	"None",
-	"Canny",
-	"FAST",
-	"SURF"
+const char *OCVDemo::phaseStr[] = {
+	"source",
+	"init",
+	"buffers",
+	"gui",
+	"schedule",
+	"configure",
+	"first frame"
 };
 
 /*******************************************************************************
@@ -57,12 +60,12 @@ const char *OCVDemo::effectStr[] = {
 
 CvButtons *buttons;
 
-bool evtExit = false;
+std::atomic<bool> evtExit(false);
 void on_exit(int toggle) {
 	evtExit = true;
 }
 
-bool evtSnapshot;
+std::atomic<bool> evtSnapshot(false);
 void on_snapshot(int toggle) {
 	evtSnapshot = true;
 }
@@ -71,41 +74,149 @@ void on_snapshot(int toggle) {
  * OpenCV Demo Code
  ******************************************************************************/
 
+OCVDemo::Config::Config() :
+	cid(0),
+	fps_max(25),
+	frames_max(0),
+	effect(EFF_NONE),
+	headless(false),
+	calib_frames(100),
+	perf(false),
+	async(false),
+	stream_rows(0),
+	latency_budget_ms(0) {
+}
+
 OCVDemo::OCVDemo(std::string const & name,
 		std::string const & recipe,
 		RTLIB_Services_t *rtlib,
-		std::string const & video,
-		uint8_t cid, uint8_t fps_max,
-		uint32_t frames_max) :
-	BbqueEXC(name, recipe, rtlib) {
-
-
-	// Keep track of the WebCam ID managed by this instance
-	cam.id = cid;
-	cam.video = video;
-	cam.using_camera = true;
-	if (cam.video != "")
-		cam.using_camera = false;
-	cam.fps_max = fps_max;
+		Config const & cfg) :
+	BbqueEXC(name, recipe, rtlib),
+	memory_exhausted(false),
+	src(cfg.video, cfg.cid),
+	composer(kernels),
+	headless(cfg.headless),
+	fx(pool, kernels),
+	async_mode(cfg.async),
+	stream(cfg.stream_rows),
+	stream_pixels(0),
+	stream_scratch_peak(0),
+	calib_recipe(cfg.calib_recipe),
+	calib_frames(cfg.calib_frames),
+	refdb_path(cfg.refdb),
+	switch_stalls(0),
+	frame_cost_ms(0),
+	effect_cost_ms(0),
+	regions(cfg.regions),
+	trace_path(cfg.trace_path),
+	perf_enabled(cfg.perf),
+	perf_threads(0),
+	preview(cfg.preview),
+	control_path(cfg.control_path),
+	results(cfg.results),
+	latency_budget_ms(cfg.latency_budget_ms),
+	latency_skipped(0),
+	latency_late(0) {
+	std::string recipe_path;
+
+	tcreate = bbque_tmr.getElapsedTimeMs();
+	tphase = tcreate;
+	for (uint8_t phase = 0; phase < PHASE_COUNT; ++phase)
+		startup_ms[phase] = 0;
+	first_frame_ms = 0;
+
+
+	cam.fps_max = cfg.fps_max;
 	cam.frames_count = 0;
 	cam.frames_total = 0;
-	cam.frames_max = frames_max;
-	cam.effect_idx = EFF_NONE;
+	cam.frames_max = cfg.frames_max;
+	cam.effect_idx = (cfg.effect < EFF_COUNT) ? cfg.effect : EFF_NONE;
+	cam.res_id = RES_COUNT;
+	SetResolution(RES_MID);
+
+	// Effects on all frames, until the policy decimates them
+	cam.decimation = 1;
+	cam.decimation_phase = 0;
+	cam.analytics_count = 0;
+	cam.analytics_total = 0;
+	cam.analytics_fps = 0;
+
+	// Account the memory of all frames and features buffers
+	src.Attach(memory, MEM_FRAMES);
+	composer.Attach(memory, MEM_FRAMES);
+	fx.Attach(memory);
 	if (CAMERA_SOURCE) {
 		fprintf(stderr, FW("OpenCV Demo EXC (webcam %d, max %d [fps]\n"),
-				cam.id, cam.fps_max);
+				src.Id(), cam.fps_max);
 	} else {
-		fprintf(stderr, FW("OpenCV Demo EXC (video %s, max %d [fps]\n"),
-				cam.video.c_str(), cam.fps_max);
+		fprintf(stderr, FW("OpenCV Demo EXC (%s %s, max %d [fps]\n"),
+				FrameSource::typeStr[src.GetType()],
+				src.Spec().c_str(), cam.fps_max);
 	}
 	if (cam.frames_max) {
 		fprintf(stderr, FW("Decoding up-to %d frames\n"), cam.frames_max);
 	}
+	if (headless) {
+		fprintf(stderr, FW("Headless mode, effect [%s]\n"),
+				effectStr[cam.effect_idx]);
+	}
+	for (uint32_t r = 0; r < regions.size(); ++r) {
+		fprintf(stderr, FI("Region [%s]: (%.2f, %.2f) %.2f x %.2f\n"),
+				regions[r].name.c_str(), regions[r].x, regions[r].y,
+				regions[r].width, regions[r].height);
+	}
+	if (!regions.empty()) {
+		fprintf(stderr, FI("Regions coverage: %.1f%%\n"),
+				100 * RegionsCoverage(regions));
+	}
+	if (Trace::Enabled()) {
+		fprintf(stderr, FI("Tracing into [%s]\n"), trace_path.c_str());
+	}
+	if (stream.Rows()) {
+		fprintf(stderr, FI("Canny and FAST streamed by strips of %u rows\n"),
+				stream.Rows());
+		stream.Attach(memory, MEM_EFFECTS);
+	}
+	if (stream.Rows() && !regions.empty()) {
+		fprintf(stderr, FW("Regions are not used by streamed effects\n"));
+	}
+	if (latency_budget_ms) {
+		fprintf(stderr, FI("Latency budget: %.1f [ms], stale frames "
+					"skipped\n"), latency_budget_ms);
+	}
+
+	// Detectors sensitivity, adapted to the budgets (if any)
+	fx.SetBudget(cfg.detect_budget);
+	if (cfg.detect_budget.Enabled()) {
+		fprintf(stderr, FI("Detectors budget: %u keypoints, "
+					"%.1f [ms] (0: no limit)\n"),
+				cfg.detect_budget.keypoints,
+				cfg.detect_budget.effect_ms);
+	}
+
+	fprintf(stderr, FI("Hamming matcher: %s\n"), fx.MatcherImpl());
+	fprintf(stderr, FI("Pixel kernels: %s\n"), Kernels::isaStr[kernels.Impl()]);
+
+	// The AWMs of the recipe, either installed or specified by path
+	recipe_path = recipe;
+	if (recipe_path.find('/') == std::string::npos)
+		recipe_path = BBQUE_OPENCV_DEMO_RECIPES_DIR "/" + recipe +
+			".recipe";
+	if (!Calibration::ReadRecipeAWMs(recipe_path, awms)) {
+		fprintf(stderr, FW("Recipe [%s] not readable, assuming "
+					"AWMs [0..%d]\n"), recipe_path.c_str(),
+				AWM_UPPER_ID);
+		for (uint8_t awm = 0; awm <= AWM_UPPER_ID; ++awm)
+			awms.push_back(awm);
+	}
+	awm_start = awms[std::min<size_t>(1, awms.size() - 1)];
+	fprintf(stderr, FI("Recipe AWMs: %lu, from [%d] to [%d]\n"),
+			awms.size(), awms.front(), awms.back());
 
 	// Setup default constraint
 	cnstr.operation = CONSTRAINT_ADD;
 	cnstr.type = UPPER_BOUND;
-	cnstr.awm = 1;
+	cnstr.awm = awm_start;
 	SetConstraints(&cnstr, sizeof(cnstr)/sizeof(RTLIB_Constraint_t));
 	fprintf(stderr, FI("Init AWM ID upper bound: %d\n"), cnstr.awm);
 
@@ -116,394 +227,613 @@ OCVDemo::~OCVDemo() {
 }
 
 
-RTLIB_ExitCode_t OCVDemo::SetResolutionCamera(uint8_t type) {
-
-	fprintf(stderr, FI("Setup camera resolution: [%d x %d]...\n"),
-			CAM_PRESET_WIDTH(type), CAM_PRESET_HEIGHT(type));
+Size OCVDemo::ResolutionSize(uint8_t type) const {
+	float reduce_fct;
 
-	cam.cap.set(CV_CAP_PROP_FRAME_WIDTH, CAM_PRESET_WIDTH(type));
-	cam.cap.set(CV_CAP_PROP_FRAME_HEIGHT, CAM_PRESET_HEIGHT(type));
-
-	// Keep track of current camera resolution
-	cam.cur_res.width = CAM_PRESET_WIDTH(type);
-	cam.cur_res.height = CAM_PRESET_HEIGHT(type);
-
-	cam.reduce_fct = 1.00;
-
-	return RTLIB_OK;
-}
-
-RTLIB_ExitCode_t OCVDemo::SetResolutionVideo(uint8_t type) {
+	// Camera presets are scaled (in software) from the native resolution,
+	// as well as streamed frames, whatever their size
+	if (CAMERA_SOURCE || stream.Rows()) {
+		return Size(
+			std::min<int>(CAM_PRESET_WIDTH(type), cam.max_res.width),
+			std::min<int>(CAM_PRESET_HEIGHT(type), cam.max_res.height));
+	}
 
-	// Video source resolution is changed at frame acquisition time
-	// Once this method is called, just setup the required actual sizes
 	switch (type) {
 	case RES_LOW:
-		cam.reduce_fct = 0.33;
+		reduce_fct = 0.33;
 		break;
 	case RES_MID:
-		cam.reduce_fct = 0.66;
+		reduce_fct = 0.66;
 		break;
 	default:
-		cam.reduce_fct = 1.00;
+		reduce_fct = 1.00;
 	}
 
-	// Keep track of current camera resolution
-	cam.cur_res.width = round(cam.max_res.width * cam.reduce_fct);
-	cam.cur_res.height = round(cam.max_res.height * cam.reduce_fct);
+	return Size(round(cam.max_res.width * reduce_fct),
+			round(cam.max_res.height * reduce_fct));
+}
 
-	return RTLIB_OK;
+size_t OCVDemo::ResolutionBytes(uint8_t type) const {
+	Size size = ResolutionSize(type);
+	size_t channels;
+
+	// Frame, gray, effects and (unless headless) composition
+	channels = (headless && !preview.Enabled()) ? 5 : 8;
+	return size.area() * channels;
 }
 
-RTLIB_ExitCode_t OCVDemo::SetResolution(uint8_t type) {
-	RTLIB_ExitCode_t result = RTLIB_OK;
+RTLIB_ExitCode_t OCVDemo::PrewarmResolution(uint8_t type) {
+	Camera::Buffers &buff = cam.buffers[type];
+	Size size = ResolutionSize(type);
+
+	// All the buffers required by effects and composition, thus
+	// a resolution switch does not (re)allocate anything
+	memory.Attach(buff.frame, MEM_FRAMES);
+	memory.Attach(buff.gray, MEM_EFFECTS);
+	memory.Attach(buff.effects, MEM_EFFECTS);
+	memory.Attach(buff.composition, MEM_FRAMES);
+	buff.frame.create(size, CV_8UC3);
+	buff.gray.create(size, CV_8UC1);
+	buff.effects.create(size, CV_8UC1);
+	if (!headless || preview.Enabled())
+		buff.composition.create(size, CV_8UC3);
 
-	if (type >= RES_COUNT)
-		return RTLIB_ERROR;
+	return RTLIB_OK;
+}
 
-	if (CAMERA_SOURCE) {
-		result = SetResolutionCamera(type);
-	} else {
-		result = SetResolutionVideo(type);
-	}
-	if (result != RTLIB_OK) {
-		return result;
-	}
+RTLIB_ExitCode_t OCVDemo::PrewarmResolutions() {
+	double tprewarm = bbque_tmr.getElapsedTimeMs();
 
-	// Keep track of current camera resolution
-	cam.res_id = type;
-	DB(fprintf(stderr, FD("Current resolution %s: [%d x %d]...\n"),
-			resolutionStr[cam.res_id],
-			CAM_WIDTH(cam), CAM_HEIGHT(cam)));
+	for (uint8_t type = RES_LOW; type < RES_COUNT; ++type)
+		PrewarmResolution(type);
 
-	return result;
+	fprintf(stderr, FI("Resolutions pre-warmed in %.3f [ms]\n"),
+			bbque_tmr.getElapsedTimeMs() - tprewarm);
 
+	return RTLIB_OK;
 }
 
-RTLIB_ExitCode_t OCVDemo::SetupSourceVideo() {
-	Mat frame;
+void OCVDemo::TrimResolution(uint8_t type) {
+	Camera::Buffers &buff = cam.buffers[type];
 
-	fprintf(stderr, FI("Opening video [%s]...\n"), cam.video.c_str());
-	cam.cap = VideoCapture(cam.video);
+	if (buff.frame.empty())
+		return;
 
-	// Setup camera name
-	cam.wcap = cam.video.c_str();
+	// Buffers still in use (by the current frame) are actually released
+	// once the switch to a lower resolution has been applied
+	fprintf(stderr, FW("Releasing %s resolution buffers\n"),
+			resolutionStr[type]);
+	buff.frame.release();
+	buff.gray.release();
+	buff.effects.release();
+	buff.composition.release();
+}
 
-	// Check if video soure has been properly initialized
-	if (!cam.cap.isOpened()) {
-		fprintf(stderr, FE("ERROR: opening video [%s] FAILED!\n"),
-				cam.video.c_str());
-		return RTLIB_ERROR;
-	}
+RTLIB_ExitCode_t OCVDemo::SetResolution(uint8_t type) {
 
-	// Get first frame which is used to read the native resolution
-	cam.cap >> frame;
-	if (frame.empty()) {
-		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
-				cam.wcap.c_str());
+	if (type >= RES_COUNT)
 		return RTLIB_ERROR;
-	}
 
-	// Setup maximum (native) resoulution
-	cam.max_res.width = frame.cols;
-	cam.max_res.height = frame.rows;
-	if (!cam.max_res.width || !cam.max_res.height) {
-		return RTLIB_ERROR;
-	}
+	// Just stage the switch, which is applied at the next frame boundary
+	cam.res_next = type;
+	DB(fprintf(stderr, FD("Staged resolution %s\n"),
+			resolutionStr[cam.res_next]));
 
-	cam.using_camera = false;
 	return RTLIB_OK;
 }
 
-RTLIB_ExitCode_t OCVDemo::SetupSourceCamera() {
-	char wcap[] = "CAM99";
+RTLIB_ExitCode_t OCVDemo::ApplyResolution() {
+	Camera::Buffers &buff = cam.buffers[cam.res_next];
+	TRACE_SCOPE("switch", cam.res_next);
 
-	// Setup camera name
-	snprintf(wcap, sizeof(wcap), "CAM%02d", cam.id);
-	cam.wcap = std::string(wcap);
+	// Regions and tracked keypoints are used by analytics in background
+	async.Wait();
 
-	// Open input device
-	fprintf(stderr, FI("Opening V4L2 device [/dev/video%d]...\n"), cam.id);
-	cam.cap = VideoCapture(cam.id);
+	// Buffers could have been released to fit the memory budget
+	if (buff.frame.empty())
+		PrewarmResolution(cam.res_next);
 
-	// Check if video soure has been properly initialized
-	if (!cam.cap.isOpened()) {
-		fprintf(stderr, FE("ERROR: opening camera [%s] FAILED!\n"),
-				cam.wcap.c_str());
-		return RTLIB_ERROR;
+	// Switch to the pre-allocated buffers
+	cam.frame = buff.frame;
+	cam.gray = buff.gray;
+	cam.effects = buff.effects;
+	composition = buff.composition;
+
+	// Keep track of current camera resolution
+	cam.cur_res.width = cam.frame.cols;
+	cam.cur_res.height = cam.frame.rows;
+	cam.reduce_fct = static_cast<float>(cam.frame.cols) / cam.max_res.width;
+
+	// Keypoints, and annotations, of different resolutions cannot be
+	// tracked, nor overlaid
+	fx.Reset();
+	cam.annotations.clear();
+
+	// The regions to process, in pixels of the new resolution
+	cam.regions.clear();
+	for (uint32_t r = 0; r < regions.size(); ++r) {
+		Rect rect = regions[r].Rect(cam.frame.size());
+		if (rect.area())
+			cam.regions.push_back(rect);
 	}
+	if (regions.empty())
+		cam.regions.push_back(Rect(0, 0, cam.frame.cols, cam.frame.rows));
+
+	// The first frame at the new resolution is always processed: the
+	// last results are in the coordinates of the previous one
+	cam.decimation_phase = 0;
 
-	// Setup maximum (native) resoulution
-	cam.max_res.width = CAM_PRESET_WIDTH(RES_HIG);
-	cam.max_res.height = CAM_PRESET_HEIGHT(RES_HIG);
+	cam.res_id = cam.res_next;
+	DB(fprintf(stderr, FD("Current resolution %s: [%d x %d]...\n"),
+			resolutionStr[cam.res_id],
+			CAM_WIDTH(cam), CAM_HEIGHT(cam)));
 
-	cam.using_camera = true;
 	return RTLIB_OK;
 }
 
-RTLIB_ExitCode_t OCVDemo::onSetup() {
-	RTLIB_ExitCode_t result;
+RTLIB_ExitCode_t OCVDemo::SetupSource() {
+	double tsource = bbque_tmr.getElapsedTimeMs();
+	RTLIB_ExitCode_t result = RTLIB_OK;
 
 	// Setup the required video source
-	if (CAMERA_SOURCE) {
-		result = SetupSourceCamera();
+	if (src.Open()) {
+		cam.max_res.width = src.NativeSize().width;
+		cam.max_res.height = src.NativeSize().height;
 	} else {
-		result = SetupSourceVideo();
+		result = RTLIB_ERROR;
+	}
+
+	startup_ms[PHASE_SOURCE] = bbque_tmr.getElapsedTimeMs() - tsource;
+	return result;
+}
+
+RTLIB_ExitCode_t OCVDemo::SetupEager() {
+	double tinit = bbque_tmr.getElapsedTimeMs();
+	Mat gray;
+
+	// Workers sized on the resources granted so far, thus the first
+	// configuration (most likely) does not respawn them
+	pool.Resize(grant.Threads());
+
+	if (!control_path.empty() && !control.Open(control_path))
+		return RTLIB_ERROR;
+	if (results.GetConfig().Enabled() && !results.Open())
+		return RTLIB_ERROR;
+
+	// Load the reference objects database (if required)
+	if (!refdb_path.empty() && !fx.LoadRefDB(refdb_path))
+		return RTLIB_ERROR;
+
+	// Get rid of the lazy initializations, of both OpenCV and the
+	// detectors, which are otherwise paid by the first frames at each
+	// resolution. Sources are scaled to (or close to) the presets.
+	// This runs concurrently with the source opening: OpenCV functions
+	// are reentrant on distinct data, and the process-wide settings are
+	// changed before the source thread is started.
+	for (uint8_t type = RES_LOW; type < RES_COUNT; ++type) {
+		gray.create(CAM_PRESET_HEIGHT(type), CAM_PRESET_WIDTH(type),
+				CV_8UC1);
+		fx.Prewarm(gray);
 	}
+
+	startup_ms[PHASE_INIT] = bbque_tmr.getElapsedTimeMs() - tinit;
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t OCVDemo::onSetup() {
+	RTLIB_ExitCode_t source_result = RTLIB_OK;
+	RTLIB_ExitCode_t result;
+	std::thread source;
+	double tbuffers;
+	double tgui;
+
+	Trace::ThreadName(exc_name.c_str());
+
+	// OpenCV threads sized on the resources granted so far, before any
+	// other thread could run OpenCV functions
+	ReadResourceGrant(grant);
+	setNumThreads(grant.Threads());
+
+	// Opening the source (e.g. a V4L2 device, or a video container) is
+	// slow, and independent of everything else, initialized meanwhile
+	source = std::thread([this, &source_result]() {
+		Trace::ThreadName("source");
+		source_result = SetupSource();
+	});
+	result = SetupEager();
+	source.join();
 	if (result != RTLIB_OK)
 		return result;
+	if (source_result != RTLIB_OK)
+		return source_result;
 
 	fprintf(stderr, FI("Max (native) resolution: [%d x %d]\n"),
 			cam.max_res.width, cam.max_res.height);
 
-	// Setup initial resolution to medium
-	SetResolution(RES_MID);
+	// Recorded, or unpaced, sources are read at the pace of processing,
+	// thus the next frame is never newer than the current one
+	if (latency_budget_ms && !src.Live()) {
+		fprintf(stderr, FW("Latency budget ignored, "
+					"not a live source\n"));
+		latency_budget_ms = 0;
+	}
+	src.SetLatencyBounded(latency_budget_ms);
+
+	// A preview is just an (optional) diagnostic aid
+	if (preview.Enabled() && !preview.Open(Size(cam.max_res.width,
+					cam.max_res.height)))
+		fprintf(stderr, FW("Preview disabled\n"));
+
+	if (!fx.Available(cam.effect_idx)) {
+		fprintf(stderr, FW("No reference database loaded, "
+					"effects disabled\n"));
+		cam.effect_idx = EFF_NONE;
+	}
+
+	// Setup the calibration plan (if required), on all available effects
+	// and up-to all the CPUs we have been granted
+	if (!calib_recipe.empty()) {
+		std::vector<uint8_t> effects;
+
+		for (uint8_t e = EFF_NONE; e < EFF_COUNT; ++e) {
+			if (!fx.Available(e))
+				continue;
+			effects.push_back(e);
+		}
+		calib.reset(new Calibration(calib_recipe, effects, RES_COUNT,
+					grant.Threads(), cam.fps_max, calib_frames));
+		CalibrationApply();
+	}
+
+	// Allocate buffers for all the resolutions, the initial one (medium,
+	// unless calibrating) being staged already
+	tbuffers = bbque_tmr.getElapsedTimeMs();
+	PrewarmResolutions();
+
+	// Calibration measures the cost of analytics on frames
+	if (async_mode && !calib) {
+		async.Attach(memory, MEM_EFFECTS);
+		async.Start([this](uint8_t effect, Mat const &gray,
+					Annotations &result) {
+			doAnalytics(effect, gray, result);
+		});
+		fprintf(stderr, FI("Analytics in background\n"));
+	}
+
+	// Analytics only: neither a window nor buttons are required
+	tgui = bbque_tmr.getElapsedTimeMs();
+	startup_ms[PHASE_BUFFERS] = tgui - tbuffers;
+	tphase = tgui;
+	if (headless)
+		return RTLIB_OK;
 
 	// Setup camera view
-	namedWindow(cam.wcap.c_str(), CV_WINDOW_AUTOSIZE);
+	namedWindow(src.Name().c_str(), CV_WINDOW_AUTOSIZE);
 
 	// Create simple buttons and attach them to their callback functions
 	buttons = new CvButtons();
 	buttons->addButton(PushButton(10, 10, 110, 20, -1, "Exit", on_exit));
 	buttons->addButton(PushButton(10, 40, 110, 20, -1, "Snapshot", on_snapshot));
-	cvSetMouseCallback(cam.wcap.c_str(), cvButtonsOnMouse, buttons);
+	cvSetMouseCallback(src.Name().c_str(), cvButtonsOnMouse, buttons);
 
+	tphase = bbque_tmr.getElapsedTimeMs();
+	startup_ms[PHASE_GUI] = tphase - tgui;
 	return RTLIB_OK;
 }
 
 
 
 RTLIB_ExitCode_t OCVDemo::onConfigure(uint8_t awm_id) {
+	double tconf = bbque_tmr.getElapsedTimeMs();
+	TRACE_SCOPE("configure", awm_id);
+	uint32_t threads;
+
 	fprintf(stderr, FW("OCVDemo::onConfigure(): "
 				"EXC [%s], AWM[%02d]\n"),
 				exc_name.c_str(), awm_id);
 
+	// Waiting for the first AWM is part of the startup
+	if (!configure_ms.count())
+		startup_ms[PHASE_SCHEDULE] = tconf - tphase;
+
+	// Match the processing parallelism with the granted resources, once
+	// workers are no more used by analytics in background
+	async.Wait();
+	ReadResourceGrant(grant);
+	threads = grant.Threads();
+	pool.Resize(threads);
+	pool.SetAffinity(grant.cpus);
+	setNumThreads(threads);
+	fprintf(stderr, FI("AWM[%02d] grant: %d CPUs, %d%% quota, "
+				"%lu MB => %d threads\n"), awm_id,
+			grant.cpus_count, grant.cpu_quota,
+			static_cast<unsigned long>(grant.mem_limit >> 20),
+			threads);
+
+	// Calibration controls the thread count by itself
+	if (calib && !calib->Done())
+		CalibrationApply();
+
+	// Fit the granted memory (calibration just measures it)
+	MemoryBudgetSetup();
+	if (!calib)
+		MemoryPolicy();
+
 	// Get the start processing time
 	tstart = bbque_tmr.getElapsedTimeMs();
 	cam.frames_count = 0;
+	cam.analytics_count = 0;
 
 	// Start next frame grabbing
-	if (!cam.cap.grab()) {
-		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
-				cam.wcap.c_str());
+	if (!src.Start())
 		return RTLIB_ERROR;
-	}
 
+	tphase = bbque_tmr.getElapsedTimeMs();
+	if (!configure_ms.count())
+		startup_ms[PHASE_CONFIGURE] = tphase - tconf;
+	configure_ms.add(tphase - tconf);
 	return RTLIB_OK;
 }
 
-RTLIB_ExitCode_t OCVDemo::getImageFromVideo() {
-	std::vector<DataMatrixCode> codes;
-	Mat frame;
-
-	// Scaled down the frame (if required)
-	if (cam.reduce_fct < 1.0) {
-		if (!cam.cap.read(frame))
-			goto exit_eof;
-		resize(frame, cam.frame,
-				Size(round(frame.cols * cam.reduce_fct),
-					round(frame.rows * cam.reduce_fct)));
-	} else if (!cam.cap.read(cam.frame)) {
-			goto exit_eof;
-	}
-	if (cam.frame.empty()) {
-		fprintf(stderr, FE("ERROR: video frame grabbing FAILED!\n"));
-		return RTLIB_ERROR;
-	}
-
-	return RTLIB_OK;
-
-exit_eof:
-	return RTLIB_EXC_WORKLOAD_NONE;
-
-}
-
-RTLIB_ExitCode_t OCVDemo::getImageFromCamera() {
-
-	// Acquire a frame from the camera
-	if (!cam.cap.retrieve(cam.frame)) {
-		fprintf(stderr, FE("ERROR: %s frame retriving FAILED!\n"),
-				cam.wcap.c_str());
-		return RTLIB_ERROR;
-	}
+RTLIB_ExitCode_t OCVDemo::getImage() {
+	TRACE_SCOPE("grab", cam.frames_total);
 
-	// Start next frame grabbing
-	if (!cam.cap.grab()) {
-		fprintf(stderr, FE("ERROR: %s frame grabbing FAILED!\n"),
-				cam.wcap.c_str());
+	switch (src.Read(cam.frame)) {
+	case FrameSource::FRAME_OK:
+		return RTLIB_OK;
+	case FrameSource::FRAME_END:
+		return RTLIB_EXC_WORKLOAD_NONE;
+	default:
 		return RTLIB_ERROR;
 	}
-
-	return RTLIB_OK;
-}
-
-RTLIB_ExitCode_t OCVDemo::getImage() {
-	if (CAMERA_SOURCE)
-		return getImageFromCamera();
-	return getImageFromVideo();
 }
 
-#define TEST_FONT(YPOS, TYPE)\
-	putText(cam.frame,\
-			"Test font: " #TYPE,\
-			Point(15, 15*YPOS),\
-			TYPE, 0.5,\
-			Scalar(0,0,0), 1, CV_AA);
-
 RTLIB_ExitCode_t OCVDemo::showImage() {
-	uint16_t xorg = CAM_WIDTH(cam)  - 240;
-	uint16_t yorg = CAM_HEIGHT(cam) -  30;
-	uint16_t xend = CAM_WIDTH(cam)  -   5;
-	uint16_t yend = CAM_HEIGHT(cam) -   5;
-	uint16_t xthm = CAM_WIDTH(cam)  -   5;
-	uint8_t  next_line = 1; // The first test line to write
-	char buff[64]; // auxiliary text buffer
-	Mat roi; // A generic image ROI
-#define LINE_YSPACE 11
-#define TEXT_LINE(IMG, TXT)\
-	if ( 1 ) {\
-	putText(IMG, TXT,\
-		Point(xorg + 5, yorg + (LINE_YSPACE * next_line)),\
-		FONT_HERSHEY_COMPLEX_SMALL, 0.5,\
-		Scalar(200,200,200), 1, CV_AA);\
-	++next_line;\
-	}
-
-	// The image to be displayed (by default the captured frame)
-	display = cam.frame;
-
-#if 0
-	TEST_FONT(0, FONT_HERSHEY_SIMPLEX);
-	TEST_FONT(1, FONT_HERSHEY_PLAIN);
-	TEST_FONT(2, FONT_HERSHEY_DUPLEX);
-	TEST_FONT(3, FONT_HERSHEY_COMPLEX);
-	TEST_FONT(4, FONT_HERSHEY_TRIPLEX);
-	TEST_FONT(5, FONT_HERSHEY_COMPLEX_SMALL);
-	TEST_FONT(6, FONT_HERSHEY_SCRIPT_SIMPLEX);
-
-	// Overlay the information box
-	rectangle(cam.frame,
-			Point(xorg, yorg),
-			Point(xend, yend),
-			Scalar(63,103,157),
-			CV_FILLED);
-#endif
-
-	// Render frame as thumbnail if effects are enabled
-	if (cam.effect_idx != EFF_NONE) {
-		display = cam.effects;
-		xthm -= round(cam.frame.cols*0.25);
-		roi = display(Rect(xthm, 10,
-			round(cam.frame.cols*0.25),
-			round(cam.frame.rows*0.25)
-		));
-		resize(cam.frame, roi, roi.size());
-	}
+	bool tuning = fx.Tuner(EFF_FAST).Enabled() &&
+		(cam.effect_idx == EFF_FAST || cam.effect_idx == EFF_SURF);
+	bool async_tag = AnalyticsAsync() && async.Completed();
+	double now = bbque_tmr.getElapsedTimeMs();
+	bool preview_due = preview.Due(now);
+	Mat none; // No effect output to compose
+
+	// Nothing to render, thus avoid any composition cost
+	if (headless && !preview_due)
+		return RTLIB_OK;
+	TRACE_SCOPE("display");
 
-	snprintf(buff, 64,
+	composer.ClearInfo();
+	composer.Info(
 		"/dev/video%d: "
 		"%dx%d @ %5.2f [fps]",
-		cam.id,
+		src.Id(),
 		CAM_WIDTH(cam), CAM_HEIGHT(cam), cam.fps_cur
 	);
-	TEXT_LINE(display, buff);
 
-	snprintf(buff, 64,
+	composer.Info(
 		"AWMs: %d,%d [cur,max] | "
 		"%s",
 		CurrentAWM(), cnstr.awm, effectStr[cam.effect_idx]
 	);
-	TEXT_LINE(display, buff);
+
+	if (cam.effect_idx != EFF_NONE) {
+		composer.Info(
+			"Analytics: %5.2f [fps] | 1 of %d frames",
+			cam.analytics_fps, cam.decimation
+		);
+	}
+
+	if (async_tag) {
+		composer.Info(
+			"Result: frame %u | %3u frames, %4.0f [ms] old",
+			async_result.frame, cam.frames_total - async_result.frame,
+			AsyncEffect::NowMs() - async_result.submit_ms
+		);
+	}
+
+	if (cam.effect_idx == EFF_OREC) {
+		composer.Info(
+			"Objects: %d/%d | Query: %6.2f [ms]",
+			fx.ObjectsFound(), fx.References().Objects(),
+			fx.QueryMs().avg()
+		);
+	}
+
+	if (cam.effect_idx == EFF_ORB) {
+		composer.Info(
+			"Matches: %lu | %s: %6.2f [ms]",
+			fx.Matches(), fx.MatcherImpl(), fx.MatchMs().avg()
+		);
+	}
+
+	if (tuning) {
+		DetectorTuner const &tuner = fx.Tuner(cam.effect_idx);
+		composer.Info(
+			"Thr: %.0f | Kps: %lu | In budget: %3.0f%%",
+			tuner.Value(), cam.annotations.keypoints.size(),
+			100 * tuner.Compliance()
+		);
+	}
+
+	// Effects, annotations and regions of interest (if any)
+	Mat &display = composer.Compose(cam.frame,
+			(cam.effect_idx != EFF_NONE) ? cam.effects : none,
+			cam.annotations, cam.regions, composition);
+
+	// Viewers get just the composition, without the buttons
+	if (preview_due)
+		preview.Publish(display, now);
+	if (headless)
+		return RTLIB_OK;
 
 	// Update buttons
 	buttons->paintButtons(display);
-	imshow(cam.wcap.c_str(), display);
+	imshow(src.Name().c_str(), display);
 
 	return RTLIB_OK;
 }
 
 RTLIB_ExitCode_t OCVDemo::doCanny() {
-	cvtColor(cam.frame, cam.effects, CV_BGR2GRAY);
-	GaussianBlur(cam.effects, cam.effects, Size(7,7), 1.5, 1.5);
-	Canny(cam.effects, cam.effects, 0, 30, 3);
-	// Ensure image is 3 channel RGB, as required for proper
-	// composition with overlay info
-	cvtColor(cam.effects, cam.effects, CV_GRAY2RGB);
+
+	// Just the regions of interest (and their halos) are processed,
+	// everything else has no edges
+	if (!regions.empty())
+		cam.effects = Scalar(0);
+	fx.Canny(cam.frame, cam.regions, cam.gray, cam.effects);
+
 	return RTLIB_OK;
 }
 
-RTLIB_ExitCode_t OCVDemo::doFast() {
-	// FAST Detector with (threshold = 10 and nonmax_suppression)
-	FastFeatureDetector fastd(10, true);
-	FeatureDetector* fd = &fastd;
-	std::vector<KeyPoint> keypoints;
+RTLIB_ExitCode_t OCVDemo::postProcess() {
+	TRACE_SCOPE("process", cam.effect_idx);
+	RTLIB_ExitCode_t result = RTLIB_OK;
+	double teffect;
 
-	// Get a gray image from the current frame
-	cvtColor(cam.frame, cam.effects, CV_BGR2GRAY);
+	if (cam.effect_idx == EFF_NONE) {
+		cam.annotations.clear();
+		return RTLIB_OK;
+	}
 
-	// Keypoints detaction
-	fd->detect(cam.effects, keypoints);
+	// Analytics in background never hold back the frame
+	if (AnalyticsAsync())
+		return postProcessAsync();
 
-	// Ensure image is 3 channel RGB, as required for proper
-	// composition with overlay info.
-	// This allows also to draw colored cycrles for each keypoint
-	cvtColor(cam.effects, cam.effects, CV_GRAY2RGB);
+	// Decimated frames just re-apply the annotations of the last processed
+	// one, on top of an updated gray-level background (but edges)
+	if (cam.decimation_phase) {
+		if (cam.effect_idx != EFF_CANNY)
+			kernels.BgrToGray(cam.frame, cam.effects);
+		cam.decimation_phase = (cam.decimation_phase + 1) % cam.decimation;
+		return RTLIB_OK;
+	}
+	cam.decimation_phase = (cam.decimation > 1) ? 1 : 0;
+	++cam.analytics_count;
+	++cam.analytics_total;
+
+	// Drop annotations of the previous frame
+	cam.annotations.clear();
+
+	teffect = bbque_tmr.getElapsedTimeMs();
+	if (Streamed()) {
+		// Workers could be still used by analytics in background
+		async.Wait();
+		result = doStream();
+	} else if (cam.effect_idx == EFF_CANNY) {
+		async.Wait();
+		doCanny();
+	} else {
+		// Get a gray image from the current frame
+		kernels.BgrToGray(cam.frame, cam.effects);
+		result = doAnalytics(cam.effect_idx, cam.effects, cam.annotations);
+	}
+	teffect = bbque_tmr.getElapsedTimeMs() - teffect;
+	effect_cost_ms = effect_cost_ms ?
+		(0.9 * effect_cost_ms + 0.1 * teffect) : teffect;
 
-	//draw green circles where the keypoints are located
-	vector<KeyPoint>::const_iterator it = keypoints.begin();
-	for ( ; it != keypoints.end(); ++it) {
-		circle(cam.effects, it->pt, 4, Scalar(0,0,255,0));
+	if (result == RTLIB_OK) {
+		LatencyAccount(src.GrabMs());
+		ResultsWrite(cam.frames_total);
 	}
 
-	return RTLIB_OK;
+	return result;
 }
 
-RTLIB_ExitCode_t OCVDemo::doSurf() {
-	// SURF Detector with (hessianThreshold = 400., octaves = 3, octaveLayers = 4)
-	SurfFeatureDetector surfd(400.0, 3, 4);
-	FeatureDetector* fd = &surfd;
-	std::vector<KeyPoint> keypoints;
+RTLIB_ExitCode_t OCVDemo::doStream() {
+	// The native frame, unless it has not been scaled down at all
+	Mat const &native = src.Native();
+	double tstream = bbque_tmr.getElapsedTimeMs();
+
+	if (cam.effect_idx == EFF_CANNY) {
+		stream.Canny(native, cam.effects, pool, kernels);
+	} else {
+		kernels.BgrToGray(cam.frame, cam.effects);
+		stream.Detect(native, cam.frame.size(), fx.FastDetector(), pool,
+				kernels, cam.annotations.keypoints);
+	}
+
+	tstream = bbque_tmr.getElapsedTimeMs() - tstream;
+	stream_ms.add(tstream);
+	stream_pixels += native.total();
+	stream_scratch_peak = std::max(stream_scratch_peak,
+			stream.ScratchBytes());
+	if (cam.effect_idx == EFF_FAST)
+		fx.Tune(EFF_FAST, cam.annotations.keypoints.size(), tstream);
 
-	// Get a gray image from the current frame
-	cvtColor(cam.frame, cam.effects, CV_BGR2GRAY);
+	return RTLIB_OK;
+}
 
-	// Keypoints detaction
-	fd->detect(cam.effects, keypoints);
+RTLIB_ExitCode_t OCVDemo::postProcessAsync() {
 
-	// Ensure image is 3 channel RGB, as required for proper
-	// composition with overlay info.
-	// This allows also to draw colored cycrles for each keypoint
-	cvtColor(cam.effects, cam.effects, CV_GRAY2RGB);
+	// The gray image is both the input of the analytics, and the
+	// background of their results
+	kernels.BgrToGray(cam.frame, cam.effects);
+	async.Submit(cam.effect_idx, cam.effects, cam.frames_total,
+			src.GrabMs());
 
-	//draw green circles where the keypoints are located
-	vector<KeyPoint>::const_iterator it = keypoints.begin();
-	for ( ; it != keypoints.end(); ++it) {
-		circle(cam.effects, it->pt, 4, Scalar(0,0,255,0));
+	// Overlay the most recent result, until a newer one is completed
+	if (!async.Fetch(async_result))
+		return RTLIB_OK;
+	std::swap(cam.annotations, async_result.annotations);
+
+	// Results of another effect, or of a frame at another resolution
+	// (completed while switching), do not apply to this frame
+	if (async_result.effect != cam.effect_idx ||
+			async_result.size != cam.frame.size()) {
+		cam.annotations.clear();
+		return RTLIB_OK;
 	}
 
+	++cam.analytics_count;
+	++cam.analytics_total;
+	async_latency_ms.add(async_result.done_ms - async_result.submit_ms);
+	LatencyAccount(async_result.grab_ms);
+	ResultsWrite(async_result.frame);
+
 	return RTLIB_OK;
 }
 
-RTLIB_ExitCode_t OCVDemo::postProcess() {
+bool OCVDemo::FrameStale() const {
 
-	if (cam.effect_idx == EFF_NONE)
-		return RTLIB_OK;
+	// Calibration measures the cost of each and every frame
+	if (!latency_budget_ms || calib)
+		return false;
+	return AsyncEffect::NowMs() - src.GrabMs() > latency_budget_ms;
+}
 
-	switch (cam.effect_idx) {
-	case EFF_CANNY:
-		doCanny();
-		break;
-	case EFF_FAST:
-		doFast();
-		break;
-	case EFF_SURF:
-		doSurf();
-		break;
-	default:
+void OCVDemo::LatencyAccount(double grab_ms) {
+	double latency = AsyncEffect::NowMs() - grab_ms;
+
+	latency_ms.add(latency);
+	if (latency_budget_ms && latency > latency_budget_ms)
+		++latency_late;
+}
+
+void OCVDemo::ResultsWrite(uint32_t frame) {
+
+	if (!results.IsOpen())
+		return;
+	TRACE_SCOPE("results", frame);
+
+	if (cam.effect_idx != EFF_CANNY) {
+		results.WriteKeypoints(frame, cam.effect_idx, cam.frame.size(),
+				cam.annotations.keypoints);
+		return;
+	}
+	if (results.GetConfig().edges)
+		results.WriteEdges(frame, cam.effect_idx, cam.effects);
+}
+
+RTLIB_ExitCode_t OCVDemo::doAnalytics(uint8_t effect, Mat const &gray,
+		Annotations &result) {
+
+	if (!fx.Detect(effect, gray, cam.regions, result)) {
 		fprintf(stderr, FW("Unknowen effect required\n"));
 		return RTLIB_ERROR;
 	}
 
+	// Keypoints are accounted by their vectors capacity
+	memory.SetExternal(MEM_FEATURES, fx.KeypointsBytes() +
+			result.keypoints.capacity() * sizeof(KeyPoint));
+
 	return RTLIB_OK;
 }
 
@@ -519,11 +849,16 @@ double OCVDemo::updateFps() {
 	if (tnow >= update_ms) {
 		elapsed_ms = tnow - tstart;
 		cam.fps_cur = cam.frames_count * 1000.0 / elapsed_ms;
-		DB(fprintf(stderr, FD("Processing @ FPS = %.2f\n"), cam.fps_cur));
+		cam.analytics_fps = cam.analytics_count * 1000.0 / elapsed_ms;
+		TRACE_COUNTER("fps", cam.fps_cur);
+		DB(fprintf(stderr, FD("Processing @ FPS = %.2f, "
+					"analytics @ FPS = %.2f\n"),
+				cam.fps_cur, cam.analytics_fps));
 		// Setup references for next update
 		tstart = bbque_tmr.getElapsedTimeMs();
 		update_ms = tstart + 250.0;
 		cam.frames_count = 0;
+		cam.analytics_count = 0;
 	}
 
 	return cam.fps_cur;
@@ -536,6 +871,7 @@ void OCVDemo::forceFps() {
 	float cycle_time;
 	float expec_time;
 	double tnow; // [s] at the call time
+	TRACE_SCOPE("pace");
 
 	if (unlikely(tstart == 0)) {
 		// The first frame is used to setup the start time
@@ -567,21 +903,83 @@ void OCVDemo::forceFps() {
 }
 
 RTLIB_ExitCode_t OCVDemo::onRun() {
+	double tframe = bbque_tmr.getElapsedTimeMs();
+	TRACE_SCOPE("frame", cam.frames_total);
+	bool switching = false;
 	RTLIB_ExitCode_t result;
 
+	// Resolution switches are applied only at frame boundaries
+	if (cam.res_next != cam.res_id) {
+		switching = (cam.res_id < RES_COUNT);
+		ApplyResolution();
+	}
+	PerfMark();
+
 	// Acquired a new images
 	result = getImage();
+	if (result == RTLIB_EXC_WORKLOAD_NONE && calib && src.Rewind()) {
+		// Calibration loops over the input video, as long as required
+		result = getImage();
+	}
+
+	// A frame captured too long ago (e.g. waiting in a ring, or delivered
+	// late) is not worth processing anymore: skip to the newest one
+	for (uint8_t i = 0; result == RTLIB_OK && i < LATENCY_SKIPS_MAX &&
+			FrameStale(); ++i) {
+		TRACE_INSTANT("skip", cam.frames_total);
+		++latency_skipped;
+		result = getImage();
+	}
 	if (result != RTLIB_OK)
 		return result;
+	PerfStage(STAGE_GRAB);
 
 	// Apply required effects
 	postProcess();
+	PerfStage(STAGE_PROCESS);
+
+	// The startup is completed by the first processed frame
+	if (unlikely(!first_frame_ms)) {
+		double now = bbque_tmr.getElapsedTimeMs();
+		startup_ms[PHASE_FRAME] = now - tphase;
+		first_frame_ms = now - tcreate;
+		StartupReport(stderr);
+	}
 
 	// Update FPS accounting
 	updateFps();
 
 	// Show the current image
 	showImage();
+	PerfStage(STAGE_DISPLAY);
+
+	// Account the frame time, which should not be affected by switches
+	tframe = bbque_tmr.getElapsedTimeMs() - tframe;
+	if (!switching) {
+		frame_ms.add(tframe);
+		frame_cost_ms = frame_cost_ms ?
+			(0.9 * frame_cost_ms + 0.1 * tframe) : tframe;
+	} else {
+		frame_cost_ms = 0;
+		effect_cost_ms = 0;
+		switch_ms.add(tframe);
+		if (frame_ms.count() &&
+				tframe > RESOLUTION_SWITCH_BOUND * frame_ms.avg()) {
+			++switch_stalls;
+			fprintf(stderr, FW("Resolution switch to %s stalled: "
+					"%.3f [ms] (avg %.3f [ms])\n"),
+					resolutionStr[cam.res_id], tframe,
+					frame_ms.avg());
+		}
+		DB(if (cam.frame.data != cam.buffers[cam.res_id].frame.data)
+			fprintf(stderr, FD("Frame buffer reallocated\n")));
+	}
+
+	// Calibration measures the maximum achievable framerate
+	if (calib) {
+		CalibrationStep();
+		return RTLIB_OK;
+	}
 
 	// Pad cycle time to force the maximum required framerate
 	forceFps();
@@ -589,6 +987,101 @@ RTLIB_ExitCode_t OCVDemo::onRun() {
 	return RTLIB_OK;
 }
 
+void OCVDemo::StartupReport(FILE *out) const {
+
+	fprintf(out, FI("Time to first frame: %.3f [ms]\n"), first_frame_ms);
+	for (uint8_t phase = 0; phase < PHASE_COUNT; ++phase) {
+		fprintf(out, FI("  %-12s: %9.3f [ms]%s\n"), phaseStr[phase],
+				startup_ms[phase],
+				(phase == PHASE_SOURCE) ? " (overlapped)" : "");
+	}
+}
+
+void OCVDemo::CalibrationApply() {
+	Calibration::Config const & cfg = calib->Current();
+
+	cam.effect_idx = cfg.effect;
+	SetResolution(cfg.res);
+	pool.Resize(cfg.threads);
+	setNumThreads(cfg.threads);
+}
+
+void OCVDemo::CalibrationStep() {
+
+	if (!calib->Frame(CAM_WIDTH(cam) * CAM_HEIGHT(cam)))
+		return;
+
+	// Move to the next configuration, or generate the recipe
+	if (!calib->Done()) {
+		CalibrationApply();
+		return;
+	}
+	calib->WriteRecipe(effectStr);
+}
+
+void OCVDemo::PerfMark() {
+	std::vector<pid_t> tids;
+
+	if (!perf_enabled)
+		return;
+
+	// Monitor all the threads of the process: this (EXC) one, the pool
+	// workers, the OpenCV ones, and the source and analytics threads.
+	// Counters are reopened whenever the set changes, e.g. the workers
+	// are respawned by each resize, even back to the same size.
+	if (!PerfCounters::ProcessThreads(tids) ||
+			!perf.Available() || tids != perf_tids) {
+		if (tids.empty() || !perf.Open(tids)) {
+			fprintf(stderr, FW("Perf counters not available, "
+						"disabled\n"));
+			perf_enabled = false;
+			return;
+		}
+		perf_threads = tids.size();
+		perf_tids = tids;
+	}
+
+	perf.Read(perf_mark);
+}
+
+void OCVDemo::PerfStage(uint8_t stage) {
+	PerfCounters::Sample sample;
+
+	if (!perf_enabled || !perf.Read(sample))
+		return;
+
+	perf_stages[stage][cam.effect_idx][cam.res_id].Add(perf_mark, sample,
+			cam.frame.total());
+	perf_mark = sample;
+}
+
+void OCVDemo::PerfReport() const {
+	char name[32];
+
+	if (!perf.Available())
+		return;
+
+	fprintf(stderr, FI("Perf counters (per stage, effect and resolution, "
+				"on %d threads):\n"), perf_threads);
+	for (uint8_t stage = 0; stage < STAGE_COUNT; ++stage) {
+		for (uint8_t eff = 0; eff < EFF_COUNT; ++eff) {
+			for (uint8_t res = 0; res < RES_COUNT; ++res) {
+				snprintf(name, sizeof(name), "%s %s %s",
+						stageStr[stage], effectStr[eff],
+						resolutionStr[res]);
+				perf_stages[stage][eff][res].Print(stderr, perf, name);
+			}
+		}
+	}
+}
+
+uint8_t OCVDemo::NextAWM(uint8_t awm) const {
+	std::vector<uint8_t>::const_iterator it;
+
+	it = std::upper_bound(awms.begin(), awms.end(), awm);
+	return (it != awms.end()) ? *it : awm;
+}
+
 RTLIB_ExitCode_t OCVDemo::FrameratePolicy() {
 	static bool napped = false;
 	static uint16_t tcheck = 1000;
@@ -611,10 +1104,16 @@ RTLIB_ExitCode_t OCVDemo::FrameratePolicy() {
 	fprintf(stderr, FI("AWM [%d], FPS deviation: %5.1f[%%]\r"),
 				CurrentAWM(), (cam.fps_dev - 1)* 100);
 
-	// Set MED resolution on AWM2
-	if (CurrentAWM() >= 1 &&
-		cam.fps_dev >= 3) {
+	// Scale up from the start AWM, if the (measured) cost of a frame fits
+	// the framerate even at the higher resolution. Processing just the
+	// regions of interest keeps the cost low at higher resolutions.
+	// Resolution is worth more than the analytics rate, thus this is
+	// done first, and only then effects are decimated less.
+	if (CurrentAWM() >= awm_start &&
+		ResolutionFits(cam.res_next + 1)) {
 		ResolutionUp();
+	} else if (DecimationFits(cam.decimation - 1)) {
+		DecimationDown();
 	}
 
 	// Check if the current FPS is at least 80% of the required FPS
@@ -640,23 +1139,26 @@ RTLIB_ExitCode_t OCVDemo::FrameratePolicy() {
 
 	// Effect enabled: ask for more resources (if not already done)
 	if (napped) {
-		// NAP request timedout: reducing resolution
-		scaling = ResolutionDown();
+		// NAP request timedout: decimating effects, then reducing
+		// resolution
+		scaling = DecimationUp() || ResolutionDown();
 		if (scaling)
-			fprintf(stderr, FI("\nNAP timeout: downscaling\n"));
+			fprintf(stderr, FI("\nNAP timeout: degrading\n"));
 		napped = false;
 		return RTLIB_OK;
 	}
 
 	// Avoid NAPs if we are already at the maximum AWM
-	if (CurrentAWM() == 2) {
+	if (CurrentAWM() >= awms.back()) {
 		fprintf(stderr, "\n");
+		if (!DecimationUp())
+			ResolutionDown();
 		return RTLIB_OK;
 	}
 
-	// Raise AWM upper-bound
-	if (cnstr.awm < 2) {
-		cnstr.awm = 2;
+	// Raise AWM upper-bound, to the next AWM of the recipe
+	if (cnstr.awm < awms.back()) {
+		cnstr.awm = NextAWM(cnstr.awm);
 		SetConstraints(&cnstr, sizeof(cnstr)/sizeof(RTLIB_Constraint_t));
 		fprintf(stderr, FI("\nRaise AWM upper bound: %d\n"), cnstr.awm);
 	}
@@ -664,6 +1166,7 @@ RTLIB_ExitCode_t OCVDemo::FrameratePolicy() {
 	// NAP not asserted: asserting a new one
 	nap = (static_cast<uint8_t>((1 - cam.fps_dev) * 100) % 100);
 	fprintf(stderr, FI("\nNAP assert [%d]\n"), nap);
+	TRACE_INSTANT("nap", nap);
 	SetGoalGap(nap);
 	napped = true;
 
@@ -671,7 +1174,12 @@ RTLIB_ExitCode_t OCVDemo::FrameratePolicy() {
 }
 
 RTLIB_ExitCode_t OCVDemo::onMonitor() {
-	uint8_t key = (cvWaitKey(1) & 255);
+	uint8_t effect = cam.effect_idx;
+	uint8_t key = 0;
+
+	// Keyboard events are available only with a window
+	if (!headless)
+		key = (cvWaitKey(1) & 255);
 
 	// Exit if we decoded the required amount of frames
 	if (cam.frames_max &&
@@ -682,9 +1190,21 @@ RTLIB_ExitCode_t OCVDemo::onMonitor() {
 	if (evtExit)
 		return RTLIB_EXC_WORKLOAD_NONE;
 
-	if (evtSnapshot)
+	if (evtSnapshot.exchange(false))
 		Snapshot();
 
+	// Commands are applied all together, before the next frame
+	if (ControlApply() == RTLIB_EXC_WORKLOAD_NONE)
+		return RTLIB_EXC_WORKLOAD_NONE;
+
+	// Frames are not being processed: recorded events are consistent
+	if (Trace::FlushRequested())
+		Trace::Flush(trace_path);
+
+	// Neither manual nor policy driven changes while calibrating
+	if (calib)
+		return calib->Done() ? RTLIB_EXC_WORKLOAD_NONE : RTLIB_OK;
+
 	switch (key) {
 	case 27:
 		return RTLIB_EXC_WORKLOAD_NONE;
@@ -706,44 +1226,331 @@ RTLIB_ExitCode_t OCVDemo::onMonitor() {
 		fprintf(stderr, FI("Enable [SURF] effect\n"));
 		cam.effect_idx = EFF_SURF;
 		break;
+	case 'b':
+		fprintf(stderr, FI("Enable [ORB] effect\n"));
+		cam.effect_idx = EFF_ORB;
+		break;
+	case 'o':
+		if (!fx.Available(EFF_OREC)) {
+			fprintf(stderr, FW("No reference database loaded\n"));
+			break;
+		}
+		fprintf(stderr, FI("Enable [ObjRec] effect\n"));
+		cam.effect_idx = EFF_OREC;
+		break;
+	case 't':
+		Trace::Enable(!Trace::Enabled());
+		fprintf(stderr, FI("Tracing %s\n"),
+				Trace::Enabled() ? "enabled" : "disabled");
+		// Dump the events recorded up to now
+		if (!Trace::Enabled())
+			Trace::Flush(trace_path);
+		break;
 	case 'q':
 		fprintf(stderr, FI("Disable effects\n"));
 		cam.effect_idx = EFF_NONE;
 
-		if (cnstr.awm < 2)
+		if (cnstr.awm <= awm_start)
 			break;
 
 		// Release the AWM upper-bound
-		cnstr.awm = 1;
+		cnstr.awm = awm_start;
 		SetConstraints(&cnstr, sizeof(cnstr)/sizeof(RTLIB_Constraint_t));
 		fprintf(stderr, FI("Lower AWM upper bound: %d\n"), cnstr.awm);
 
 		break;
 	}
 
+	// The first frame of a new effect is always processed: the last
+	// results are of the previous one
+	if (cam.effect_idx != effect)
+		cam.decimation_phase = 0;
+
 	FrameratePolicy();
+	MemoryPolicy();
 	return RTLIB_OK;
 }
 
+RTLIB_ExitCode_t OCVDemo::ControlApply() {
+	RTLIB_ExitCode_t result = RTLIB_OK;
+	ControlCommand cmd;
+	uint8_t type;
+	int fps;
+
+	while (control.Pop(cmd)) {
+		fprintf(stderr, FI("Control: %s %s\n"),
+				ControlCommand::typeStr[cmd.type], cmd.arg);
+
+		switch (cmd.type) {
+		case ControlCommand::CMD_EXIT:
+			result = RTLIB_EXC_WORKLOAD_NONE;
+			continue;
+		case ControlCommand::CMD_SNAPSHOT:
+			Snapshot();
+			continue;
+		}
+
+		// Neither manual nor policy driven changes while calibrating
+		if (calib) {
+			fprintf(stderr, FW("Control: calibrating, ignored\n"));
+			continue;
+		}
+
+		switch (cmd.type) {
+		case ControlCommand::CMD_EFFECT:
+			for (type = 0; type < EFF_COUNT; ++type)
+				if (strcasecmp(cmd.arg, effectStr[type]) == 0)
+					break;
+			if (!fx.Available(type)) {
+				fprintf(stderr, FW("Control: effect [%s] "
+							"not available\n"), cmd.arg);
+				break;
+			}
+			cam.effect_idx = type;
+			cam.decimation_phase = 0;
+			break;
+		case ControlCommand::CMD_RESOLUTION:
+			if (strcasecmp(cmd.arg, "up") == 0) {
+				ResolutionUp();
+				break;
+			}
+			if (strcasecmp(cmd.arg, "down") == 0) {
+				ResolutionDown();
+				break;
+			}
+			for (type = 0; type < RES_COUNT; ++type)
+				if (strcasecmp(cmd.arg, resolutionStr[type]) == 0)
+					break;
+			// Buffers released to fit the memory budget must fit again
+			if (type == RES_COUNT || (cam.buffers[type].frame.empty() &&
+						!memory.Fits(ResolutionBytes(type)))) {
+				fprintf(stderr, FW("Control: resolution [%s] "
+							"not available\n"), cmd.arg);
+				break;
+			}
+			SetResolution(type);
+			break;
+		case ControlCommand::CMD_FPS:
+			fps = atoi(cmd.arg);
+			if (fps < 1 || fps > 255) {
+				fprintf(stderr, FW("Control: fps [%s] out of "
+							"range\n"), cmd.arg);
+				break;
+			}
+			cam.fps_max = fps;
+			break;
+		}
+	}
+
+	return result;
+}
+
+void OCVDemo::MemoryBudgetSetup() {
+	uint64_t untracked = 0;
+	uint64_t resident;
+	size_t limit;
+
+	if (!grant.mem_limit) {
+		memory.SetLimit(0);
+		return;
+	}
+
+	// The budget of accounted memory is what remains of the granted one
+	// once the (resident) memory not accounted is subtracted
+	resident = ReadResidentMemory();
+	if (resident > memory.Used())
+		untracked = resident - memory.Used();
+	limit = grant.mem_limit * (1 - MEMORY_BUDGET_HEADROOM);
+	limit = (limit > untracked) ? (limit - untracked) : 0;
+
+	memory.SetLimit(limit ? limit : 1);
+	memory_exhausted = false;
+	fprintf(stderr, FI("Memory budget: %lu KB (%lu KB not accounted), "
+				"used %lu KB\n"),
+			static_cast<unsigned long>(limit >> 10),
+			static_cast<unsigned long>(untracked >> 10),
+			static_cast<unsigned long>(memory.Used() >> 10));
+}
+
+RTLIB_ExitCode_t OCVDemo::MemoryPolicy() {
+
+	if (!memory.Exceeded())
+		return RTLIB_OK;
+
+	// Drop the buffers of resolutions above the current one
+	for (uint8_t type = RES_HIG; type > cam.res_next; --type) {
+		TrimResolution(type);
+		if (!memory.Exceeded())
+			return RTLIB_OK;
+	}
+
+	// Scale down, thus the current buffers are dropped at next check
+	if (ResolutionDown()) {
+		fprintf(stderr, FW("Memory budget exceeded: %lu/%lu KB\n"),
+				static_cast<unsigned long>(memory.Used() >> 10),
+				static_cast<unsigned long>(memory.Limit() >> 10));
+		return RTLIB_OK;
+	}
+
+	if (!memory_exhausted) {
+		fprintf(stderr, FE("ERROR: memory budget exceeded at the "
+					"lowest resolution: %lu/%lu KB\n"),
+				static_cast<unsigned long>(memory.Used() >> 10),
+				static_cast<unsigned long>(memory.Limit() >> 10));
+		memory_exhausted = true;
+	}
+
+	return RTLIB_ERROR;
+}
+
+RTLIB_ExitCode_t OCVDemo::onRelease() {
+
+	async.Stop();
+	control.Close();
+
+	fprintf(stderr, FI("===== OCVDemo [%s] statistics =====\n"),
+			exc_name.c_str());
+	fprintf(stderr, FI("Processed frames: %d (analytics on %d)\n"),
+			cam.frames_total, cam.analytics_total);
+	src.Print(stderr);
+	src.Close();
+	if (results.GetConfig().Enabled()) {
+		fprintf(stderr, FI("Results: %lu records, %lu KB, %lu dropped\n"),
+				static_cast<unsigned long>(results.Records()),
+				static_cast<unsigned long>(results.Bytes() >> 10),
+				static_cast<unsigned long>(results.Dropped()));
+		results.Close();
+	}
+	if (preview.Enabled()) {
+		fprintf(stderr, FI("Preview frames published: %lu\n"),
+				static_cast<unsigned long>(preview.Frames()));
+		preview.Close();
+	}
+	if (first_frame_ms)
+		StartupReport(stderr);
+	configure_ms.print(stderr, "Reconfiguration", "ms");
+	frame_ms.print(stderr, "Frame", "ms");
+	if (switch_ms.count()) {
+		switch_ms.print(stderr, "Resolution switch frame", "ms");
+		fprintf(stderr, FI("Resolution switches stalled: %u of %lu "
+					"(above %.2fx the average frame)\n"),
+				switch_stalls, switch_ms.count(),
+				RESOLUTION_SWITCH_BOUND);
+	}
+	if (stream_ms.count()) {
+		size_t native = cam.max_res.width * cam.max_res.height * 3;
+		fprintf(stderr, FI("Streamed %dx%d frames: %.1f [Mpixel/s], "
+					"scratch peak %lu KB (%.1f%% of a frame)\n"),
+				cam.max_res.width, cam.max_res.height,
+				stream_pixels / (stream_ms.avg() * stream_ms.count() * 1e3),
+				static_cast<unsigned long>(stream_scratch_peak >> 10),
+				100.0 * stream_scratch_peak / native);
+		stream_ms.print(stderr, "Streamed effect", "ms");
+	}
+	if (async_mode) {
+		fprintf(stderr, FI("Analytics in background: %u completed, "
+					"%u frames dropped\n"),
+				async.Completed(), async.Dropped());
+		async_latency_ms.print(stderr, "Analytics latency", "ms");
+	}
+	if (latency_ms.count()) {
+		fprintf(stderr, FI("Latency budget: %.1f [ms] (0: none), "
+					"%u frames skipped, %u results late\n"),
+				latency_budget_ms, latency_skipped + src.Skipped(),
+				latency_late);
+		latency_ms.print(stderr, "Glass-to-result latency", "ms");
+	}
+	memory.Print(stderr);
+	PerfReport();
+	fx.Print(stderr);
+
+	// Events are flushed already when tracing is disabled
+	if (Trace::Enabled())
+		Trace::Flush(trace_path);
+
+	return RTLIB_OK;
+}
+
+bool OCVDemo::ResolutionFits(uint8_t type) const {
+	double scale;
+
+	if (type >= RES_COUNT || !frame_cost_ms || cam.res_next != cam.res_id)
+		return false;
+
+	// Frame costs scale with the number of pixels
+	scale = static_cast<double>(ResolutionSize(type).area()) /
+		cam.frame.size().area();
+	return (frame_cost_ms * scale * RESOLUTION_UP_MARGIN) <=
+		(1e3 / cam.fps_max);
+}
+
+bool OCVDemo::DecimationFits(uint8_t decimation) const {
+	double cost;
+
+	if (decimation < 1 || decimation >= cam.decimation || !effect_cost_ms)
+		return false;
+
+	// The effect cost is shared by the frames of a decimation period
+	cost = frame_cost_ms - (effect_cost_ms / cam.decimation) +
+		(effect_cost_ms / decimation);
+	return (cost * RESOLUTION_UP_MARGIN) <= (1e3 / cam.fps_max);
+}
+
+bool OCVDemo::DecimationUp() {
+
+	// Analytics in background do not slow down the frames anyway
+	if (cam.effect_idx == EFF_NONE || cam.decimation >= DECIMATION_MAX ||
+			AnalyticsAsync())
+		return false;
+
+	++cam.decimation;
+	cam.decimation_phase = 0;
+	TRACE_COUNTER("decimation", cam.decimation);
+	fprintf(stderr, FI("Effects decimation: 1 of %d frames\n"),
+			cam.decimation);
+	return true;
+}
+
+bool OCVDemo::DecimationDown() {
+
+	if (cam.decimation <= 1)
+		return false;
+
+	--cam.decimation;
+	cam.decimation_phase = 0;
+	TRACE_COUNTER("decimation", cam.decimation);
+	fprintf(stderr, FI("Effects decimation: 1 of %d frames\n"),
+			cam.decimation);
+	return true;
+}
+
 bool OCVDemo::ResolutionUp() {
+	uint8_t type = cam.res_next + 1;
 
-	if (cam.res_id == RES_HIG)
+	if (cam.res_next == RES_HIG)
 		return false;
 
+	// Buffers released to fit the memory budget must fit again
+	if (cam.buffers[type].frame.empty()) {
+		if (!memory.Fits(ResolutionBytes(type)))
+			return false;
+		PrewarmResolution(type);
+	}
+
 	fprintf(stderr, FI("Resolution Scale UP\n"));
-	++cam.res_id;
-	SetResolution(cam.res_id);
+	TRACE_INSTANT("resolution up", type);
+	SetResolution(type);
 	return true;
 }
 
 bool OCVDemo::ResolutionDown() {
 
-	if (cam.res_id == RES_LOW)
+	if (cam.res_next == RES_LOW)
 		return false;
 
 	fprintf(stderr, FI("Resolution Scale DOWN\n"));
-	--cam.res_id;
-	SetResolution(cam.res_id);
+	TRACE_INSTANT("resolution down", cam.res_next - 1);
+	SetResolution(cam.res_next - 1);
 	return true;
 }
 
@@ -759,7 +1566,11 @@ void OCVDemo::Snapshot() const {
 
 	sprintf(filename, "/tmp/ocvdemo_frame_%s.png", timestamp);
 	imwrite(filename, cam.frame);
+
+	// No display image is composed in headless mode
+	if (headless)
+		return;
+
 	sprintf(filename, "/tmp/ocvdemo_display_%s.png", timestamp);
-	imwrite(filename, display);
-	evtSnapshot = false;
+	imwrite(filename, composer.Display());
 }
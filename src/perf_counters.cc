@@ -0,0 +1,235 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.prf"
+
+char const *PerfCounters::counterStr[PERF_COUNT] = {
+	"cycles",
+	"instructions",
+	"LLC misses",
+	"branch misses",
+};
+
+// The generic cache misses event usually counts last level cache misses
+static uint64_t const counterConfig[PerfCounters::PERF_COUNT] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int OpenCounter(pid_t tid, uint64_t config, int group_fd) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP |
+		PERF_FORMAT_TOTAL_TIME_ENABLED |
+		PERF_FORMAT_TOTAL_TIME_RUNNING;
+	// User-space only, which is allowed by the default paranoid level
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, tid, -1, group_fd, 0);
+}
+
+PerfCounters::PerfCounters() :
+	reported(false) {
+	for (uint8_t c = 0; c < PERF_COUNT; ++c)
+		supported[c] = false;
+}
+
+PerfCounters::~PerfCounters() {
+	Close();
+}
+
+void PerfCounters::Close() {
+	for (uint32_t g = 0; g < groups.size(); ++g) {
+		for (uint8_t c = 0; c < PERF_COUNT; ++c) {
+			if (groups[g].fds[c] >= 0)
+				close(groups[g].fds[c]);
+		}
+	}
+	groups.clear();
+}
+
+bool PerfCounters::ProcessThreads(std::vector<pid_t> &tids) {
+	struct dirent *entry;
+	DIR *dir;
+
+	tids.clear();
+	dir = opendir("/proc/self/task");
+	if (!dir)
+		return false;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		tids.push_back(atoi(entry->d_name));
+	}
+	closedir(dir);
+
+	std::sort(tids.begin(), tids.end());
+	return !tids.empty();
+}
+
+bool PerfCounters::Open(std::vector<pid_t> const &tids) {
+	bool first = true;
+	Group group;
+
+	Close();
+	for (uint8_t c = 0; c < PERF_COUNT; ++c)
+		supported[c] = false;
+
+	for (uint32_t t = 0; t < tids.size(); ++t) {
+		bool failed = false;
+
+		for (uint8_t c = 0; c < PERF_COUNT; ++c)
+			group.fds[c] = -1;
+
+		// The cycles counter leads the group
+		for (uint8_t c = 0; c < PERF_COUNT && !failed; ++c) {
+			if (!first && !supported[c])
+				continue;
+			group.fds[c] = OpenCounter(tids[t], counterConfig[c],
+					c ? group.fds[PERF_CYCLES] : -1);
+			if (group.fds[c] >= 0) {
+				supported[c] |= first;
+				continue;
+			}
+			// The thread exited since it was listed
+			if (c == PERF_CYCLES && errno == ESRCH)
+				break;
+			if (first && c != PERF_CYCLES) {
+				if (!reported)
+					fprintf(stderr, FW("Perf counter [%s] not "
+							"available: %s\n"), counterStr[c],
+							strerror(errno));
+				continue;
+			}
+			failed = true;
+		}
+
+		if (group.fds[PERF_CYCLES] < 0 && !failed)
+			continue;
+		if (!failed) {
+			groups.push_back(group);
+			first = false;
+			continue;
+		}
+
+		// Do not account a partial set of threads
+		for (uint8_t c = 0; c < PERF_COUNT; ++c) {
+			if (group.fds[c] >= 0)
+				close(group.fds[c]);
+		}
+		if (!reported)
+			fprintf(stderr, FW("Perf counters not available on thread "
+					"[%d]: %s\n"), tids[t], strerror(errno));
+		reported = true;
+		Close();
+		return false;
+	}
+
+	reported = true;
+	return Available();
+}
+
+bool PerfCounters::Read(Sample &sample) const {
+	// Layout of a group read: nr, time_enabled, time_running, values[nr]
+	uint64_t data[3 + PERF_COUNT];
+
+	for (uint8_t c = 0; c < PERF_COUNT; ++c)
+		sample.values[c] = 0;
+
+	for (uint32_t g = 0; g < groups.size(); ++g) {
+		uint8_t v = 0;
+		double scale = 1;
+
+		if (read(groups[g].fds[PERF_CYCLES], data, sizeof(data)) <= 0)
+			return false;
+
+		// Multiplexed counters are extrapolated on the enabled time
+		if (data[2] && data[2] < data[1])
+			scale = static_cast<double>(data[1]) / data[2];
+
+		for (uint8_t c = 0; c < PERF_COUNT; ++c) {
+			if (!supported[c])
+				continue;
+			sample.values[c] += data[3 + v++] * scale;
+		}
+	}
+
+	return true;
+}
+
+void PerfAccount::Add(PerfCounters::Sample const &from,
+		PerfCounters::Sample const &to, uint64_t frame_pixels) {
+	for (uint8_t c = 0; c < PerfCounters::PERF_COUNT; ++c) {
+		// Scaled counts might not be monotonic
+		if (to.values[c] > from.values[c])
+			totals[c] += to.values[c] - from.values[c];
+	}
+	pixels += frame_pixels;
+	++frames;
+}
+
+void PerfAccount::Print(FILE *out, PerfCounters const &perf,
+		char const *name) const {
+	char ipc[] = "    n/a";
+	char llc[] = "    n/a";
+	char brm[] = "    n/a";
+
+	if (!frames)
+		return;
+
+	if (perf.Supported(PerfCounters::PERF_INSTRUCTIONS) &&
+			totals[PerfCounters::PERF_CYCLES])
+		snprintf(ipc, sizeof(ipc), "%7.2f",
+				static_cast<double>(
+					totals[PerfCounters::PERF_INSTRUCTIONS]) /
+				totals[PerfCounters::PERF_CYCLES]);
+	if (perf.Supported(PerfCounters::PERF_LLC_MISSES))
+		snprintf(llc, sizeof(llc), "%7.4f",
+				static_cast<double>(
+					totals[PerfCounters::PERF_LLC_MISSES]) / pixels);
+	if (perf.Supported(PerfCounters::PERF_BRANCH_MISSES))
+		snprintf(brm, sizeof(brm), "%7.4f",
+				static_cast<double>(
+					totals[PerfCounters::PERF_BRANCH_MISSES]) / pixels);
+
+	fprintf(out, "%-24s: frames %7lu, Mcycles/frame %9.3f, IPC %s, "
+			"LLC misses/px %s, branch misses/px %s\n",
+			name, static_cast<unsigned long>(frames),
+			totals[PerfCounters::PERF_CYCLES] / (1e6 * frames),
+			ipc, llc, brm);
+}
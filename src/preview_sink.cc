@@ -0,0 +1,80 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "preview_sink.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.pvw"
+
+// Double-buffered: viewers read one slot while the other one is written
+#define PREVIEW_SLOTS 2
+
+using namespace cv;
+
+PreviewSink::Config::Config() :
+	width(320),
+	fps(5) {
+}
+
+PreviewSink::PreviewSink(Config const &cfg) :
+	cfg(cfg),
+	next_ms(0) {
+}
+
+bool PreviewSink::Open(Size native) {
+	Size size;
+
+	if (!Enabled() || !native.width)
+		return false;
+
+	// Never scaled up, and with even sizes, as most video encoders want
+	size.width = std::min<int>(cfg.width, native.width) & ~1;
+	size.height = (size.width * native.height / native.width) & ~1;
+	if (!ring.Create(cfg.name, size, CV_8UC3, PREVIEW_SLOTS))
+		return false;
+
+	fprintf(stderr, FI("Preview [%s]: %dx%d @ %.1f [fps]\n"),
+			cfg.name.c_str(), size.width, size.height, cfg.fps);
+	return true;
+}
+
+void PreviewSink::Close() {
+	ring.Close();
+}
+
+bool PreviewSink::Due(double now_ms) {
+	ShmRing::Consumer viewers[SHM_RING_CONSUMERS];
+
+	if (!ring.IsOpen() || now_ms < next_ms)
+		return false;
+	return ring.Consumers(viewers) > 0;
+}
+
+void PreviewSink::Publish(Mat const &display, double now_ms) {
+	Mat slot = ring.Writable();
+
+	// Nearest neighbour scaling reads just the pixels written
+	if (display.size() == slot.size())
+		display.copyTo(slot);
+	else
+		resize(display, slot, slot.size(), 0, 0, INTER_NEAREST);
+	ring.Publish();
+
+	next_ms = now_ms + (cfg.fps > 0 ? 1000.0 / cfg.fps : 0);
+}
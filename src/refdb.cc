@@ -0,0 +1,323 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "refdb.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.rdb"
+
+// Ratio test threshold (on squared L2 distances) for a good match
+#define REFDB_MATCH_RATIO2 (0.75 * 0.75)
+// Ratio test threshold (on Hamming distances) for a good match
+#define REFDB_MATCH_RATIOH 0.8
+// Minimum number of good matches to recognize an object
+#define REFDB_MATCH_VOTES  8
+
+using namespace cv;
+
+const char *RefDB::descriptorStr[] = {
+	"SURF",
+	"ORB"
+};
+
+Ptr<Feature2D> RefDB::NewFeatures(uint8_t type) {
+	switch (type) {
+	case DESC_SURF:
+		// Same detector params of the SURF effect, with
+		// 64 (i.e. not extended) descriptor elements
+		return new SURF(400.0, 3, 4, false);
+	case DESC_ORB:
+		// Same detector params of the ORB effect
+		return new ORB(500);
+	}
+	return Ptr<Feature2D>();
+}
+
+static size_t PageAlign(size_t offset) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (offset + page - 1) & ~(page - 1);
+}
+
+bool RefDB::Build(std::string const &path, uint8_t type,
+		std::vector<Object> const &objects, Mat const &desc) {
+	std::vector<uint32_t> labels(desc.rows);
+	std::vector<char> padding;
+	flann::Index index;
+	Timer tmr(true);
+	Header hdr;
+	FILE *fd;
+
+	if (type >= DESC_COUNT || objects.empty() || desc.empty() ||
+			!desc.isContinuous())
+		return false;
+
+	// Label each descriptor with the index of its object
+	for (uint32_t i = 0; i < objects.size(); ++i) {
+		for (uint32_t j = 0; j < objects[i].desc_count; ++j)
+			labels[objects[i].desc_first + j] = i;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	strncpy(hdr.magic, REFDB_MAGIC, sizeof(hdr.magic));
+	hdr.version = REFDB_VERSION;
+	hdr.desc_type = type;
+	hdr.desc_cols = desc.cols;
+	hdr.desc_elem_size = desc.elemSize();
+	hdr.obj_count = objects.size();
+	hdr.desc_count = desc.rows;
+	hdr.obj_offset = sizeof(Header);
+	hdr.labels_offset = hdr.obj_offset + objects.size() * sizeof(Object);
+	hdr.desc_offset = PageAlign(hdr.labels_offset +
+			labels.size() * sizeof(uint32_t));
+	padding.resize(hdr.desc_offset -
+			(hdr.labels_offset + labels.size() * sizeof(uint32_t)));
+
+	fd = fopen(path.c_str(), "w");
+	if (!fd) {
+		fprintf(stderr, FE("ERROR: opening [%s] FAILED!\n"), path.c_str());
+		return false;
+	}
+	fwrite(&hdr, sizeof(hdr), 1, fd);
+	fwrite(&objects[0], sizeof(Object), objects.size(), fd);
+	fwrite(&labels[0], sizeof(uint32_t), labels.size(), fd);
+	if (!padding.empty())
+		fwrite(&padding[0], 1, padding.size(), fd);
+	fwrite(desc.data, desc.elemSize(), desc.total(), fd);
+	if (ferror(fd)) {
+		fprintf(stderr, FE("ERROR: writing [%s] FAILED!\n"), path.c_str());
+		fclose(fd);
+		return false;
+	}
+	fclose(fd);
+	fprintf(stderr, FI("Database [%s]: %d objects, %d descriptors, "
+				"written in %.3f[ms]\n"), path.c_str(),
+			hdr.obj_count, hdr.desc_count, tmr.getElapsedTimeMs());
+
+	// Build the (kd-tree or LSH) index
+	tmr.start();
+	if (type == DESC_ORB)
+		index.build(desc, flann::LshIndexParams(12, 20, 2),
+				flann::FLANN_DIST_HAMMING);
+	else
+		index.build(desc, flann::KDTreeIndexParams(4));
+	fprintf(stderr, FI("Index [%s]: built in %.3f[ms]\n"),
+			descriptorStr[type], tmr.getElapsedTimeMs());
+	index.save(path + REFDB_INDEX_SUFFIX);
+
+	return true;
+}
+
+RefDB::RefDB() :
+	base(MAP_FAILED),
+	length(0),
+	hdr(NULL),
+	objects(NULL),
+	labels(NULL),
+	load_ms(0) {
+}
+
+RefDB::~RefDB() {
+	Unload();
+}
+
+/**
+ * @brief Check that count items, of the specified size and alignment,
+ * starting at the specified offset, are all within the first length bytes
+ */
+static bool InBounds(uint64_t offset, uint64_t count, uint64_t size,
+		uint64_t align, size_t length) {
+	if (offset > length || offset % align)
+		return false;
+	return count <= (length - offset) / size;
+}
+
+bool RefDB::Validate() const {
+	uint64_t desc_elems;
+	uint32_t elem_size;
+
+	if (length < sizeof(Header) ||
+			strncmp(hdr->magic, REFDB_MAGIC, sizeof(hdr->magic)) ||
+			hdr->version != REFDB_VERSION ||
+			hdr->desc_type >= DESC_COUNT)
+		return false;
+
+	// Descriptors are bytes (ORB) or floats (SURF)
+	elem_size = (hdr->desc_type == DESC_ORB) ?
+		sizeof(uint8_t) : sizeof(float);
+	if (hdr->desc_elem_size != elem_size || !hdr->desc_cols)
+		return false;
+
+	// Each table is (aligned and) within the mapping
+	desc_elems = static_cast<uint64_t>(hdr->desc_count) * hdr->desc_cols;
+	if (hdr->obj_offset < sizeof(Header) ||
+			!InBounds(hdr->obj_offset, hdr->obj_count,
+				sizeof(Object), sizeof(uint32_t), length) ||
+			!InBounds(hdr->labels_offset, hdr->desc_count,
+				sizeof(uint32_t), sizeof(uint32_t), length) ||
+			!InBounds(hdr->desc_offset, desc_elems,
+				elem_size, elem_size, length))
+		return false;
+
+	// Each object has a (terminated) name, and its descriptors
+	for (uint32_t i = 0; i < hdr->obj_count; ++i) {
+		if (!memchr(objects[i].name, 0, sizeof(objects[i].name)) ||
+				objects[i].desc_first > hdr->desc_count ||
+				objects[i].desc_count >
+					hdr->desc_count - objects[i].desc_first)
+			return false;
+	}
+
+	return true;
+}
+
+bool RefDB::Load(std::string const &path) {
+	Timer tmr(true);
+	struct stat st;
+	int fd;
+
+	Unload();
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, FE("ERROR: opening [%s] FAILED!\n"), path.c_str());
+		if (fd >= 0)
+			::close(fd);
+		return false;
+	}
+
+	// The mapping keeps a reference to the file, which can be closed
+	length = st.st_size;
+	base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, FE("ERROR: mapping [%s] FAILED!\n"), path.c_str());
+		return false;
+	}
+
+	// Check the database layout (but labels), once for all the queries
+	hdr = static_cast<Header const *>(base);
+	if (length >= sizeof(Header)) {
+		objects = reinterpret_cast<Object const *>(
+				static_cast<uint8_t const *>(base) +
+				hdr->obj_offset);
+		labels = reinterpret_cast<uint32_t const *>(
+				static_cast<uint8_t const *>(base) +
+				hdr->labels_offset);
+	}
+	if (!Validate()) {
+		fprintf(stderr, FE("ERROR: [%s] is not a valid database\n"),
+				path.c_str());
+		Unload();
+		return false;
+	}
+
+	// Descriptors are used in place, the index never writes them
+	desc = Mat(hdr->desc_count, hdr->desc_cols,
+			(hdr->desc_type == DESC_ORB) ? CV_8U : CV_32F,
+			static_cast<uint8_t *>(base) + hdr->desc_offset);
+	madvise(static_cast<uint8_t *>(base) + hdr->desc_offset,
+			length - hdr->desc_offset, MADV_RANDOM);
+
+	if (!index.load(desc, path + REFDB_INDEX_SUFFIX)) {
+		fprintf(stderr, FE("ERROR: loading index [%s%s] FAILED!\n"),
+				path.c_str(), REFDB_INDEX_SUFFIX);
+		Unload();
+		return false;
+	}
+
+	// Setup query scratch buffers
+	votes.resize(hdr->obj_count);
+	boxes.resize(hdr->obj_count);
+
+	load_ms = tmr.getElapsedTimeMs();
+	fprintf(stderr, FI("Database [%s]: %d objects, %d %s descriptors, "
+				"loaded in %.3f[ms]\n"), path.c_str(),
+			hdr->obj_count, hdr->desc_count,
+			descriptorStr[hdr->desc_type], load_ms);
+
+	return true;
+}
+
+void RefDB::Unload() {
+	index.release();
+	desc.release();
+	if (base != MAP_FAILED)
+		munmap(base, length);
+	base = MAP_FAILED;
+	length = 0;
+	hdr = NULL;
+	objects = NULL;
+	labels = NULL;
+}
+
+uint32_t RefDB::Query(Mat const &query,
+		std::vector<KeyPoint> const &kps,
+		Annotations &ann) {
+	uint32_t recognized = 0;
+
+	if (!Loaded() || query.rows < 2)
+		return 0;
+
+	index.knnSearch(query, indices, dists, 2, flann::SearchParams(32));
+
+	// Vote for the objects of the (unambiguous) best matches
+	std::fill(votes.begin(), votes.end(), 0);
+	for (int i = 0; i < indices.rows; ++i) {
+		int const *idx = indices.ptr<int>(i);
+		Rect kpr;
+		uint32_t obj;
+
+		if (idx[0] < 0 || idx[0] >= desc.rows)
+			continue;
+		// Hamming distances are integers, L2 ones are squared floats
+		if (dists.type() == CV_32S) {
+			int const *dst = dists.ptr<int>(i);
+			if (dst[0] >= REFDB_MATCH_RATIOH * dst[1])
+				continue;
+		} else {
+			float const *dst = dists.ptr<float>(i);
+			if (dst[0] >= REFDB_MATCH_RATIO2 * dst[1])
+				continue;
+		}
+
+		// Labels are checked lazily, only the matched ones are touched
+		obj = labels[idx[0]];
+		if (unlikely(obj >= hdr->obj_count))
+			continue;
+		kpr = Rect(kps[i].pt.x, kps[i].pt.y, 1, 1);
+		boxes[obj] = votes[obj] ? (boxes[obj] | kpr) : kpr;
+		++votes[obj];
+	}
+
+	for (uint32_t obj = 0; obj < hdr->obj_count; ++obj) {
+		if (votes[obj] < REFDB_MATCH_VOTES)
+			continue;
+		ann.boxes.push_back(boxes[obj]);
+		ann.labels.push_back(objects[obj].name);
+		++recognized;
+	}
+
+	return recognized;
+}
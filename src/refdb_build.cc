@@ -0,0 +1,179 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <strings.h>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "refdb.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.rdb"
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each tool parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Reference Database Options");
+
+/**
+ * The map of all tool parameters values
+ */
+po::variables_map opts_vm;
+
+/**
+ * @brief The list of reference objects
+ *
+ * Each (not empty and not commented) line defines an object as:
+ * <id> <name> <image path>
+ */
+std::string list_path;
+
+/**
+ * @brief The database to build
+ */
+std::string db_path;
+
+/**
+ * @brief The name of the descriptors to use
+ */
+std::string desc_name;
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help") || list_path.empty() || db_path.empty()) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<RefDB::Object> objects;
+	Ptr<Feature2D> features;
+	std::vector<KeyPoint> kps;
+	std::string line;
+	uint8_t type;
+	Mat all_desc;
+	Mat desc;
+	Timer tmr;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("list,l", po::value<std::string>(&list_path),
+			"the list of reference objects (<id> <name> <image>)")
+		("output,o", po::value<std::string>(&db_path),
+			"the reference database to build")
+		("desc,d", po::value<std::string>(&desc_name)->
+			default_value("SURF"),
+			"the descriptors to use (SURF, ORB)")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	for (type = 0; type < RefDB::DESC_COUNT; ++type) {
+		if (!strcasecmp(desc_name.c_str(), RefDB::descriptorStr[type]))
+			break;
+	}
+	if (type == RefDB::DESC_COUNT) {
+		fprintf(stderr, FE("ERROR: unknown descriptors [%s]\n"),
+				desc_name.c_str());
+		return EXIT_FAILURE;
+	}
+	features = RefDB::NewFeatures(type);
+
+	std::ifstream list(list_path.c_str());
+	if (!list) {
+		fprintf(stderr, FE("ERROR: opening [%s] FAILED!\n"),
+				list_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	// Extract the descriptors of each reference object
+	tmr.start();
+	while (std::getline(list, line)) {
+		std::istringstream fields(line);
+		std::string name, image_path;
+		RefDB::Object obj;
+		Mat image;
+
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		memset(&obj, 0, sizeof(obj));
+		if (!(fields >> obj.id >> name >> image_path)) {
+			fprintf(stderr, FW("Malformed line [%s], skipped\n"),
+					line.c_str());
+			continue;
+		}
+		strncpy(obj.name, name.c_str(), sizeof(obj.name) - 1);
+
+		image = imread(image_path, 0);
+		if (image.empty()) {
+			fprintf(stderr, FW("Loading [%s] FAILED, skipped\n"),
+					image_path.c_str());
+			continue;
+		}
+
+		(*features)(image, Mat(), kps, desc);
+		if (desc.rows == 0) {
+			fprintf(stderr, FW("No features in [%s], skipped\n"),
+					image_path.c_str());
+			continue;
+		}
+
+		obj.desc_first = all_desc.rows;
+		obj.desc_count = desc.rows;
+		all_desc.push_back(desc);
+		objects.push_back(obj);
+
+		fprintf(stderr, FI("Object [%5d:%s]: %5d descriptors\n"),
+				obj.id, obj.name, obj.desc_count);
+	}
+	fprintf(stderr, FI("Extracted %lu objects in %.3f[ms]\n"),
+			objects.size(), tmr.getElapsedTimeMs());
+
+	if (!RefDB::Build(db_path, type, objects, all_desc))
+		return EXIT_FAILURE;
+
+	// Check the database just built, which also reports the load time
+	RefDB db;
+	if (!db.Load(db_path))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "regions.h"
+
+// The grid used to estimate the regions coverage
+#define COVERAGE_GRID 64
+
+cv::Rect RegionOfInterest::Rect(cv::Size const &frame) const {
+	int x0 = std::max<int>(round(x * frame.width), 0);
+	int y0 = std::max<int>(round(y * frame.height), 0);
+	int x1 = std::min<int>(round((x + width) * frame.width), frame.width);
+	int y1 = std::min<int>(round((y + height) * frame.height), frame.height);
+
+	if (x1 <= x0 || y1 <= y0)
+		return cv::Rect();
+	return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+bool ParseRegion(std::string const &spec, RegionOfInterest &roi) {
+	char name[64] = "";
+	int fields;
+
+	fields = sscanf(spec.c_str(), "%f,%f,%f,%f,%63s",
+			&roi.x, &roi.y, &roi.width, &roi.height, name);
+	if (fields < 4)
+		return false;
+	roi.name = name;
+
+	// Regions must overlap the frame
+	if (roi.width <= 0 || roi.height <= 0)
+		return false;
+	if (roi.x >= 1 || roi.y >= 1 ||
+			roi.x + roi.width <= 0 || roi.y + roi.height <= 0)
+		return false;
+
+	return true;
+}
+
+bool LoadRegions(std::string const &path,
+		std::vector<RegionOfInterest> &rois) {
+	std::ifstream in(path.c_str());
+	RegionOfInterest roi;
+	std::string line;
+
+	if (!in)
+		return false;
+
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (!ParseRegion(line, roi))
+			return false;
+		rois.push_back(roi);
+	}
+
+	return true;
+}
+
+void MergeRegions(std::vector<cv::Rect> const &regions,
+		std::vector<cv::Rect> &merged) {
+	bool changed = true;
+
+	merged.clear();
+	for (size_t i = 0; i < regions.size(); ++i) {
+		if (regions[i].area())
+			merged.push_back(regions[i]);
+	}
+
+	// A grown region could overlap others, checked already
+	while (changed) {
+		changed = false;
+		for (size_t i = 0; i < merged.size(); ++i) {
+			for (size_t j = i + 1; j < merged.size(); ) {
+				if (!(merged[i] & merged[j]).area()) {
+					++j;
+					continue;
+				}
+				merged[i] |= merged[j];
+				merged.erase(merged.begin() + j);
+				changed = true;
+			}
+		}
+	}
+}
+
+float RegionsCoverage(std::vector<RegionOfInterest> const &rois) {
+	cv::Size grid(COVERAGE_GRID, COVERAGE_GRID);
+	bool covered[COVERAGE_GRID][COVERAGE_GRID] = {};
+	uint32_t count = 0;
+
+	if (rois.empty())
+		return 1.0;
+
+	// Overlapping regions are counted once
+	for (size_t i = 0; i < rois.size(); ++i) {
+		cv::Rect r = rois[i].Rect(grid);
+		for (int y = r.y; y < r.y + r.height; ++y)
+			for (int x = r.x; x < r.x + r.width; ++x)
+				covered[y][x] = true;
+	}
+	for (int y = 0; y < COVERAGE_GRID; ++y)
+		for (int x = 0; x < COVERAGE_GRID; ++x)
+			count += covered[y][x];
+
+	return static_cast<float>(count) / (COVERAGE_GRID * COVERAGE_GRID);
+}
@@ -0,0 +1,179 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <time.h>
+
+#include "resources.h"
+
+/**
+ * @brief Get the path of our cgroup for the specified controller
+ *
+ * This looks up the mount point of the controller (or of the v2 unified
+ * hierarchy, for an empty controller name) and appends our own cgroup path.
+ *
+ * @return an empty string if the controller is not available
+ */
+static std::string CGroupPath(std::string const &controller) {
+	std::ifstream mounts("/proc/self/mounts");
+	std::ifstream cgroup("/proc/self/cgroup");
+	std::string mount_point;
+	std::string line;
+
+	// Lookup the hierarchy mount point
+	while (std::getline(mounts, line)) {
+		std::istringstream fields(line);
+		std::string dev, dir, type, opts;
+
+		fields >> dev >> dir >> type >> opts;
+		if (controller.empty() && type == "cgroup2") {
+			mount_point = dir;
+			break;
+		}
+		if (controller.empty() || type != "cgroup")
+			continue;
+		if (("," + opts + ",").find("," + controller + ",") !=
+				std::string::npos) {
+			mount_point = dir;
+			break;
+		}
+	}
+	if (mount_point.empty())
+		return std::string();
+
+	// Lookup our own cgroup: "<id>:<controllers>:<path>"
+	while (std::getline(cgroup, line)) {
+		size_t c1 = line.find(':');
+		size_t c2 = line.find(':', c1 + 1);
+		std::string ctrls;
+
+		if (c1 == std::string::npos || c2 == std::string::npos)
+			continue;
+		ctrls = "," + line.substr(c1 + 1, c2 - c1 - 1) + ",";
+		if ((controller.empty() && ctrls == ",,") ||
+			(!controller.empty() &&
+			 ctrls.find("," + controller + ",") != std::string::npos))
+			return mount_point + line.substr(c2 + 1);
+	}
+
+	return std::string();
+}
+
+static bool ReadValue(std::string const &path, std::string &value) {
+	std::ifstream attr(path.c_str());
+	return (attr && std::getline(attr, value));
+}
+
+static void ReadCpuQuota(ResourceGrant &grant) {
+	std::string path, value;
+	long long quota, period;
+
+	// cgroup v1: cpu.cfs_quota_us is -1 if unlimited
+	path = CGroupPath("cpu");
+	if (!path.empty() &&
+			ReadValue(path + "/cpu.cfs_quota_us", value) &&
+			sscanf(value.c_str(), "%lld", &quota) == 1 &&
+			ReadValue(path + "/cpu.cfs_period_us", value) &&
+			sscanf(value.c_str(), "%lld", &period) == 1) {
+		if (quota > 0 && period > 0)
+			grant.cpu_quota = (quota * 100) / period;
+		return;
+	}
+
+	// cgroup v2: cpu.max is "<quota|max> <period>"
+	path = CGroupPath("");
+	if (!path.empty() &&
+			ReadValue(path + "/cpu.max", value) &&
+			sscanf(value.c_str(), "%lld %lld", &quota, &period) == 2 &&
+			period > 0)
+		grant.cpu_quota = (quota * 100) / period;
+}
+
+static void ReadMemLimit(ResourceGrant &grant) {
+	unsigned long long limit;
+	std::string path, value;
+
+	// cgroup v1: an huge value is reported if unlimited
+	path = CGroupPath("memory");
+	if (!path.empty() &&
+			ReadValue(path + "/memory.limit_in_bytes", value) &&
+			sscanf(value.c_str(), "%llu", &limit) == 1) {
+		if (limit < (1ULL << 62))
+			grant.mem_limit = limit;
+		return;
+	}
+
+	// cgroup v2: memory.max is "max" if unlimited
+	path = CGroupPath("");
+	if (!path.empty() &&
+			ReadValue(path + "/memory.max", value) &&
+			sscanf(value.c_str(), "%llu", &limit) == 1)
+		grant.mem_limit = limit;
+}
+
+void ReadResourceGrant(ResourceGrant &grant) {
+	memset(&grant, 0, sizeof(grant));
+
+	// The cpuset is reflected by our affinity mask
+	if (sched_getaffinity(0, sizeof(grant.cpus), &grant.cpus) == 0)
+		grant.cpus_count = CPU_COUNT(&grant.cpus);
+
+	ReadCpuQuota(grant);
+	ReadMemLimit(grant);
+}
+
+/**
+ * @brief Read a memory metric, in bytes, from our /proc status
+ */
+static uint64_t ReadStatusMemory(const char *format) {
+	std::ifstream status("/proc/self/status");
+	unsigned long long kb;
+	std::string line;
+
+	while (std::getline(status, line)) {
+		if (sscanf(line.c_str(), format, &kb) == 1)
+			return kb << 10;
+	}
+
+	return 0;
+}
+
+uint64_t ReadPeakMemory() {
+	return ReadStatusMemory("VmHWM: %llu kB");
+}
+
+uint64_t ReadResidentMemory() {
+	return ReadStatusMemory("VmRSS: %llu kB");
+}
+
+bool ResetPeakMemory() {
+	std::ofstream clear_refs("/proc/self/clear_refs");
+
+	// Writing "5" resets the peak RSS (Linux 4.0+)
+	clear_refs << "5" << std::endl;
+	return clear_refs.good();
+}
+
+double ReadCpuTimeMs() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (ts.tv_sec * 1e3) + (ts.tv_nsec / 1e6);
+}
@@ -0,0 +1,327 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "results_sink.h"
+#include "shm_ring.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.res"
+
+// The alignment of records
+#define RESULTS_ALIGN 8
+
+static_assert(sizeof(ResultsHeader) == 40, "ResultsHeader layout");
+static_assert(sizeof(ResultsRecord) == 32, "ResultsRecord layout");
+static_assert(sizeof(ResultsKeypoint) == 20, "ResultsKeypoint layout");
+static_assert(sizeof(ResultsRun) == 8, "ResultsRun layout");
+
+using namespace cv;
+
+static uint64_t WallClockNs() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void InitHeader(ResultsHeader &hdr, uint32_t header_bytes,
+		uint64_t capacity) {
+	memset(&hdr, 0, sizeof(hdr));
+	strncpy(hdr.magic, RESULTS_MAGIC, sizeof(hdr.magic));
+	hdr.version = RESULTS_VERSION;
+	hdr.header_bytes = header_bytes;
+	hdr.capacity = capacity;
+}
+
+ResultsSink::Config::Config() :
+	edges(false) {
+}
+
+ResultsSink::ResultsSink(Config const &cfg) :
+	cfg(cfg),
+	fd(-1),
+	chunk_used(0),
+	record_pad(0),
+	hdr(NULL),
+	length(0),
+	ring(NULL),
+	cursor(0),
+	records(0),
+	bytes(0),
+	dropped(0) {
+}
+
+ResultsSink::~ResultsSink() {
+	Close();
+}
+
+bool ResultsSink::Open() {
+	ResultsHeader header;
+
+	if (cfg.path.compare(0, strlen(SHM_RING_PREFIX), SHM_RING_PREFIX) == 0)
+		return OpenShm(cfg.path.substr(strlen(SHM_RING_PREFIX)));
+
+	// Opening a named pipe waits for its reader
+	fprintf(stderr, FI("Opening results [%s]...\n"), cfg.path.c_str());
+	fd = open(cfg.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, FE("Opening results [%s] FAILED (%s)\n"),
+				cfg.path.c_str(), strerror(errno));
+		return false;
+	}
+
+	// A reader closing the pipe must not terminate the whole process
+	signal(SIGPIPE, SIG_IGN);
+
+	InitHeader(header, sizeof(header), 0);
+	Put(&header, sizeof(header));
+	Flush();
+	return IsOpen();
+}
+
+bool ResultsSink::OpenShm(std::string const &name) {
+	std::string object = "/ocvdemo." + name;
+	size_t page = sysconf(_SC_PAGESIZE);
+	int shm_fd;
+
+	// The ring starts on its own page
+	length = page + RESULTS_SHM_BYTES;
+	shm_fd = shm_open(object.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if (shm_fd < 0 || ftruncate(shm_fd, length) != 0) {
+		fprintf(stderr, FE("Creating results [%s] FAILED (%s)\n"),
+				object.c_str(), strerror(errno));
+		if (shm_fd >= 0)
+			close(shm_fd);
+		return false;
+	}
+	hdr = static_cast<ResultsHeader *>(mmap(NULL, length,
+				PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0));
+	close(shm_fd);
+	if (hdr == MAP_FAILED) {
+		hdr = NULL;
+		shm_unlink(object.c_str());
+		return false;
+	}
+
+	InitHeader(*hdr, page, RESULTS_SHM_BYTES);
+	ring = reinterpret_cast<uint8_t *>(hdr) + page;
+	cursor = 0;
+
+	fprintf(stderr, FI("Results on [%s]: %lu KB ring\n"), object.c_str(),
+			static_cast<unsigned long>(RESULTS_SHM_BYTES >> 10));
+	return true;
+}
+
+void ResultsSink::Close() {
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	if (hdr) {
+		munmap(hdr, length);
+		shm_unlink(("/ocvdemo." +
+				cfg.path.substr(strlen(SHM_RING_PREFIX))).c_str());
+		hdr = NULL;
+		ring = NULL;
+	}
+}
+
+bool ResultsSink::Begin(ResultsRecord &rec, size_t item_bytes) {
+	uint64_t payload = sizeof(rec) + rec.count * item_bytes;
+	uint64_t total = (payload + RESULTS_ALIGN - 1) & ~(RESULTS_ALIGN - 1);
+	uint64_t tail;
+	uint64_t skip;
+
+	if (!IsOpen() || total > UINT32_MAX ||
+			(hdr && total > hdr->capacity)) {
+		++dropped;
+		return false;
+	}
+
+	rec.magic = RESULTS_RECORD_MAGIC;
+	rec.bytes = total;
+	rec.reserved = 0;
+	rec.timestamp_ns = WallClockNs();
+	record_pad = total - payload;
+
+	// Records never wrap around the end of the ring
+	tail = hdr ? hdr->capacity - (cursor % hdr->capacity) : total;
+	skip = (tail < total) ? tail : 0;
+
+	// Readers must know the bytes being overwritten, before any of them
+	if (hdr) {
+		__atomic_store_n(&hdr->reserved, cursor + skip + total,
+				__ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+
+	if (skip) {
+		if (tail >= sizeof(ResultsRecord)) {
+			ResultsRecord pad;
+			memset(&pad, 0, sizeof(pad));
+			pad.magic = RESULTS_RECORD_MAGIC;
+			pad.bytes = tail;
+			pad.kind = ResultsRecord::RESULTS_PAD;
+			memcpy(ring + (cursor % hdr->capacity), &pad, sizeof(pad));
+		}
+		cursor += tail;
+		__atomic_store_n(&hdr->written, cursor, __ATOMIC_RELEASE);
+	}
+
+	Put(&rec, sizeof(rec));
+	return true;
+}
+
+void ResultsSink::Put(void const *data, size_t size) {
+	uint8_t const *src = static_cast<uint8_t const *>(data);
+	size_t count;
+
+	if (hdr) {
+		memcpy(ring + (cursor % hdr->capacity), data, size);
+		cursor += size;
+		return;
+	}
+
+	while (size) {
+		count = std::min(size, sizeof(chunk) - chunk_used);
+		memcpy(chunk + chunk_used, src, count);
+		chunk_used += count;
+		src += count;
+		size -= count;
+		if (chunk_used == sizeof(chunk))
+			Flush();
+	}
+}
+
+void ResultsSink::End(ResultsRecord const &rec) {
+	static const uint8_t zeros[RESULTS_ALIGN] = { 0 };
+
+	Put(zeros, record_pad);
+	++records;
+	bytes += rec.bytes;
+
+	// Records are visible to readers only once complete
+	if (hdr) {
+		__atomic_store_n(&hdr->written, cursor, __ATOMIC_RELEASE);
+		return;
+	}
+	Flush();
+}
+
+void ResultsSink::Flush() {
+	uint8_t const *src = chunk;
+	ssize_t count;
+
+	while (fd >= 0 && chunk_used) {
+		count = write(fd, src, chunk_used);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0) {
+			fprintf(stderr, FE("Writing results [%s] FAILED (%s), "
+						"results disabled\n"),
+					cfg.path.c_str(), strerror(errno));
+			close(fd);
+			fd = -1;
+			break;
+		}
+		src += count;
+		chunk_used -= count;
+	}
+	chunk_used = 0;
+}
+
+void ResultsSink::WriteKeypoints(uint32_t frame, uint8_t effect, Size size,
+		std::vector<KeyPoint> const &kps) {
+	ResultsRecord rec;
+	ResultsKeypoint kp;
+
+	rec.frame = frame;
+	rec.effect = effect;
+	rec.kind = ResultsRecord::RESULTS_KEYPOINTS;
+	rec.width = size.width;
+	rec.height = size.height;
+	rec.count = kps.size();
+	if (!Begin(rec, sizeof(kp)))
+		return;
+
+	for (size_t i = 0; i < kps.size(); ++i) {
+		kp.x = kps[i].pt.x;
+		kp.y = kps[i].pt.y;
+		kp.size = kps[i].size;
+		kp.response = kps[i].response;
+		kp.octave = kps[i].octave;
+		Put(&kp, sizeof(kp));
+	}
+
+	End(rec);
+}
+
+void ResultsSink::WriteEdges(uint32_t frame, uint8_t effect,
+		Mat const &edges) {
+	ResultsRecord rec;
+	ResultsRun run;
+	int c;
+
+	rec.frame = frame;
+	rec.effect = effect;
+	rec.kind = ResultsRecord::RESULTS_EDGES;
+	rec.width = edges.cols;
+	rec.height = edges.rows;
+	rec.count = 0;
+
+	// Count the runs first, since the record size comes first
+	for (int r = 0; r < edges.rows; ++r) {
+		uchar const *p = edges.ptr<uchar>(r);
+		for (c = 0; c < edges.cols; ++c)
+			if (p[c] && (c == 0 || !p[c - 1]))
+				++rec.count;
+	}
+	if (!Begin(rec, sizeof(run)))
+		return;
+
+	run.reserved = 0;
+	for (int r = 0; r < edges.rows; ++r) {
+		uchar const *p = edges.ptr<uchar>(r);
+		for (c = 0; c < edges.cols; ) {
+			if (!p[c]) {
+				++c;
+				continue;
+			}
+			run.row = r;
+			run.col = c;
+			while (c < edges.cols && p[c])
+				++c;
+			run.length = c - run.col;
+			Put(&run, sizeof(run));
+		}
+	}
+
+	End(rec);
+}
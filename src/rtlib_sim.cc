@@ -0,0 +1,435 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sched.h>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+#include <bbque/utils/timer.h>
+#include <bbque/utils/utility.h>
+
+#include "rtlib_sim.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.sim"
+
+// The window used to measure the cycle rate before a switch [ms]
+#define SIM_RATE_WINDOW_MS 1000
+// The default reaction time to a goal-gap assertion [ms]
+#define SIM_GAP_DELAY_MS 100
+// The AWM id used to represent a blocked EXC
+#define SIM_AWM_BLOCKED -1
+
+using namespace bbque::utils;
+
+namespace {
+
+struct Step {
+	double time;
+	int16_t awm;
+};
+
+struct Switch {
+	/** When the switch has been required (by schedule or goal-gap) */
+	double due;
+	/** When the switch has been notified to the EXC */
+	double delivered;
+	/** When the first cycle after the switch has been completed */
+	double completed;
+	int16_t from;
+	int16_t to;
+	bool promotion;
+};
+
+struct Simulator {
+	std::mutex mtx;
+	Timer tmr;
+	bool enabled;
+
+	std::string name;
+	std::vector<Step> timeline;
+	size_t next_step;
+	std::map<int16_t, uint32_t> awm_cpus;
+	cpu_set_t cpus;
+
+	/** The scheduled AWM, and the one actually assigned */
+	int16_t scheduled;
+	int16_t assigned;
+	int16_t awm_max;
+
+	/** AWM bounds asserted by the EXC */
+	int16_t lower;
+	int16_t upper;
+
+	/** Goal-gap handling */
+	double gap_delay;
+	double gap_due;
+	uint8_t gap;
+
+	/** Switches, and the (completion) time of each cycle */
+	std::vector<Switch> switches;
+	std::vector<double> cycles;
+	bool reconfiguring;
+};
+
+Simulator sim;
+
+int16_t Clamp(int16_t awm) {
+	if (awm == SIM_AWM_BLOCKED)
+		return awm;
+	return std::max(sim.lower, std::min(sim.upper, awm));
+}
+
+void Restrict(int16_t awm) {
+	std::map<int16_t, uint32_t>::const_iterator it = sim.awm_cpus.find(awm);
+	uint32_t count;
+	cpu_set_t cpus;
+
+	// AWMs without CPUs get all the original ones back, rather than the
+	// ones of the previous AWM
+	if (it == sim.awm_cpus.end()) {
+		sched_setaffinity(0, sizeof(sim.cpus), &sim.cpus);
+		return;
+	}
+
+	// Keep the first CPUs of the original set, the EXC will read back
+	// its affinity as if it had been placed in a cpuset
+	CPU_ZERO(&cpus);
+	count = it->second;
+	for (int c = 0; c < CPU_SETSIZE && count; ++c) {
+		if (!CPU_ISSET(c, &sim.cpus))
+			continue;
+		CPU_SET(c, &cpus);
+		--count;
+	}
+	sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+void Require(double tnow, int16_t awm, bool promotion) {
+	Switch sw;
+
+	awm = Clamp(awm);
+	if (awm == sim.assigned)
+		return;
+
+	// A pending (not yet delivered) switch is just retargeted
+	if (!sim.switches.empty() && !sim.switches.back().delivered) {
+		sim.switches.back().to = awm;
+		return;
+	}
+
+	sw.due = tnow;
+	sw.delivered = 0;
+	sw.completed = 0;
+	sw.from = sim.assigned;
+	sw.to = awm;
+	sw.promotion = promotion;
+	sim.switches.push_back(sw);
+}
+
+RTLIB_ExecutionContextHandler_t Register(const char *name,
+		const RTLIB_ExecutionContextParams_t *params) {
+	(void)params;
+	sim.name = name;
+	fprintf(stderr, FI("EXC [%s] registered (stand-in RTLib)\n"), name);
+	return reinterpret_cast<RTLIB_ExecutionContextHandler_t>(&sim);
+}
+
+RTLIB_ExitCode_t Enable(RTLIB_ExecutionContextHandler_t ech) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	(void)ech;
+
+	sim.tmr.start();
+	sim.enabled = true;
+	sched_getaffinity(0, sizeof(sim.cpus), &sim.cpus);
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t GetWorkingMode(RTLIB_ExecutionContextHandler_t ech,
+		RTLIB_WorkingModeParams_t *wm, RTLIB_SyncType_t st) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	double tnow = sim.tmr.getElapsedTimeMs();
+	bool start = (sim.assigned == SIM_AWM_BLOCKED && sim.cycles.empty());
+	(void)ech;
+	(void)st;
+
+	// Each poll marks the end of the previous cycle
+	if (sim.reconfiguring) {
+		sim.switches.back().completed = tnow;
+		sim.reconfiguring = false;
+	}
+	if (!start)
+		sim.cycles.push_back(tnow);
+
+	// Replay the timeline
+	while (sim.next_step < sim.timeline.size() &&
+			sim.timeline[sim.next_step].time <= tnow) {
+		sim.scheduled = sim.timeline[sim.next_step].awm;
+		Require(sim.timeline[sim.next_step].time, sim.scheduled, false);
+		++sim.next_step;
+	}
+
+	// Goal-gap reaction: promote to the next AWM
+	if (sim.gap_due && sim.gap_due <= tnow) {
+		if (sim.assigned != SIM_AWM_BLOCKED && sim.assigned < sim.awm_max) {
+			fprintf(stderr, FI("Goal-gap [%d]: promoting to AWM [%d]\n"),
+					sim.gap, sim.assigned + 1);
+			Require(sim.gap_due, sim.assigned + 1, true);
+		}
+		sim.gap_due = 0;
+	}
+
+	if (sim.switches.empty() || sim.switches.back().delivered) {
+		if (sim.assigned == SIM_AWM_BLOCKED)
+			return RTLIB_EXC_GWM_BLOCKED;
+		wm->awm_id = sim.assigned;
+		return RTLIB_OK;
+	}
+
+	// Deliver the pending switch
+	Switch &sw = sim.switches.back();
+	sw.delivered = tnow;
+	sim.assigned = sw.to;
+	if (sim.assigned == SIM_AWM_BLOCKED) {
+		sw.completed = tnow;
+		return RTLIB_EXC_GWM_BLOCKED;
+	}
+	sim.reconfiguring = true;
+	Restrict(sim.assigned);
+	wm->awm_id = sim.assigned;
+
+	return (sw.from == SIM_AWM_BLOCKED) ?
+		RTLIB_EXC_GWM_START : RTLIB_EXC_GWM_RECONF;
+}
+
+RTLIB_ExitCode_t SetConstraints(RTLIB_ExecutionContextHandler_t ech,
+		RTLIB_Constraint_t *constraints, uint8_t count) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	(void)ech;
+
+	for (uint8_t i = 0; i < count; ++i) {
+		RTLIB_Constraint_t const &c = constraints[i];
+		bool add = (c.operation == CONSTRAINT_ADD);
+
+		switch (c.type) {
+		case LOWER_BOUND:
+			sim.lower = add ? c.awm : 0;
+			break;
+		case UPPER_BOUND:
+			sim.upper = add ? c.awm : sim.awm_max;
+			break;
+		case EXACT_VALUE:
+			sim.lower = add ? c.awm : 0;
+			sim.upper = add ? c.awm : sim.awm_max;
+			break;
+		}
+	}
+	DB(fprintf(stderr, FD("Constraints: AWM in [%d, %d]\n"),
+				sim.lower, sim.upper));
+
+	// The scheduled AWM could be now within bounds
+	if (sim.enabled && sim.assigned != SIM_AWM_BLOCKED)
+		Require(sim.tmr.getElapsedTimeMs(), sim.scheduled, false);
+
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t ClearConstraints(RTLIB_ExecutionContextHandler_t ech) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	(void)ech;
+
+	sim.lower = 0;
+	sim.upper = sim.awm_max;
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t SetGoalGap(RTLIB_ExecutionContextHandler_t ech,
+		uint8_t gap) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	(void)ech;
+
+	sim.gap = gap;
+	if (!gap || !sim.gap_delay)
+		return RTLIB_OK;
+	sim.gap_due = sim.tmr.getElapsedTimeMs() + sim.gap_delay;
+	return RTLIB_OK;
+}
+
+RTLIB_ExitCode_t Disable(RTLIB_ExecutionContextHandler_t ech) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	(void)ech;
+
+	sim.enabled = false;
+	return RTLIB_OK;
+}
+
+void Unregister(RTLIB_ExecutionContextHandler_t ech) {
+	(void)ech;
+	fprintf(stderr, FI("EXC [%s] unregistered (stand-in RTLib)\n"),
+			sim.name.c_str());
+}
+
+const char *GetChUid() {
+	static char uid[] = "00000:ocvdemo";
+	snprintf(uid, sizeof(uid), "%05d:ocvdemo", getpid());
+	return uid;
+}
+
+RTLIB_ExitCode_t GetUid(RTLIB_ExecutionContextHandler_t ech,
+		uint64_t *uid) {
+	(void)ech;
+	*uid = (static_cast<uint64_t>(getpid()) << 5);
+	return RTLIB_OK;
+}
+
+bool LoadSchedule(std::string const &path) {
+	std::ifstream in(path.c_str());
+	std::string line;
+
+	if (!in)
+		return false;
+
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		std::string key, value;
+		Step step;
+
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (!(fields >> key))
+			continue;
+
+		if (key == "cpus") {
+			int awm;
+			uint32_t count;
+			if (!(fields >> awm >> count))
+				return false;
+			sim.awm_cpus[awm] = count;
+			continue;
+		}
+		if (key == "gap") {
+			if (!(fields >> sim.gap_delay))
+				return false;
+			continue;
+		}
+
+		if (!(fields >> value))
+			return false;
+		step.time = atof(key.c_str());
+		step.awm = (value == "block") ?
+			SIM_AWM_BLOCKED : atoi(value.c_str());
+		sim.awm_max = std::max(sim.awm_max, step.awm);
+		sim.timeline.push_back(step);
+	}
+
+	std::stable_sort(sim.timeline.begin(), sim.timeline.end(),
+			[](Step const &a, Step const &b) {
+				return a.time < b.time;
+			});
+
+	return !sim.timeline.empty();
+}
+
+RTLIB_Services_t services;
+
+} // namespace
+
+RTLIB_ExitCode_t RTLIB_SimInit(std::string const &schedule,
+		RTLIB_Services_t **rtlib) {
+
+	sim.enabled = false;
+	sim.next_step = 0;
+	sim.scheduled = SIM_AWM_BLOCKED;
+	sim.assigned = SIM_AWM_BLOCKED;
+	sim.awm_max = 0;
+	sim.gap_delay = SIM_GAP_DELAY_MS;
+	sim.gap_due = 0;
+	sim.gap = 0;
+	sim.reconfiguring = false;
+
+	if (!LoadSchedule(schedule)) {
+		fprintf(stderr, FE("ERROR: loading schedule [%s] FAILED!\n"),
+				schedule.c_str());
+		return RTLIB_ERROR;
+	}
+	sim.lower = 0;
+	sim.upper = sim.awm_max;
+	fprintf(stderr, FI("Schedule [%s]: %lu steps, up-to AWM [%d]\n"),
+			schedule.c_str(), sim.timeline.size(), sim.awm_max);
+
+	memset(&services, 0, sizeof(services));
+	services.version.major = RTLIB_VERSION_MAJOR;
+	services.version.minor = RTLIB_VERSION_MINOR;
+	services.Register = Register;
+	services.Enable = Enable;
+	services.GetWorkingMode = GetWorkingMode;
+	services.SetConstraints = SetConstraints;
+	services.ClearConstraints = ClearConstraints;
+	services.SetGoalGap = SetGoalGap;
+	services.Disable = Disable;
+	services.Unregister = Unregister;
+	services.Utils.GetChUid = GetChUid;
+	services.Utils.GetUid = GetUid;
+
+	*rtlib = &services;
+	return RTLIB_OK;
+}
+
+void RTLIB_SimReport(FILE *out) {
+	std::unique_lock<std::mutex> lck(sim.mtx);
+	std::vector<double>::const_iterator wbegin, wend;
+	double pickup, first, rate;
+	double lost;
+
+	fprintf(out, "===== Stand-in RTLib: %lu cycles, %lu AWM switches =====\n",
+			sim.cycles.size(), sim.switches.size());
+	fprintf(out, "%10s %5s %5s %4s %10s %10s %10s %8s\n",
+			"Due[ms]", "From", "To", "Gap", "Pickup[ms]", "First[ms]",
+			"Total[ms]", "Lost");
+
+	for (size_t i = 0; i < sim.switches.size(); ++i) {
+		Switch const &sw = sim.switches[i];
+		if (!sw.completed)
+			continue;
+
+		pickup = sw.delivered - sw.due;
+		first = sw.completed - sw.delivered;
+
+		// The cycle rate in the window before the switch
+		wbegin = std::lower_bound(sim.cycles.begin(), sim.cycles.end(),
+				sw.due - SIM_RATE_WINDOW_MS);
+		wend = std::lower_bound(sim.cycles.begin(), sim.cycles.end(),
+				sw.due);
+		rate = (wend - wbegin) / static_cast<double>(SIM_RATE_WINDOW_MS);
+
+		// Cycles expected at that rate, minus the completed ones
+		lost = rate * (sw.completed - sw.due) -
+			(std::upper_bound(sim.cycles.begin(), sim.cycles.end(),
+				sw.completed) - wend);
+
+		fprintf(out, "%10.1f %5d %5d %4s %10.3f %10.3f %10.3f %8.1f\n",
+				sw.due, sw.from, sw.to, sw.promotion ? "yes" : "no",
+				pickup, first, pickup + first, std::max(0.0, lost));
+	}
+}
@@ -0,0 +1,389 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.shm"
+
+// The ring header signature, written last by the producer
+#define SHM_RING_MAGIC 0x4f435652
+
+// The polling period of consumers waiting for a frame [us]
+#define SHM_RING_POLL_US 500
+
+using namespace cv;
+
+struct ShmRing::Header {
+	std::atomic<uint32_t> magic;
+	uint32_t slots;
+	int32_t width;
+	int32_t height;
+	int32_t type;
+	uint32_t slot_bytes;
+	uint64_t data_offset;
+	int32_t producer;
+
+	/** The number of frames published */
+	std::atomic<uint64_t> published;
+	std::atomic<uint32_t> eos;
+
+	struct Cursor {
+		/** The consumer process, 0 if the entry is free */
+		std::atomic<int32_t> pid;
+		/** The next frame to read */
+		std::atomic<uint64_t> next;
+		std::atomic<uint64_t> dropped;
+		std::atomic<uint64_t> torn;
+	} cursors[SHM_RING_CONSUMERS];
+
+	/**
+	 * The frame in each slot, plus one, 0 while the slot is written
+	 */
+	std::atomic<uint64_t> seq[SHM_RING_SLOTS_MAX];
+
+	/**
+	 * When the frame in each slot has been published [ms], guarded by
+	 * the slot sequence number as the frame itself
+	 */
+	double published_ms[SHM_RING_SLOTS_MAX];
+};
+
+static double NowMs() {
+	return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief The shared memory object name of a ring
+ */
+static std::string ObjectName(std::string const &name) {
+	return "/ocvdemo." + name;
+}
+
+static bool ProcessAlive(int32_t pid) {
+	return (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+ShmRing::ShmRing() :
+	producer(false),
+	length(0),
+	hdr(NULL),
+	data(NULL),
+	consumer(-1),
+	current(0),
+	frames(0),
+	published_ms(0) {
+}
+
+ShmRing::~ShmRing() {
+	Close();
+}
+
+bool ShmRing::Create(std::string const &_name, Size size, int type,
+		uint32_t slots) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t offset = (sizeof(Header) + page - 1) / page * page;
+	size_t slot_bytes = size.area() * CV_ELEM_SIZE(type);
+	int fd;
+
+	if (slots < 2 || slots > SHM_RING_SLOTS_MAX || !slot_bytes) {
+		fprintf(stderr, FE("Creating ring [%s] FAILED (%u slots)\n"),
+				_name.c_str(), slots);
+		return false;
+	}
+
+	// Slots are page aligned, as decoders write them with vector stores
+	slot_bytes = (slot_bytes + page - 1) / page * page;
+	length = offset + slots * slot_bytes;
+
+	name = _name;
+	shm_unlink(ObjectName(name).c_str());
+	fd = shm_open(ObjectName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0 || ftruncate(fd, length) != 0) {
+		fprintf(stderr, FE("Creating ring [%s] FAILED (%s)\n"),
+				name.c_str(), strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	hdr = static_cast<Header *>(mmap(NULL, length,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		hdr = NULL;
+		shm_unlink(ObjectName(name).c_str());
+		return false;
+	}
+
+	new (hdr) Header();
+	hdr->slots = slots;
+	hdr->width = size.width;
+	hdr->height = size.height;
+	hdr->type = type;
+	hdr->slot_bytes = slot_bytes;
+	hdr->data_offset = offset;
+	hdr->producer = getpid();
+	hdr->published.store(0);
+	hdr->eos.store(0);
+	for (uint32_t c = 0; c < SHM_RING_CONSUMERS; ++c) {
+		hdr->cursors[c].pid.store(0);
+		hdr->cursors[c].next.store(0);
+	}
+	for (uint32_t s = 0; s < SHM_RING_SLOTS_MAX; ++s) {
+		hdr->seq[s].store(0);
+		hdr->published_ms[s] = 0;
+	}
+	hdr->magic.store(SHM_RING_MAGIC, std::memory_order_release);
+
+	data = reinterpret_cast<uint8_t *>(hdr) + offset;
+	producer = true;
+	frames = 0;
+
+	fprintf(stderr, FI("Created ring [%s]: %u slots of %dx%d, %lu KB\n"),
+			name.c_str(), slots, size.width, size.height,
+			static_cast<unsigned long>(length / 1024));
+	return true;
+}
+
+bool ShmRing::Open(std::string const &_name) {
+	struct stat st;
+	int fd;
+
+	name = _name;
+	fd = shm_open(ObjectName(name).c_str(), O_RDWR, 0);
+	if (fd < 0 || fstat(fd, &st) != 0 ||
+			static_cast<size_t>(st.st_size) < sizeof(Header)) {
+		fprintf(stderr, FE("Opening ring [%s] FAILED (no producer?)\n"),
+				name.c_str());
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	length = st.st_size;
+	hdr = static_cast<Header *>(mmap(NULL, length,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	close(fd);
+	if (hdr == MAP_FAILED ||
+			hdr->magic.load(std::memory_order_acquire) != SHM_RING_MAGIC) {
+		fprintf(stderr, FE("Opening ring [%s] FAILED (not ready)\n"),
+				name.c_str());
+		if (hdr != MAP_FAILED)
+			munmap(hdr, length);
+		hdr = NULL;
+		return false;
+	}
+	data = reinterpret_cast<uint8_t *>(hdr) + hdr->data_offset;
+
+	// Grab a free cursor, starting from the latest frame
+	for (consumer = 0; consumer < SHM_RING_CONSUMERS; ++consumer) {
+		Header::Cursor &cur = hdr->cursors[consumer];
+		int32_t free_pid = 0;
+		uint64_t latest = hdr->published.load(std::memory_order_acquire);
+
+		if (!cur.pid.compare_exchange_strong(free_pid, getpid()))
+			continue;
+		cur.next.store(latest ? latest - 1 : 0);
+		cur.dropped.store(0);
+		cur.torn.store(0);
+		break;
+	}
+	if (consumer == SHM_RING_CONSUMERS) {
+		fprintf(stderr, FE("Opening ring [%s] FAILED (%d consumers)\n"),
+				name.c_str(), SHM_RING_CONSUMERS);
+		Close();
+		return false;
+	}
+
+	producer = false;
+	frames = 0;
+	fprintf(stderr, FI("Opened ring [%s]: %u slots of %dx%d, consumer %d\n"),
+			name.c_str(), hdr->slots, hdr->width, hdr->height, consumer);
+	return true;
+}
+
+void ShmRing::Close() {
+	if (!hdr)
+		return;
+
+	if (producer) {
+		hdr->eos.store(1, std::memory_order_release);
+		shm_unlink(ObjectName(name).c_str());
+	} else if (consumer >= 0 && consumer < SHM_RING_CONSUMERS) {
+		hdr->cursors[consumer].pid.store(0, std::memory_order_release);
+	}
+	munmap(hdr, length);
+
+	hdr = NULL;
+	data = NULL;
+	consumer = -1;
+}
+
+Size ShmRing::FrameSize() const {
+	if (!hdr)
+		return Size();
+	return Size(hdr->width, hdr->height);
+}
+
+uint8_t * ShmRing::SlotData(uint64_t frame) const {
+	return data + (frame % hdr->slots) * hdr->slot_bytes;
+}
+
+Mat ShmRing::Writable() {
+	current = hdr->published.load(std::memory_order_relaxed);
+
+	// Invalidate the slot before writing it
+	hdr->seq[current % hdr->slots].store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	return Mat(hdr->height, hdr->width, hdr->type, SlotData(current));
+}
+
+void ShmRing::Publish() {
+	hdr->published_ms[current % hdr->slots] = NowMs();
+	hdr->seq[current % hdr->slots].store(current + 1,
+			std::memory_order_release);
+	hdr->published.store(current + 1, std::memory_order_release);
+	++frames;
+}
+
+uint32_t ShmRing::Consumers(Consumer *status) {
+	uint64_t published = hdr->published.load(std::memory_order_acquire);
+	uint32_t count = 0;
+
+	for (uint32_t c = 0; c < SHM_RING_CONSUMERS; ++c) {
+		Header::Cursor &cur = hdr->cursors[c];
+		int32_t pid = cur.pid.load(std::memory_order_acquire);
+		uint64_t next;
+
+		if (!pid)
+			continue;
+		if (!ProcessAlive(pid)) {
+			fprintf(stderr, FW("Ring [%s]: consumer %u (pid %d) "
+						"terminated, detached\n"),
+					name.c_str(), c, pid);
+			cur.pid.compare_exchange_strong(pid, 0);
+			continue;
+		}
+
+		next = cur.next.load(std::memory_order_relaxed);
+		status[count].pid = pid;
+		status[count].lag = published > next ? published - next : 0;
+		status[count].dropped = cur.dropped.load(std::memory_order_relaxed);
+		status[count].torn = cur.torn.load(std::memory_order_relaxed);
+		++count;
+	}
+
+	return count;
+}
+
+bool ShmRing::Acquire(Mat &frame) {
+	Header::Cursor &cur = hdr->cursors[consumer];
+	uint64_t next = cur.next.load(std::memory_order_relaxed);
+	uint64_t published;
+
+	for (;;) {
+		published = hdr->published.load(std::memory_order_acquire);
+
+		// Wait for the next frame, until the end of stream
+		if (next >= published) {
+			if (hdr->eos.load(std::memory_order_acquire) ||
+					!ProcessAlive(hdr->producer))
+				return false;
+			std::this_thread::sleep_for(
+					std::chrono::microseconds(SHM_RING_POLL_US));
+			continue;
+		}
+
+		// Lapped by the producer: skip to the latest frame, the
+		// oldest ones being the next overwritten
+		if (published - next >= hdr->slots) {
+			cur.dropped.fetch_add(published - 1 - next,
+					std::memory_order_relaxed);
+			next = published - 1;
+		}
+
+		if (hdr->seq[next % hdr->slots].load(std::memory_order_acquire) ==
+				next + 1)
+			break;
+
+		// Overwritten right after the check above
+		++next;
+		cur.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	current = next;
+	published_ms = hdr->published_ms[current % hdr->slots];
+	cur.next.store(next + 1, std::memory_order_relaxed);
+	frame = Mat(hdr->height, hdr->width, hdr->type, SlotData(current));
+	return true;
+}
+
+uint64_t ShmRing::SkipToLatest() {
+	Header::Cursor &cur = hdr->cursors[consumer];
+	uint64_t next = cur.next.load(std::memory_order_relaxed);
+	uint64_t published = hdr->published.load(std::memory_order_acquire);
+	uint64_t skipped;
+
+	if (published <= next + 1)
+		return 0;
+
+	skipped = published - 1 - next;
+	cur.dropped.fetch_add(skipped, std::memory_order_relaxed);
+	cur.next.store(published - 1, std::memory_order_relaxed);
+	return skipped;
+}
+
+bool ShmRing::Release() {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (hdr->seq[current % hdr->slots].load(std::memory_order_relaxed) ==
+			current + 1) {
+		++frames;
+		return true;
+	}
+
+	hdr->cursors[consumer].torn.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+uint64_t ShmRing::Dropped() const {
+	if (!hdr || producer)
+		return 0;
+	return hdr->cursors[consumer].dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t ShmRing::Torn() const {
+	if (!hdr || producer)
+		return 0;
+	return hdr->cursors[consumer].torn.load(std::memory_order_relaxed);
+}
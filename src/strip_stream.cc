@@ -0,0 +1,143 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "strip_stream.h"
+
+using namespace cv;
+
+StripStream::StripStream(uint32_t rows) :
+	rows(rows),
+	memory(NULL),
+	subsys(0) {
+}
+
+void StripStream::Attach(MemoryBudget &memory, uint8_t subsys) {
+	this->memory = &memory;
+	this->subsys = subsys;
+	for (uint32_t w = 0; w < scratch.size(); ++w) {
+		memory.Attach(scratch[w].gray, subsys);
+		memory.Attach(scratch[w].work, subsys);
+	}
+}
+
+void StripStream::Split(Size const &frame, int halo, uint32_t workers) {
+	uint32_t count = rows ? (frame.height + rows - 1) / rows : 1;
+
+	strips.clear();
+	SplitStrips(Rect(0, 0, frame.width, frame.height), frame, count, halo,
+			strips);
+
+	if (scratch.size() >= workers)
+		return;
+	scratch.resize(workers);
+	for (uint32_t w = 0; memory && w < workers; ++w) {
+		memory->Attach(scratch[w].gray, subsys);
+		memory->Attach(scratch[w].work, subsys);
+	}
+}
+
+void StripStream::Canny(Mat const &bgr, Mat &edges, WorkerPool &pool,
+		Kernels const &kernels) {
+	double fy = static_cast<double>(edges.rows) / bgr.rows;
+
+	Split(bgr.size(), EFFECT_CANNY_HALO, pool.Size());
+
+	for (uint32_t first = 0; first < strips.size(); first += pool.Size()) {
+		uint32_t count = std::min<uint32_t>(pool.Size(),
+				strips.size() - first);
+
+		pool.Run(count, [&, first](uint32_t w) {
+			Strip const &strip = strips[first + w];
+			Scratch &sc = scratch[w];
+			int skip = strip.rows.start - strip.halo.start;
+			int r0 = round(strip.rows.start * fy);
+			int r1 = round(strip.rows.end * fy);
+
+			kernels.BgrToGray(Mat(bgr, strip.halo, strip.halo_cols),
+					sc.gray);
+			GaussianBlur(sc.gray, sc.work, Size(7,7), 1.5, 1.5);
+			cv::Canny(sc.work, sc.work, 0, 30, 3);
+
+			// Scale down just the strip rows, into the output ones
+			if (r1 <= r0)
+				return;
+			Mat out(edges, Range(r0, r1), Range::all());
+			resize(sc.work(Range(skip, skip + strip.rows.size()),
+						Range::all()),
+					out, out.size(), 0, 0, INTER_AREA);
+		});
+	}
+}
+
+void StripStream::Detect(Mat const &bgr, Size const &out,
+		FeatureDetector const &fd, WorkerPool &pool,
+		Kernels const &kernels, std::vector<KeyPoint> &kps) {
+	float fx = static_cast<float>(out.width) / bgr.cols;
+	float fy = static_cast<float>(out.height) / bgr.rows;
+
+	Split(bgr.size(), EFFECT_FAST_HALO, pool.Size());
+
+	for (uint32_t first = 0; first < strips.size(); first += pool.Size()) {
+		uint32_t count = std::min<uint32_t>(pool.Size(),
+				strips.size() - first);
+
+		pool.Run(count, [&, first](uint32_t w) {
+			Strip const &strip = strips[first + w];
+			Scratch &sc = scratch[w];
+			std::vector<KeyPoint>::iterator it;
+
+			kernels.BgrToGray(Mat(bgr, strip.halo, strip.halo_cols),
+					sc.gray);
+			fd.detect(sc.gray, sc.kps);
+
+			// Back to frame coordinates, dropping keypoints in the
+			// halos, then scaled to the output ones
+			sc.kps.erase(std::remove_if(sc.kps.begin(), sc.kps.end(),
+				[&strip](KeyPoint const &kp) {
+					return (kp.pt.y + strip.halo.start <
+							strip.rows.start ||
+						kp.pt.y + strip.halo.start >=
+							strip.rows.end);
+				}), sc.kps.end());
+			for (it = sc.kps.begin(); it != sc.kps.end(); ++it) {
+				it->pt.x = (it->pt.x + strip.halo_cols.start) * fx;
+				it->pt.y = (it->pt.y + strip.halo.start) * fy;
+				it->size *= fx;
+			}
+		});
+
+		// Keypoints are appended in strips order
+		for (uint32_t w = 0; w < count; ++w)
+			kps.insert(kps.end(), scratch[w].kps.begin(),
+					scratch[w].kps.end());
+	}
+}
+
+size_t StripStream::ScratchBytes() const {
+	size_t bytes = 0;
+
+	for (uint32_t w = 0; w < scratch.size(); ++w) {
+		bytes += scratch[w].gray.total() * scratch[w].gray.elemSize();
+		bytes += scratch[w].work.total() * scratch[w].work.elemSize();
+		bytes += scratch[w].kps.capacity() * sizeof(KeyPoint);
+	}
+
+	return bytes;
+}
@@ -0,0 +1,217 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include "synthetic_source.h"
+
+using namespace cv;
+
+static double NowMs() {
+	return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief The position along a range, bouncing at its edges
+ */
+static int Bounce(double pos, int range) {
+	double period = 2.0 * range;
+	double off;
+
+	if (range <= 0)
+		return 0;
+	off = fmod(pos, period);
+	if (off < 0)
+		off += period;
+	if (off > range)
+		off = period - off;
+	return static_cast<int>(off);
+}
+
+SyntheticSource::Config::Config() :
+	size(640, 480),
+	seed(1),
+	shapes(16),
+	noise(8),
+	fps(0),
+	jitter_ms(0) {
+}
+
+bool SyntheticSource::Parse(std::string const &spec, Config &cfg) {
+	std::istringstream in(spec);
+	std::string token;
+	char key[16];
+	double value;
+	int w, h;
+
+	while (std::getline(in, token, ',')) {
+		if (token.empty())
+			continue;
+		if (sscanf(token.c_str(), "%dx%d", &w, &h) == 2) {
+			if (w < 16 || h < 16)
+				return false;
+			cfg.size = Size(w, h);
+			continue;
+		}
+		if (sscanf(token.c_str(), "%15[a-z]=%lf", key, &value) != 2 ||
+				value < 0)
+			return false;
+
+		if (!strcmp(key, "seed"))
+			cfg.seed = value;
+		else if (!strcmp(key, "shapes"))
+			cfg.shapes = value;
+		else if (!strcmp(key, "noise") && value <= 255)
+			cfg.noise = value;
+		else if (!strcmp(key, "fps"))
+			cfg.fps = value;
+		else if (!strcmp(key, "jitter"))
+			cfg.jitter_ms = value;
+		else
+			return false;
+	}
+
+	return true;
+}
+
+SyntheticSource::SyntheticSource() :
+	frame(0),
+	dropped(0),
+	tstart(0),
+	captured_ms(0) {
+}
+
+void SyntheticSource::Setup(Config const &cfg) {
+	int side = std::min(cfg.size.width, cfg.size.height);
+	float speed = side / 100.0 + 1;
+	Mat small(4, 4, CV_8UC3);
+
+	this->cfg = cfg;
+	rng = RNG(cfg.seed);
+	frame = 0;
+	dropped = 0;
+	tstart = 0;
+	captured_ms = 0;
+
+	// A smooth background, thus with (almost) no keypoints
+	rng.fill(small, RNG::UNIFORM, Scalar::all(64), Scalar::all(192));
+	resize(small, background, cfg.size, 0, 0, INTER_LINEAR);
+
+	// Shapes with a blocky random texture, i.e. plenty of corners
+	shapes.resize(cfg.shapes);
+	for (uint32_t s = 0; s < shapes.size(); ++s) {
+		Shape &shape = shapes[s];
+		int width = rng.uniform(side / 16, side / 5 + 1) + 8;
+		int height = rng.uniform(side / 16, side / 5 + 1) + 8;
+		int cell = rng.uniform(3, 12);
+
+		small.create((height + cell - 1) / cell, (width + cell - 1) / cell,
+				CV_8UC3);
+		rng.fill(small, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+		resize(small, shape.sprite, Size(width, height), 0, 0,
+				INTER_NEAREST);
+
+		// Either a rectangle or an ellipse
+		shape.mask.create(height, width, CV_8UC1);
+		shape.mask.setTo(Scalar(255));
+		if (rng.uniform(0, 2)) {
+			shape.mask.setTo(Scalar(0));
+			ellipse(shape.mask, Point(width / 2, height / 2),
+					Size(width / 2, height / 2), 0, 0, 360,
+					Scalar(255), -1);
+		}
+
+		shape.origin = Point2f(
+				rng.uniform(0.f, static_cast<float>(cfg.size.width)),
+				rng.uniform(0.f, static_cast<float>(cfg.size.height)));
+		shape.speed = Point2f(
+				rng.uniform(-speed, speed), rng.uniform(-speed, speed));
+	}
+
+	// Noise is cycled over a few pre-generated frames
+	for (uint8_t n = 0; n < SYNTHETIC_NOISE_FRAMES; ++n) {
+		noise[n].release();
+		if (!cfg.noise)
+			continue;
+		noise[n].create(cfg.size, CV_8UC3);
+		rng.fill(noise[n], RNG::UNIFORM, Scalar::all(0),
+				Scalar::all(cfg.noise + 1));
+	}
+}
+
+void SyntheticSource::Pace() {
+	double period = 1e3 / cfg.fps;
+	double now = NowMs();
+	double due;
+	uint64_t late;
+
+	if (!tstart)
+		tstart = now;
+
+	// Frames not read in time are lost, as with a camera
+	due = tstart + frame * period;
+	if (now > due + period) {
+		late = (now - due) / period;
+		frame += late;
+		dropped += late;
+		due += late * period;
+	}
+
+	// Captured when due, then delivered with some delay (if any)
+	captured_ms = due;
+	if (cfg.jitter_ms)
+		due += rng.uniform(0., cfg.jitter_ms);
+	if (due > now)
+		std::this_thread::sleep_for(
+				std::chrono::duration<double, std::milli>(due - now));
+}
+
+void SyntheticSource::Read(Mat &out) {
+
+	if (cfg.fps)
+		Pace();
+	else
+		captured_ms = NowMs();
+
+	background.copyTo(out);
+	for (uint32_t s = 0; s < shapes.size(); ++s) {
+		Shape const &shape = shapes[s];
+		Rect area(
+			Bounce(shape.origin.x + shape.speed.x * frame,
+				cfg.size.width - shape.sprite.cols),
+			Bounce(shape.origin.y + shape.speed.y * frame,
+				cfg.size.height - shape.sprite.rows),
+			std::min(shape.sprite.cols, cfg.size.width),
+			std::min(shape.sprite.rows, cfg.size.height));
+		Mat dst(out, area);
+
+		shape.sprite(Rect(0, 0, area.width, area.height)).copyTo(dst,
+				shape.mask(Rect(0, 0, area.width, area.height)));
+	}
+
+	if (cfg.noise)
+		add(out, noise[rng.uniform(0, SYNTHETIC_NOISE_FRAMES)], out);
+
+	++frame;
+}
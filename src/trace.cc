@@ -0,0 +1,236 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "trace.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.trc"
+
+namespace {
+
+struct TraceEvent {
+	char const *name;
+	uint64_t ts;
+	uint64_t dur;
+	int64_t arg;
+	pid_t tid;
+	char phase;
+};
+
+struct TraceRing {
+	TraceEvent events[TRACE_RING_EVENTS];
+	/** The count of events recorded, written only by the owner */
+	std::atomic<uint64_t> head;
+	/** The count of events already flushed */
+	uint64_t tail;
+	/** Set while a thread is recording into the ring */
+	std::atomic<bool> owned;
+	pid_t tid;
+
+	TraceRing() : head(0), tail(0), owned(true), tid(0) {}
+};
+
+/** Releases the ring of a thread at its termination */
+struct TraceRingOwner {
+	TraceRing *ring;
+
+	TraceRingOwner() : ring(NULL) {}
+
+	~TraceRingOwner() {
+		if (ring)
+			ring->owned.store(false, std::memory_order_release);
+	}
+};
+
+// The rings are never released, thus events of terminated threads are
+// flushed too, and the ring is reused by the next started thread
+std::mutex rings_mtx;
+std::vector<TraceRing *> rings;
+std::map<pid_t, std::string> thread_names;
+
+thread_local TraceRingOwner owner;
+
+TraceRing *GetRing() {
+	TraceRing *ring;
+
+	if (owner.ring)
+		return owner.ring;
+
+	std::unique_lock<std::mutex> lck(rings_mtx);
+	for (uint32_t r = 0; r < rings.size(); ++r) {
+		bool owned = false;
+		if (rings[r]->owned.compare_exchange_strong(owned, true)) {
+			owner.ring = rings[r];
+			break;
+		}
+	}
+	if (!owner.ring) {
+		ring = new TraceRing();
+		rings.push_back(ring);
+		owner.ring = ring;
+	}
+	owner.ring->tid = syscall(SYS_gettid);
+
+	return owner.ring;
+}
+
+void Record(char phase, char const *name, uint64_t ts, uint64_t dur,
+		int64_t arg) {
+	TraceRing *ring = GetRing();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	TraceEvent &evt = ring->events[head % TRACE_RING_EVENTS];
+
+	evt.name = name;
+	evt.ts = ts;
+	evt.dur = dur;
+	evt.arg = arg;
+	evt.tid = ring->tid;
+	evt.phase = phase;
+
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+/** Write a string literal, escaping the JSON special characters */
+void WriteString(FILE *out, char const *str) {
+	fputc('"', out);
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', out);
+		fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+void WriteEvent(FILE *out, TraceEvent const &evt, pid_t pid) {
+	fputs("{\"name\":", out);
+	WriteString(out, evt.name);
+	fprintf(out, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+			evt.phase, evt.ts / 1e3, pid, evt.tid);
+
+	switch (evt.phase) {
+	case 'X':
+		fprintf(out, ",\"dur\":%.3f", evt.dur / 1e3);
+		break;
+	case 'i':
+		fputs(",\"s\":\"t\"", out);
+		break;
+	case 'C':
+		fprintf(out, ",\"args\":{\"value\":%lld}}",
+				static_cast<long long>(evt.arg));
+		return;
+	}
+
+	if (evt.arg >= 0)
+		fprintf(out, ",\"args\":{\"arg\":%lld}",
+				static_cast<long long>(evt.arg));
+	fputc('}', out);
+}
+
+} // namespace
+
+std::atomic<bool> Trace::enabled(false);
+std::atomic<bool> Trace::flush_requested(false);
+
+void Trace::Enable(bool on) {
+	enabled.store(on, std::memory_order_relaxed);
+}
+
+uint64_t Trace::Now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void Trace::ThreadName(char const *name) {
+	std::unique_lock<std::mutex> lck(rings_mtx);
+	thread_names[syscall(SYS_gettid)] = name;
+}
+
+void Trace::Complete(char const *name, uint64_t start, uint64_t end,
+		int64_t arg) {
+	Record('X', name, start, end - start, arg);
+}
+
+void Trace::Instant(char const *name, int64_t arg) {
+	Record('i', name, Now(), 0, arg);
+}
+
+void Trace::Counter(char const *name, int64_t value) {
+	Record('C', name, Now(), 0, value);
+}
+
+int Trace::Flush(std::string const &path) {
+	std::map<pid_t, std::string>::const_iterator it;
+	pid_t pid = getpid();
+	char const *sep = "";
+	int count = 0;
+	FILE *out;
+
+	out = fopen(path.c_str(), "w");
+	if (!out) {
+		fprintf(stderr, FE("ERROR: cannot write trace [%s]\n"),
+				path.c_str());
+		return -1;
+	}
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+
+	std::unique_lock<std::mutex> lck(rings_mtx);
+	for (it = thread_names.begin(); it != thread_names.end(); ++it) {
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+				sep, pid, it->first);
+		WriteString(out, it->second.c_str());
+		fputs("}}", out);
+		sep = ",\n";
+	}
+
+	for (uint32_t r = 0; r < rings.size(); ++r) {
+		TraceRing &ring = *rings[r];
+		uint64_t head = ring.head.load(std::memory_order_acquire);
+		uint64_t first = ring.tail;
+
+		// Events older than a full ring have been overwritten
+		if (head - first > TRACE_RING_EVENTS)
+			first = head - TRACE_RING_EVENTS;
+		for (uint64_t e = first; e < head; ++e, ++count) {
+			fputs(sep, out);
+			WriteEvent(out, ring.events[e % TRACE_RING_EVENTS], pid);
+			sep = ",\n";
+		}
+		ring.tail = head;
+	}
+	lck.unlock();
+
+	fputs("\n]}\n", out);
+	fclose(out);
+
+	fprintf(stderr, FI("Trace: %d events written to [%s]\n"),
+			count, path.c_str());
+	return count;
+}
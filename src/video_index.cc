@@ -0,0 +1,261 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "video_index.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.vix"
+
+// The suffix of the default index path
+#define VIDEO_INDEX_SUFFIX ".idx"
+
+// The first line of an index file
+#define VIDEO_INDEX_MAGIC "# OCVDemo video index v2"
+
+using namespace cv;
+
+/**
+ * @brief The size and modification time [ns] of a video file
+ */
+static bool VideoStat(std::string const &video, uint64_t &size,
+		int64_t &mtime) {
+	struct stat st;
+
+	if (stat(video.c_str(), &st))
+		return false;
+	size = st.st_size;
+	mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	return true;
+}
+
+VideoIndex::VideoIndex() :
+	video_size(0),
+	video_mtime(0),
+	frames(0),
+	fps(0),
+	interval(0) {
+}
+
+std::string VideoIndex::DefaultPath(std::string const &video) {
+	return video + VIDEO_INDEX_SUFFIX;
+}
+
+uint64_t VideoIndex::Hash(Mat const &frame) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t row_bytes = frame.cols * frame.elemSize();
+
+	for (int r = 0; r < frame.rows; ++r) {
+		uchar const *p = frame.ptr<uchar>(r);
+		for (size_t i = 0; i < row_bytes; ++i) {
+			hash ^= p[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+bool VideoIndex::Build(std::string const &path, uint32_t _interval) {
+	std::vector<SeekPoint> candidates;
+	VideoCapture cap(path);
+	uint32_t dropped = 0;
+	Mat frame;
+
+	if (!cap.isOpened() || !_interval ||
+			!VideoStat(path, video_size, video_mtime)) {
+		fprintf(stderr, FE("Indexing [%s] FAILED (open)\n"), path.c_str());
+		return false;
+	}
+
+	video = path;
+	interval = _interval;
+	fps = cap.get(CV_CAP_PROP_FPS);
+	points.clear();
+
+	// Decode sequentially, hashing the candidate seek points, since the
+	// frames count reported by the container is just an estimate
+	fprintf(stderr, FI("Indexing [%s], candidate seek points every %u frames...\n"),
+			path.c_str(), interval);
+	for (frames = 0; cap.read(frame); ++frames) {
+		if (frames % interval)
+			continue;
+		SeekPoint pt = { frames, Hash(frame) };
+		candidates.push_back(pt);
+	}
+	if (!frames) {
+		fprintf(stderr, FE("Indexing [%s] FAILED (no frames)\n"),
+				path.c_str());
+		return false;
+	}
+
+	// Keep just the candidates which seeking decodes exactly; the first
+	// frame is always a seek point, since each capture starts from it
+	points.push_back(candidates[0]);
+	for (size_t i = 1; i < candidates.size(); ++i) {
+		SeekPoint const &pt = candidates[i];
+		cap.set(CV_CAP_PROP_POS_FRAMES, pt.frame);
+		if (!cap.read(frame) || Hash(frame) != pt.hash) {
+			++dropped;
+			continue;
+		}
+		points.push_back(pt);
+	}
+
+	fprintf(stderr, FI("Indexed [%s]: %u frames, %zu seek points "
+				"(%u inexact dropped)\n"),
+			path.c_str(), frames, points.size(), dropped);
+	if (dropped)
+		fprintf(stderr, FW("Seeking [%s] is not frame accurate, "
+					"chunks merged at %u inexact points\n"),
+				path.c_str(), dropped);
+	return true;
+}
+
+bool VideoIndex::Save(std::string const &path) const {
+	FILE *out = fopen(path.c_str(), "w");
+
+	if (!out) {
+		fprintf(stderr, FE("Saving index [%s] FAILED\n"), path.c_str());
+		return false;
+	}
+
+	fprintf(out, "%s\n", VIDEO_INDEX_MAGIC);
+	fprintf(out, "video %s\n", video.c_str());
+	fprintf(out, "size %" PRIu64 "\n", video_size);
+	fprintf(out, "mtime %" PRId64 "\n", video_mtime);
+	fprintf(out, "frames %u\n", frames);
+	fprintf(out, "fps %.3f\n", fps);
+	fprintf(out, "interval %u\n", interval);
+	for (size_t i = 0; i < points.size(); ++i)
+		fprintf(out, "point %u %016" PRIx64 "\n",
+				points[i].frame, points[i].hash);
+
+	fclose(out);
+	return true;
+}
+
+bool VideoIndex::Load(std::string const &path, std::string const &_video) {
+	FILE *in = fopen(path.c_str(), "r");
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	char line[1024];
+	char name[1024];
+	SeekPoint pt;
+	bool valid;
+
+	if (!in)
+		return false;
+
+	points.clear();
+	video_size = 0;
+	video_mtime = 0;
+	valid = (fgets(line, sizeof(line), in) &&
+			strncmp(line, VIDEO_INDEX_MAGIC, strlen(VIDEO_INDEX_MAGIC)) == 0);
+	while (valid && fgets(line, sizeof(line), in)) {
+		if (sscanf(line, "point %u %" SCNx64, &pt.frame, &pt.hash) == 2) {
+			// Seek points are sorted, and within the video
+			valid = (points.empty() || pt.frame > points.back().frame);
+			points.push_back(pt);
+			continue;
+		}
+		if (sscanf(line, "video %1023[^\n]", name) == 1) {
+			video = name;
+			continue;
+		}
+		if (sscanf(line, "size %" SCNu64, &video_size) == 1 ||
+				sscanf(line, "mtime %" SCNd64, &video_mtime) == 1 ||
+				sscanf(line, "frames %u", &frames) == 1 ||
+				sscanf(line, "fps %lf", &fps) == 1 ||
+				sscanf(line, "interval %u", &interval) == 1)
+			continue;
+		valid = false;
+	}
+	fclose(in);
+
+	valid = valid && !points.empty() && points[0].frame == 0 &&
+		points.back().frame < frames;
+	if (!valid) {
+		fprintf(stderr, FW("Loading index [%s] FAILED (malformed)\n"),
+				path.c_str());
+		points.clear();
+		return false;
+	}
+
+	// The video changed since it was indexed
+	if (!VideoStat(_video, size, mtime) ||
+			size != video_size || mtime != video_mtime) {
+		fprintf(stderr, FW("Index [%s] is stale for [%s]\n"),
+				path.c_str(), _video.c_str());
+		points.clear();
+		return false;
+	}
+
+	fprintf(stderr, FI("Loaded index [%s]: %u frames, %zu seek points\n"),
+			path.c_str(), frames, points.size());
+	return true;
+}
+
+void VideoIndex::Chunks(uint32_t count, std::vector<Range> &chunks) const {
+	uint32_t start = 0;
+	size_t next = 1;
+
+	chunks.clear();
+	if (!frames || points.empty())
+		return;
+	if (!count)
+		count = 1;
+
+	// Close each chunk at the first seek point past its share of frames,
+	// re-balancing the following ones on the frames left
+	while (start < frames) {
+		uint32_t left = count - chunks.size();
+		uint32_t target = start + (frames - start + left - 1) / left;
+		uint32_t end = frames;
+
+		for (; next < points.size(); ++next) {
+			if (points[next].frame < target)
+				continue;
+			end = points[next++].frame;
+			break;
+		}
+		if (left <= 1)
+			end = frames;
+		chunks.push_back(Range(start, end));
+		start = end;
+	}
+}
+
+bool VideoIndex::Seek(VideoCapture &cap, uint32_t frame, Mat &first) const {
+	size_t i;
+
+	for (i = 0; i < points.size(); ++i)
+		if (points[i].frame == frame)
+			break;
+	if (i == points.size())
+		return false;
+
+	// The first frame requires no seeking, the capture being just opened
+	if (frame)
+		cap.set(CV_CAP_PROP_POS_FRAMES, frame);
+	return (cap.read(first) && Hash(first) == points[i].hash);
+}
@@ -0,0 +1,99 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "shm_ring.h"
+#include "utils.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.vwr"
+
+namespace po = boost::program_options;
+using namespace cv;
+
+/**
+ * The decription of each viewer parameters
+ */
+po::options_description opts_desc("BBQ-OpenCV Demo Preview Viewer Options");
+
+/**
+ * The map of all viewer parameters values
+ */
+po::variables_map opts_vm;
+
+void ParseCommandLine(int argc, char *argv[]) {
+	// Parse command line params
+	try {
+	po::store(po::parse_command_line(argc, argv, opts_desc), opts_vm);
+	} catch(...) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_FAILURE);
+	}
+	po::notify(opts_vm);
+
+	// Check for help request
+	if (opts_vm.count("help")) {
+		std::cout << "Usage: " << argv[0] << " [options]\n";
+		std::cout << opts_desc << std::endl;
+		::exit(EXIT_SUCCESS);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	std::string ring_name;
+	ShmRing ring;
+	Mat slot, frame;
+	uint8_t key = 0;
+
+	opts_desc.add_options()
+		("help,h", "print this help message")
+		("preview,p", po::value<std::string>(&ring_name)->
+			default_value("preview"),
+			"the preview ring name, as given to bbque-ocvdemo --preview")
+	;
+
+	ParseCommandLine(argc, argv);
+
+	if (!ring.Open(ring_name))
+		return EXIT_FAILURE;
+	namedWindow(ring_name.c_str(), CV_WINDOW_AUTOSIZE);
+
+	// Copy each frame out of the ring right away, since the producer
+	// overwrites it two frames later
+	while (key != 'q' && key != 27 && ring.Acquire(slot)) {
+		slot.copyTo(frame);
+		if (!ring.Release())
+			continue;
+		imshow(ring_name.c_str(), frame);
+		key = (cvWaitKey(1) & 255);
+	}
+
+	fprintf(stderr, FI("Preview [%s]: %lu frames, %lu torn\n"),
+			ring_name.c_str(),
+			static_cast<unsigned long>(ring.Frames()),
+			static_cast<unsigned long>(ring.Torn()));
+	ring.Close();
+
+	return EXIT_SUCCESS;
+}
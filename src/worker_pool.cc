@@ -0,0 +1,169 @@
+/* Copyright (C) 2012  Politecnico di Milano
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+// Setup logging
+#undef  BBQUE_LOG_MODULE
+#define BBQUE_LOG_MODULE "ocvdemo.wkp"
+
+WorkerPool::WorkerPool() :
+	generation(0),
+	started(0),
+	task(NULL),
+	count(0),
+	next(0),
+	batch(0),
+	busy(0),
+	stopping(false) {
+	sched_getaffinity(0, sizeof(cpus), &cpus);
+}
+
+WorkerPool::~WorkerPool() {
+	Stop();
+}
+
+void WorkerPool::Stop() {
+	std::unique_lock<std::mutex> lck(mtx);
+	stopping = true;
+	lck.unlock();
+	start_cv.notify_all();
+
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+	tids.clear();
+	started = 0;
+	stopping = false;
+}
+
+void WorkerPool::Resize(uint32_t parallelism) {
+	if (parallelism < 1)
+		parallelism = 1;
+	if (parallelism == Size())
+		return;
+
+	// Reconfigurations are not frequent: just respawn all the workers
+	Stop();
+	++generation;
+	tids.resize(parallelism - 1);
+	for (uint32_t id = 0; id < parallelism - 1; ++id)
+		workers.push_back(std::thread(&WorkerPool::Worker, this, id, batch));
+
+	// Wait for all the workers to be started, thus their IDs are known
+	std::unique_lock<std::mutex> lck(mtx);
+	while (started < workers.size())
+		done_cv.wait(lck);
+
+	DB(fprintf(stderr, FD("Worker pool resized: %d threads\n"), Size()));
+}
+
+void WorkerPool::Pin(uint32_t id, pthread_t thread) {
+	uint32_t ncpus = CPU_COUNT(&cpus);
+	uint32_t target;
+	cpu_set_t cpu;
+
+	if (!ncpus)
+		return;
+
+	// Select the (id % ncpus)-th CPU of the set
+	target = id % ncpus;
+	for (int c = 0; c < CPU_SETSIZE; ++c) {
+		if (!CPU_ISSET(c, &cpus))
+			continue;
+		if (target--)
+			continue;
+		CPU_ZERO(&cpu);
+		CPU_SET(c, &cpu);
+		pthread_setaffinity_np(thread, sizeof(cpu), &cpu);
+		return;
+	}
+}
+
+void WorkerPool::SetAffinity(cpu_set_t const &cpuset) {
+	cpus = cpuset;
+	for (uint32_t id = 0; id < workers.size(); ++id)
+		Pin(id, workers[id].native_handle());
+}
+
+void WorkerPool::Drain() {
+	uint32_t i;
+
+	while ((i = next++) < count) {
+		TRACE_SCOPE("task", i);
+		(*task)(i);
+	}
+}
+
+void WorkerPool::Run(uint32_t tasks, Task const &t) {
+
+	// Nothing to share with workers
+	if (workers.empty() || tasks == 1) {
+		for (uint32_t i = 0; i < tasks; ++i)
+			t(i);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lck(mtx);
+	task = &t;
+	count = tasks;
+	next = 0;
+	busy = workers.size();
+	++batch;
+	lck.unlock();
+	start_cv.notify_all();
+
+	// The calling thread does its share of the work too
+	Drain();
+
+	lck.lock();
+	while (busy)
+		done_cv.wait(lck);
+	task = NULL;
+}
+
+void WorkerPool::Worker(uint32_t id, uint64_t done_batch) {
+	std::unique_lock<std::mutex> lck(mtx);
+
+	// Workers are pinned as soon as they start
+	Pin(id, pthread_self());
+	Trace::ThreadName("worker");
+	tids[id] = syscall(SYS_gettid);
+	++started;
+	done_cv.notify_all();
+
+	while (true) {
+		while (!stopping && done_batch == batch)
+			start_cv.wait(lck);
+		if (stopping)
+			return;
+		done_batch = batch;
+		lck.unlock();
+
+		Drain();
+
+		lck.lock();
+		if (--busy == 0)
+			done_cv.notify_one();
+	}
+}